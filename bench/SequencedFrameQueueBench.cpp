@@ -0,0 +1,171 @@
+// Compares SequencedFrameQueue against the scan it replaced in the ordered
+// stages (FaceDetector/FaceTracker assignment, FaceMapper, OutputDriver and
+// EventLogger replay). Those used to keep an unordered_map of pending frames
+// and, on every wakeup, walk the whole map (by value) under their mutex to
+// find the lowest frame which hadn't been handled yet.
+//
+// Frames are kept `depth` deep in the queue, and become ready slightly out of
+// order (shuffled within small windows, the way parallel upstream stages
+// finish them). Every ready signal wakes the stage, which then takes as many
+// in-order frames as it can. Both implementations must hand out the same frames
+// in the same order.
+//
+// Usage: yer-face-bench-sequencedframequeue [depth] [frames]
+
+#include "SequencedFrameQueue.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+using namespace YerFace;
+
+#define YERFACE_BENCH_DEFAULT_DEPTH 200
+#define YERFACE_BENCH_DEFAULT_FRAMES 200000
+#define YERFACE_BENCH_READY_WINDOW 8
+
+//What each ordered stage used to keep per frame.
+class LegacyPendingFrame {
+public:
+	FrameNumber frameNumber;
+	bool ready;
+	bool completed;
+};
+
+class BenchResult {
+public:
+	double seconds;
+	size_t wakeups, scannedEntries;
+	FrameNumber lastFrameNumber;
+	FrameNumber checksum;
+};
+
+static BenchResult benchLegacyScan(const vector<FrameNumber> &readyOrder, size_t depth) {
+	BenchResult result = { 0.0, 0, 0, -1, 0 };
+	unordered_map<FrameNumber, LegacyPendingFrame> pendingFrames;
+	FrameNumber frames = (FrameNumber)readyOrder.size();
+	FrameNumber nextInsert = 1;
+
+	auto start = chrono::steady_clock::now();
+	for(FrameNumber readyFrameNumber : readyOrder) {
+		while(nextInsert <= frames && nextInsert <= readyFrameNumber + (FrameNumber)depth) {
+			LegacyPendingFrame pendingFrame;
+			pendingFrame.frameNumber = nextInsert;
+			pendingFrame.ready = false;
+			pendingFrame.completed = false;
+			pendingFrames[nextInsert] = pendingFrame;
+			nextInsert++;
+		}
+		pendingFrames[readyFrameNumber].ready = true;
+
+		//The worker keeps scanning for as long as it finds work.
+		for(;;) {
+			result.wakeups++;
+			FrameNumber lowestPendingFrameNumber = -1;
+			for(auto pendingFramePair : pendingFrames) {
+				LegacyPendingFrame *pendingFrame = &pendingFramePair.second;
+				if((lowestPendingFrameNumber < 0 || pendingFrame->frameNumber < lowestPendingFrameNumber) && !pendingFrame->completed) {
+					lowestPendingFrameNumber = pendingFrame->frameNumber;
+				}
+				result.scannedEntries++;
+			}
+			if(lowestPendingFrameNumber < 0 || !pendingFrames[lowestPendingFrameNumber].ready) {
+				break;
+			}
+			if(lowestPendingFrameNumber <= result.lastFrameNumber) {
+				fprintf(stderr, "Legacy scan handed out frames out of order!\n");
+				exit(1);
+			}
+			result.lastFrameNumber = lowestPendingFrameNumber;
+			result.checksum += lowestPendingFrameNumber;
+			//Completed frames lingered until they were GONE. Here they go right away, which flatters the legacy scan.
+			pendingFrames.erase(lowestPendingFrameNumber);
+		}
+	}
+	result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+static BenchResult benchSequencedFrameQueue(const vector<FrameNumber> &readyOrder, size_t depth) {
+	BenchResult result = { 0.0, 0, 0, -1, 0 };
+	SequencedFrameQueue queue("Bench");
+	FrameNumber frames = (FrameNumber)readyOrder.size();
+	FrameNumber nextInsert = 1;
+
+	auto start = chrono::steady_clock::now();
+	for(FrameNumber readyFrameNumber : readyOrder) {
+		while(nextInsert <= frames && nextInsert <= readyFrameNumber + (FrameNumber)depth) {
+			FrameTimestamps frameTimestamps;
+			frameTimestamps.frameNumber = nextInsert;
+			frameTimestamps.startTimestamp = 0.0;
+			frameTimestamps.estimatedEndTimestamp = 0.0;
+			queue.insertFrame(frameTimestamps);
+			nextInsert++;
+		}
+
+		//Only a signal which made the next in-order frame ready wakes the worker at all.
+		if(!queue.setFrameReady(readyFrameNumber)) {
+			continue;
+		}
+		result.wakeups++;
+		FrameTimestamps frameTimestamps;
+		while(queue.popNextReadyFrame(&frameTimestamps)) {
+			if(frameTimestamps.frameNumber <= result.lastFrameNumber) {
+				fprintf(stderr, "SequencedFrameQueue handed out frames out of order!\n");
+				exit(1);
+			}
+			result.lastFrameNumber = frameTimestamps.frameNumber;
+			result.checksum += frameTimestamps.frameNumber;
+		}
+	}
+	result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+static void report(const char *name, BenchResult result, FrameNumber frames) {
+	printf("%-20s %8.03lf ms total, %9.01lf ns per frame, %9lu wakeups, %11lu entries scanned.\n",
+		name,
+		result.seconds * 1000.0,
+		result.seconds * 1.0e9 / (double)frames,
+		(unsigned long)result.wakeups,
+		(unsigned long)result.scannedEntries);
+}
+
+int main(int argc, char *argv[]) {
+	long depth = argc > 1 ? atol(argv[1]) : YERFACE_BENCH_DEFAULT_DEPTH;
+	FrameNumber frames = argc > 2 ? (FrameNumber)atoll(argv[2]) : YERFACE_BENCH_DEFAULT_FRAMES;
+	if(depth < 1 || frames < 1) {
+		fprintf(stderr, "Usage: %s [depth] [frames]\n", argv[0]);
+		return 1;
+	}
+
+	//Frames finish upstream out of order, but only within a small window.
+	vector<FrameNumber> readyOrder;
+	for(FrameNumber frameNumber = 1; frameNumber <= frames; frameNumber++) {
+		readyOrder.push_back(frameNumber);
+	}
+	mt19937 random(12345);
+	for(size_t i = 0; i < readyOrder.size(); i += YERFACE_BENCH_READY_WINDOW) {
+		size_t end = min(readyOrder.size(), i + YERFACE_BENCH_READY_WINDOW);
+		shuffle(readyOrder.begin() + i, readyOrder.begin() + end, random);
+	}
+
+	printf("Queue depth %ld, " YERFACE_FRAMENUMBER_FORMAT " frames, ready order shuffled within windows of %d.\n", depth, frames, YERFACE_BENCH_READY_WINDOW);
+	BenchResult legacy = benchLegacyScan(readyOrder, (size_t)depth);
+	report("unordered_map scan", legacy, frames);
+	BenchResult sequenced = benchSequencedFrameQueue(readyOrder, (size_t)depth);
+	report("SequencedFrameQueue", sequenced, frames);
+
+	if(legacy.checksum != sequenced.checksum || legacy.lastFrameNumber != sequenced.lastFrameNumber) {
+		fprintf(stderr, "Implementations disagree about which frames were handed out!\n");
+		return 1;
+	}
+	printf("Speedup: %.01lfx\n", legacy.seconds / sequenced.seconds);
+	return 0;
+}
@@ -0,0 +1,247 @@
+// Compares the process-wide WorkScheduler against the per-pool dedicated
+// threads it replaced, using a synthetic pipeline shaped like ours: a heavy
+// parallel stage (detection), a light parallel stage (landmark prediction), a
+// cheap ordered stage (assignment), and a long single-worker stage which hogs
+// its thread (speech recognition). Each stage burns CPU for a fixed time per
+// task (of its own thread's CPU time), so the only thing which differs between
+// modes is how pools share cores.
+//
+// Two runs per mode:
+//  - Throughput: every frame is pushed at once, as in an offline render.
+//  - Paced: frames arrive at a fixed rate, as in live capture, and we report how
+//    long tasks sat in their queue before a worker picked them up. This is where
+//    the long stage crowding out the latency-critical ones would show.
+//
+// A cost scale of zero turns every task into a no-op, which measures nothing but
+// the cost of scheduling itself.
+//
+// Usage: yer-face-bench-workscheduler <yer-face-config.json> [frames] [fps] [cost scale]
+
+#include "Logger.hpp"
+#include "Status.hpp"
+#include "FrameServer.hpp"
+#include "WorkerPool.hpp"
+#include "WorkScheduler.hpp"
+#include "Utilities.hpp"
+
+#include "SDL.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+using namespace YerFace;
+
+#define YERFACE_BENCH_DEFAULT_FRAMES 600
+#define YERFACE_BENCH_DEFAULT_FPS 60.0
+
+class BenchStage {
+public:
+	const char *name;
+	int numWorkers;
+	double numWorkersPerCPU;
+	double costSeconds;
+	int everyNthFrame;
+};
+
+static const BenchStage benchStages[] = {
+	{ "Bench.Detect", 0, 0.5, 0.012, 3 },
+	{ "Bench.Predict", 0, 1.0, 0.003, 1 },
+	{ "Bench.Assign", 1, 0.0, 0.0005, 1 },
+	{ "Bench.Recognize", 1, 0.0, 0.060, 15 }
+};
+#define YERFACE_BENCH_NUM_STAGES (sizeof(benchStages) / sizeof(benchStages[0]))
+
+class BenchStageState {
+public:
+	const BenchStage *stage;
+	WorkerPool *pool;
+	vector<double> queueDelays; //Seconds from pushTask() until a worker started the task.
+};
+
+static SDL_mutex *benchMutex;
+static SDL_cond *benchCond;
+static size_t tasksFinished;
+static double costScale; //Multiplies every stage's costSeconds.
+
+//Seconds of CPU time used by the calling thread. Burning wall clock time instead would let oversubscribed
+//threads "finish" their work concurrently on a single core, which flatters whichever mode runs more threads.
+static double getThreadCPUTime(void) {
+#ifdef WIN32
+	return FrameServer::getWallClock();
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec / 1.0e9;
+#endif
+}
+
+static void burnCPU(double seconds) {
+	double until = getThreadCPUTime() + seconds;
+	while(getThreadCPUTime() < until) {
+		continue;
+	}
+}
+
+static void benchTaskHandler(WorkerPoolWorker *worker, WorkerPoolTask task) {
+	BenchStageState *state = (BenchStageState *)worker->ptr;
+	double pushedAt = *(double *)task.payload;
+	delete (double *)task.payload;
+	double delay = FrameServer::getWallClock() - pushedAt;
+
+	if(costScale > 0.0) {
+		burnCPU(state->stage->costSeconds * costScale);
+	}
+
+	YerFace_MutexLock(benchMutex);
+	state->queueDelays.push_back(delay);
+	tasksFinished++;
+	SDL_CondSignal(benchCond);
+	YerFace_MutexUnlock(benchMutex);
+}
+
+static double percentile(vector<double> values, double p) {
+	if(values.size() == 0) {
+		return 0.0;
+	}
+	sort(values.begin(), values.end());
+	size_t index = (size_t)(p * (double)(values.size() - 1));
+	return values[index];
+}
+
+static void runBench(Logger *logger, json config, Status *status, bool scheduled, FrameNumber frames, double fps) {
+	const char *mode = scheduled ? "WorkScheduler" : "dedicated threads";
+	//Pools need a FrameServer, and it must outlive them until it has drained, since they are on its drained callback list.
+	FrameServer *frameServer = new FrameServer(config, status, false);
+	vector<BenchStageState *> states;
+	for(size_t i = 0; i < YERFACE_BENCH_NUM_STAGES; i++) {
+		BenchStageState *state = new BenchStageState();
+		state->stage = &benchStages[i];
+		WorkerPoolParameters workerPoolParameters;
+		workerPoolParameters.name = benchStages[i].name;
+		workerPoolParameters.numWorkers = benchStages[i].numWorkers;
+		workerPoolParameters.numWorkersPerCPU = benchStages[i].numWorkersPerCPU;
+		workerPoolParameters.dedicatedThreads = !scheduled;
+		workerPoolParameters.initializer = NULL;
+		workerPoolParameters.deinitializer = NULL;
+		workerPoolParameters.usrPtr = (void *)state;
+		workerPoolParameters.handler = NULL;
+		workerPoolParameters.taskHandler = benchTaskHandler;
+		workerPoolParameters.backlog = NULL;
+		state->pool = new WorkerPool(config, status, frameServer, workerPoolParameters);
+		states.push_back(state);
+	}
+
+	size_t tasksPushed = 0;
+	YerFace_MutexLock(benchMutex);
+	tasksFinished = 0;
+	YerFace_MutexUnlock(benchMutex);
+
+	double start = FrameServer::getWallClock();
+	for(FrameNumber frameNumber = 1; frameNumber <= frames; frameNumber++) {
+		if(fps > 0.0) {
+			double due = start + (double)(frameNumber - 1) / fps;
+			double now = FrameServer::getWallClock();
+			if(due > now) {
+				SDL_Delay((Uint32)((due - now) * 1000.0));
+			}
+		}
+		for(BenchStageState *state : states) {
+			if(frameNumber % state->stage->everyNthFrame != 0) {
+				continue;
+			}
+			WorkerPoolTask task;
+			task.frameNumber = frameNumber;
+			task.deadline = FrameServer::getWallClock();
+			task.shedIfLate = false;
+			task.missedDeadline = false;
+			task.payload = (void *)new double(task.deadline);
+			state->pool->pushTask(task);
+			tasksPushed++;
+		}
+	}
+
+	YerFace_MutexLock(benchMutex);
+	while(tasksFinished < tasksPushed) {
+		SDL_CondWait(benchCond, benchMutex);
+	}
+	YerFace_MutexUnlock(benchMutex);
+	double elapsed = FrameServer::getWallClock() - start;
+
+	if(fps > 0.0) {
+		logger->info("[%s] Paced at %.01lf fps: %lu tasks in %.03lf seconds.", mode, fps, tasksPushed, elapsed);
+	} else {
+		logger->info("[%s] Throughput: " YERFACE_FRAMENUMBER_FORMAT " frames (%lu tasks) in %.03lf seconds, %.02lf frames per second, %.02lf microseconds per task.", mode, frames, tasksPushed, elapsed, (double)frames / elapsed, elapsed * 1.0e6 / (double)tasksPushed);
+	}
+	for(BenchStageState *state : states) {
+		logger->info("[%s]     %-16s %2d workers, queue delay p50 %7.02lfms, p99 %7.02lfms, max %7.02lfms.", mode, state->stage->name,
+			state->pool->getNumWorkers(),
+			percentile(state->queueDelays, 0.50) * 1000.0,
+			percentile(state->queueDelays, 0.99) * 1000.0,
+			percentile(state->queueDelays, 1.0) * 1000.0);
+		state->pool->stopWorkerNow();
+	}
+
+	frameServer->setDraining();
+	delete frameServer;
+	for(BenchStageState *state : states) {
+		delete state->pool;
+		delete state;
+	}
+}
+
+int main(int argc, char *argv[]) {
+	if(argc < 2) {
+		fprintf(stderr, "Usage: %s <yer-face-config.json> [frames] [fps] [cost scale]\n", argv[0]);
+		return 1;
+	}
+	FrameNumber frames = argc > 2 ? (FrameNumber)atoll(argv[2]) : YERFACE_BENCH_DEFAULT_FRAMES;
+	double fps = argc > 3 ? atof(argv[3]) : YERFACE_BENCH_DEFAULT_FPS;
+	costScale = argc > 4 ? atof(argv[4]) : 1.0;
+	if(frames < 1 || fps <= 0.0 || costScale < 0.0) {
+		fprintf(stderr, "frames and fps must be positive, and cost scale must not be negative.\n");
+		return 1;
+	}
+
+	Logger::setLoggingFilter(LOG_SEVERITY_INFO);
+	Logger *logger = new Logger("WorkSchedulerBench");
+
+	json config;
+	try {
+		std::ifstream fileStream = std::ifstream(argv[1]);
+		std::stringstream ssBuffer;
+		ssBuffer << fileStream.rdbuf();
+		config = json::parse(ssBuffer.str());
+	} catch(exception &e) {
+		logger->err("Failed to parse configuration file \"%s\". Got exception: %s", argv[1], e.what());
+		return 1;
+	}
+
+	if((benchMutex = SDL_CreateMutex()) == NULL || (benchCond = SDL_CreateCond()) == NULL) {
+		logger->err("Failed creating mutex or condition!");
+		return 1;
+	}
+
+	Status *status = new Status(false);
+	logger->info("System has %d CPUs. Simulating " YERFACE_FRAMENUMBER_FORMAT " frames with task costs scaled by %.02lf.", SDL_GetCPUCount(), frames, costScale);
+
+	//Before: every pool on its own threads. (No WorkScheduler instance, so pools fall back to dedicated threads.)
+	runBench(logger, config, status, false, frames, 0.0);
+	runBench(logger, config, status, false, frames, fps);
+
+	//After: every pool shares the WorkScheduler.
+	WorkScheduler *workScheduler = new WorkScheduler(config, status);
+	runBench(logger, config, status, true, frames, 0.0);
+	runBench(logger, config, status, true, frames, fps);
+	delete workScheduler;
+
+	delete status;
+	SDL_DestroyCond(benchCond);
+	SDL_DestroyMutex(benchMutex);
+	delete logger;
+	return 0;
+}
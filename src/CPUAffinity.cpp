@@ -0,0 +1,213 @@
+
+#include "CPUAffinity.hpp"
+#include "Utilities.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#if defined(WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+namespace YerFace {
+
+std::vector<int> CPUAffinity::isolatedCores;
+
+CPUAffinity::CPUAffinity(void) {
+	layout = CPU_AFFINITY_NONE;
+}
+
+CPUAffinity CPUAffinity::fromJSON(json affinityConfig) {
+	CPUAffinity affinity;
+	string layoutName = affinityConfig["layout"];
+	if(layoutName == "none") {
+		affinity.layout = CPU_AFFINITY_NONE;
+	} else if(layoutName == "set") {
+		affinity.layout = CPU_AFFINITY_SET;
+	} else if(layoutName == "compact") {
+		affinity.layout = CPU_AFFINITY_COMPACT;
+	} else if(layoutName == "scatter") {
+		affinity.layout = CPU_AFFINITY_SCATTER;
+	} else {
+		throw invalid_argument("CPU affinity layout must be one of: none, set, compact, scatter");
+	}
+	for(json core : affinityConfig["cores"]) {
+		int cpu = core;
+		if(cpu < 0 || cpu >= SDL_GetCPUCount()) {
+			throw invalid_argument("CPU affinity core list refers to a CPU which does not exist!");
+		}
+		affinity.cores.push_back(cpu);
+	}
+	return affinity;
+}
+
+CPUAffinity CPUAffinity::isolated(void) {
+	CPUAffinity affinity;
+	if(isolatedCores.size() > 0) {
+		affinity.layout = CPU_AFFINITY_SET;
+		affinity.cores = isolatedCores;
+	}
+	return affinity;
+}
+
+void CPUAffinity::setIsolatedCores(std::vector<int> cores) {
+	for(int cpu : cores) {
+		if(cpu < 0 || cpu >= SDL_GetCPUCount()) {
+			throw invalid_argument("Isolated core list refers to a CPU which does not exist!");
+		}
+	}
+	isolatedCores = cores;
+}
+
+std::vector<int> CPUAffinity::getCoresForThread(int threadIndex) {
+	std::vector<int> available = cores;
+	if(available.size() == 0) {
+		int numCPUs = SDL_GetCPUCount();
+		for(int cpu = 0; cpu < numCPUs; cpu++) {
+			if(std::find(isolatedCores.begin(), isolatedCores.end(), cpu) == isolatedCores.end()) {
+				available.push_back(cpu);
+			}
+		}
+	}
+	if(available.size() == 0 || layout == CPU_AFFINITY_SET) {
+		return available;
+	}
+
+	//Order the candidates by socket, so compact fills sockets in turn and scatter can alternate between them.
+	std::stable_sort(available.begin(), available.end(), [](int a, int b) {
+		return getCPUPackage(a) < getCPUPackage(b);
+	});
+	if(layout == CPU_AFFINITY_SCATTER) {
+		std::vector<std::vector<int>> packages;
+		int lastPackage = -1;
+		for(int cpu : available) {
+			int package = getCPUPackage(cpu);
+			if(packages.size() == 0 || package != lastPackage) {
+				packages.push_back(std::vector<int>());
+				lastPackage = package;
+			}
+			packages.back().push_back(cpu);
+		}
+		std::vector<int> interleaved;
+		for(size_t i = 0; interleaved.size() < available.size(); i++) {
+			for(auto &package : packages) {
+				if(i < package.size()) {
+					interleaved.push_back(package[i]);
+				}
+			}
+		}
+		available = interleaved;
+	}
+
+	std::vector<int> result;
+	result.push_back(available[threadIndex % available.size()]);
+	return result;
+}
+
+bool CPUAffinity::applyToCurrentThread(int threadIndex, int numThreads, Logger *logger, const char *threadName) {
+	if(layout == CPU_AFFINITY_NONE) {
+		logger->debug1("%s placement: unpinned, currently allowed on %s", threadName, getCurrentThreadPlacement().c_str());
+		return true;
+	}
+	std::vector<int> myCores = getCoresForThread(threadIndex);
+	if(myCores.size() == 0) {
+		logger->warning("%s has a CPU affinity, but no CPUs are left to choose from! Leaving it unpinned.", threadName);
+		return false;
+	}
+	if(!setCurrentThreadCores(myCores)) {
+		logger->warning("%s could not be pinned. (Unsupported platform, or the requested CPUs are not allowed.)", threadName);
+		return false;
+	}
+	logger->info("%s placement: thread %d of %d pinned to %s", threadName, threadIndex + 1, numThreads, getCurrentThreadPlacement().c_str());
+	return true;
+}
+
+string CPUAffinity::getCurrentThreadPlacement(void) {
+	std::ostringstream placement;
+#if defined(__linux__)
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	if(pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet) != 0) {
+		return "unknown CPUs";
+	}
+	placement << "CPUs [";
+	bool first = true;
+	for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if(CPU_ISSET(cpu, &cpuSet)) {
+			placement << (first ? "" : ",") << cpu << "(socket " << getCPUPackage(cpu) << ")";
+			first = false;
+		}
+	}
+	placement << "]";
+#else
+	placement << "unknown CPUs";
+#endif
+	return placement.str();
+}
+
+int CPUAffinity::getCurrentCPU(void) {
+#if defined(__linux__)
+	return sched_getcpu();
+#elif defined(WIN32)
+	return (int)GetCurrentProcessorNumber();
+#else
+	return -1;
+#endif
+}
+
+int CPUAffinity::getCPUCacheDomain(int cpu) {
+#if defined(__linux__)
+	std::ostringstream path;
+	path << "/sys/devices/system/cpu/cpu" << cpu << "/cache/index3/id";
+	std::ifstream cacheFile(path.str());
+	int cacheID;
+	if(cacheFile >> cacheID) {
+		//Keep L3 IDs from different sockets apart, in case the kernel numbers them per socket.
+		return (getCPUPackage(cpu) << 16) | cacheID;
+	}
+#endif
+	return getCPUPackage(cpu) << 16;
+}
+
+int CPUAffinity::getCPUPackage(int cpu) {
+#if defined(__linux__)
+	std::ostringstream path;
+	path << "/sys/devices/system/cpu/cpu" << cpu << "/topology/physical_package_id";
+	std::ifstream packageFile(path.str());
+	int package;
+	if(packageFile >> package) {
+		return package;
+	}
+#endif
+	return 0;
+}
+
+bool CPUAffinity::setCurrentThreadCores(std::vector<int> myCores) {
+#if defined(__linux__)
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	for(int cpu : myCores) {
+		CPU_SET(cpu, &cpuSet);
+	}
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet) == 0;
+#elif defined(WIN32)
+	DWORD_PTR mask = 0;
+	for(int cpu : myCores) {
+		if(cpu >= (int)(sizeof(DWORD_PTR) * 8)) {
+			return false;
+		}
+		mask |= ((DWORD_PTR)1 << cpu);
+	}
+	return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+	return false;
+#endif
+}
+
+}; //namespace YerFace
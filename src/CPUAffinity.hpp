@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Logger.hpp"
+#include "Utilities.hpp"
+
+#include "SDL.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace YerFace {
+
+enum CPUAffinityLayout: unsigned int {
+	CPU_AFFINITY_NONE = 0, //Leave placement up to the operating system.
+	CPU_AFFINITY_SET = 1, //Every thread may run on any of the chosen CPUs.
+	CPU_AFFINITY_COMPACT = 2, //One CPU per thread, filling one socket before moving on to the next.
+	CPU_AFFINITY_SCATTER = 3 //One CPU per thread, alternating between sockets.
+};
+
+// Thread placement policy, as configured under YerFace.CPUAffinity. If no
+// explicit CPU list is given, layouts choose from every CPU on the system
+// except the isolated CPUs, which are reserved for the capture and demuxer
+// threads. Pinning is only implemented on Linux and Windows, elsewhere it
+// is a logged no-op.
+class CPUAffinity {
+public:
+	CPUAffinity(void);
+	static CPUAffinity fromJSON(json affinityConfig);
+	static CPUAffinity isolated(void); //CPU_AFFINITY_SET on the isolated CPUs, or CPU_AFFINITY_NONE if there are none.
+	static void setIsolatedCores(std::vector<int> cores);
+	bool applyToCurrentThread(int threadIndex, int numThreads, Logger *logger, const char *threadName);
+	static string getCurrentThreadPlacement(void);
+	static int getCurrentCPU(void); //-1 if unknown.
+	static int getCPUCacheDomain(int cpu); //Identifies the last level cache shared by this CPU. (Falls back to the socket.)
+
+	CPUAffinityLayout layout;
+	std::vector<int> cores; //Empty means all non-isolated CPUs.
+private:
+	std::vector<int> getCoresForThread(int threadIndex);
+	static int getCPUPackage(int cpu);
+	static bool setCurrentThreadCores(std::vector<int> cores);
+
+	static std::vector<int> isolatedCores;
+};
+
+}; //namespace YerFace
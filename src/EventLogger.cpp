@@ -34,7 +34,7 @@ EventLogger::EventLogger(json config, string myEventFile, double myEventFileStar
 
 	eventReplay = false;
 	frameEvents.clear();
-	pendingReplayFrames.clear();
+	pendingReplayFrameQueue = new SequencedFrameQueue("EventLogger.Replay");
 	if(eventFilename.length() > 0) {
 		eventFilestream.open(eventFilename, ifstream::in | ifstream::binary);
 		if(eventFilestream.fail()) {
@@ -44,12 +44,13 @@ EventLogger::EventLogger(json config, string myEventFile, double myEventFileStar
 		eventReplay = true;
 
 		//We also want to introduce a checkpoint so that frames cannot TRANSITION AWAY from FRAME_STATUS_PREPROCESS without our blessing.
-		frameServer->registerFrameStatusCheckpoint(FRAME_STATUS_PREPROCESS, "eventLogger.ran");
+		frameServer->registerFrameStatusCheckpoint(FRAME_STATUS_PREPROCESS, FRAME_CHECKPOINT_EVENTLOGGER);
 
 		WorkerPoolParameters workerPoolParameters;
 		workerPoolParameters.name = "EventLogger.Replay";
 		workerPoolParameters.numWorkers = 1;
 		workerPoolParameters.numWorkersPerCPU = 0.0;
+		workerPoolParameters.dedicatedThreads = false;
 		workerPoolParameters.initializer = NULL;
 		workerPoolParameters.deinitializer = NULL;
 		workerPoolParameters.usrPtr = (void *)this;
@@ -80,7 +81,7 @@ EventLogger::~EventLogger() noexcept(false) {
 	}
 
 	YerFace_MutexLock(myMutex);
-	if(pendingReplayFrames.size() > 0) {
+	if(pendingReplayFrameQueue->size() > 0) {
 		logger->err("Frames are still pending for replay! Woe is me!");
 	}
 	if(frameEvents.size() > 0) {
@@ -89,6 +90,7 @@ EventLogger::~EventLogger() noexcept(false) {
 	YerFace_MutexUnlock(myMutex);
 
 	SDL_DestroyMutex(myMutex);
+	delete pendingReplayFrameQueue;
 	delete logger;
 }
 
@@ -190,7 +192,7 @@ void EventLogger::processNextPacket(FrameTimestamps frameTimestamps) {
 void EventLogger::handleFrameStatusChange(void *userdata, WorkingFrameStatus newStatus, FrameTimestamps frameTimestamps) {
 	EventLogger *self = (EventLogger *)userdata;
 	FrameNumber frameNumber = frameTimestamps.frameNumber;
-	EventLoggerReplayTask replay;
+	bool replayReady;
 	switch(newStatus) {
 		default:
 			throw logic_error("Handler passed unsupported frame status change event!");
@@ -199,19 +201,17 @@ void EventLogger::handleFrameStatusChange(void *userdata, WorkingFrameStatus new
 			self->frameEvents[frameNumber] = json::object();
 			YerFace_MutexUnlock(self->myMutex);
 			if(self->eventReplay) {
-				replay.frameTimestamps = frameTimestamps;
-				replay.readyForReplay = false;
 				YerFace_MutexLock(self->myMutex);
-				self->pendingReplayFrames[frameNumber] = replay;
+				self->pendingReplayFrameQueue->insertFrame(frameTimestamps);
 				YerFace_MutexUnlock(self->myMutex);
 			}
 			break;
 		case FRAME_STATUS_PREPROCESS:
 			if(self->eventReplay) {
 				YerFace_MutexLock(self->myMutex);
-				self->pendingReplayFrames[frameNumber].readyForReplay = true;
+				replayReady = self->pendingReplayFrameQueue->setFrameReady(frameNumber);
 				YerFace_MutexUnlock(self->myMutex);
-				if(self->replayWorkerPool != NULL) {
+				if(replayReady && self->replayWorkerPool != NULL) {
 					self->replayWorkerPool->sendWorkerSignal();
 				}
 			}
@@ -239,18 +239,8 @@ bool EventLogger::replayWorkerHandler(WorkerPoolWorker *worker) {
 
 	YerFace_MutexLock(self->myMutex);
 	//// CHECK FOR WORK ////
-	for(auto pendingFrameNumber : self->pendingReplayFrames) {
-		if(myFrameNumber < 0 || pendingFrameNumber.first < myFrameNumber) {
-			myFrameNumber = pendingFrameNumber.first;
-		}
-	}
-	if(myFrameNumber > 0 && !self->pendingReplayFrames[myFrameNumber].readyForReplay) {
-		// self->logger->verbose("BLOCKED on frame " YERFACE_FRAMENUMBER_FORMAT " because it is not ready!", myFrameNumber);
-		myFrameNumber = -1;
-	}
-	if(myFrameNumber > 0) {
-		frameTimestamps = self->pendingReplayFrames[myFrameNumber].frameTimestamps;
-		self->pendingReplayFrames.erase(myFrameNumber);
+	if(self->pendingReplayFrameQueue->popNextReadyFrame(&frameTimestamps)) {
+		myFrameNumber = frameTimestamps.frameNumber;
 	}
 	YerFace_MutexUnlock(self->myMutex);
 
@@ -279,7 +269,7 @@ bool EventLogger::replayWorkerHandler(WorkerPoolWorker *worker) {
 
 		self->logger->debug4("DONE EVENT REPLAY: Finished frame #" YERFACE_FRAMENUMBER_FORMAT " at time: %lf-%lf", frameTimestamps.frameNumber, frameTimestamps.startTimestamp, frameTimestamps.estimatedEndTimestamp);
 
-		self->frameServer->setWorkingFrameStatusCheckpoint(myFrameNumber, FRAME_STATUS_PREPROCESS, "eventLogger.ran");
+		self->frameServer->setWorkingFrameStatusCheckpoint(myFrameNumber, FRAME_STATUS_PREPROCESS, FRAME_CHECKPOINT_EVENTLOGGER);
 
 		didWork = true;
 	}
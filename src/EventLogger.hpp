@@ -6,6 +6,7 @@
 #include "Utilities.hpp"
 #include "Status.hpp"
 #include "WorkerPool.hpp"
+#include "SequencedFrameQueue.hpp"
 
 #include <list>
 
@@ -21,12 +22,6 @@ public:
 	function<bool(string eventName, json eventPayload, json sourcePacket)> replayCallback;
 };
 
-class EventLoggerReplayTask {
-public:
-	FrameTimestamps frameTimestamps;
-	bool readyForReplay;
-};
-
 class EventLogger {
 public:
 	EventLogger(json config, string myEventFile, double myEventFileStartSeconds, Status *myStatus, OutputDriver *myOutputDriver, FrameServer *myFrameServer);
@@ -51,7 +46,7 @@ private:
 	SDL_mutex *myMutex;
 	list<EventType> registeredEventTypes;
 	unordered_map<FrameNumber, json> frameEvents;
-	unordered_map<FrameNumber, EventLoggerReplayTask> pendingReplayFrames;
+	SequencedFrameQueue *pendingReplayFrameQueue;
 	bool eventReplay, eventReplayHold;
 	json nextPacket;
 };
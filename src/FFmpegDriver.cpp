@@ -2,7 +2,9 @@
 #include "FFmpegDriver.hpp"
 
 #include "Utilities.hpp"
+#include "ThreadBudgetPlanner.hpp"
 
+#include <cmath>
 #include <exception>
 #include <stdexcept>
 
@@ -39,17 +41,46 @@ MediaOutputContext::MediaOutputContext(void) {
 	formatContext = NULL;
 	videoStream = NULL;
 	audioStream = NULL;
-	outputPackets.clear();
 	multiplexerThread = NULL;
 	multiplexerMutex = NULL;
 	multiplexerCond = NULL;
 	multiplexerThreadRunning = false;
+	multiplexerWaiting = false;
+	ringSpaceCond = NULL;
+	ringSpaceWaiters = 0;
+	packetRing = NULL;
+	packetRingMask = 0;
+	packetRingEnqueuePos = 0;
+	packetRingDequeuePos = 0;
+	drainBatchSize = 1;
+	packetsDropped = 0;
+	packetRingWaits = 0;
+	packetsMultiplexed = 0;
+	packetBatches = 0;
+	largestPacketBatch = 0;
+	fileIO = NULL;
 	initialized = false;
 }
 
-FFmpegDriver::FFmpegDriver(Status *myStatus, FrameServer *myFrameServer, bool myLowLatency, bool myListAllAvailableOptions) {
+void VideoFrameBacking::retain(void) {
+	SDL_AtomicIncRef(&refCount);
+}
+
+void VideoFrameBacking::release(void) {
+	if(SDL_AtomicAdd(&refCount, -1) <= 0) {
+		throw logic_error("VideoFrameBacking was released more times than it was retained!");
+	}
+}
+
+bool VideoFrameBacking::getIsInUse(void) {
+	return SDL_AtomicGet(&refCount) > 0;
+}
+
+FFmpegDriver::FFmpegDriver(json myConfig, Status *myStatus, FrameServer *myFrameServer, bool myLowLatency, bool myListAllAvailableOptions) {
 	videoCaptureWorkerPool = NULL;
+	conversionWorkerPool = NULL;
 	logger = new Logger("FFmpegDriver");
+	config = myConfig;
 
 	status = myStatus;
 	if(status == NULL) {
@@ -60,8 +91,45 @@ FFmpegDriver::FFmpegDriver(Status *myStatus, FrameServer *myFrameServer, bool my
 		throw invalid_argument("frameServer cannot be NULL");
 	}
 	lowLatency = myLowLatency;
+	string lowLatencyKey = "LowLatency";
+	if(!lowLatency) {
+		lowLatencyKey = "Offline";
+	}
+	videoDecoderThreading = parseDecoderThreading(config["YerFace"]["FFmpegDriver"][lowLatencyKey], "video");
+	audioDecoderThreading = parseDecoderThreading(config["YerFace"]["FFmpegDriver"][lowLatencyKey], "audio");
+	videoDecodeMetrics = new Metrics(config, "FFmpegDriver.VideoDecode", true);
+	workingFrameScaler = parseScalerAlgorithm(config["YerFace"]["FFmpegDriver"][lowLatencyKey]["workingFrameScaler"]);
+	detectionFrameScaler = parseScalerAlgorithm(config["YerFace"]["FFmpegDriver"][lowLatencyKey]["detectionFrameScaler"]);
 
 	swsContext = NULL;
+	detectionSwsContext = NULL;
+	detectionFrameSize = Size(0, 0);
+
+	conversionMinimumPixels = config["YerFace"]["FFmpegDriver"]["SlicedConversion"]["minimumPixels"];
+	if(conversionMinimumPixels < 0) {
+		throw invalid_argument("Sliced conversion minimumPixels is nonsense.");
+	}
+	conversionSliceCount = config["YerFace"]["FFmpegDriver"]["SlicedConversion"]["slices"];
+	double slicesPerCPU = config["YerFace"]["FFmpegDriver"]["SlicedConversion"]["slicesPerCPU"];
+	if(conversionSliceCount < 0 || slicesPerCPU < 0.0) {
+		throw invalid_argument("Sliced conversion slice count is nonsense.");
+	}
+	if(conversionSliceCount == 0) {
+		int numCPUs = SDL_GetCPUCount();
+		conversionSliceCount = (int)ceil((double)numCPUs * slicesPerCPU);
+		logger->debug1("Calculating conversion slices: System has %d CPUs, at %.02lf slices per CPU that's %d slices.", numCPUs, slicesPerCPU, conversionSliceCount);
+	}
+	if(conversionSliceCount > YERFACE_MAX_CONVERSION_SLICES) {
+		conversionSliceCount = YERFACE_MAX_CONVERSION_SLICES;
+	}
+	conversionChromaShift = 0;
+	if((conversionMutex = SDL_CreateMutex()) == NULL) {
+		throw runtime_error("Failed creating mutex!");
+	}
+	if((conversionCond = SDL_CreateCond()) == NULL) {
+		throw runtime_error("Failed creating condition!");
+	}
+	conversionMetrics = new Metrics(config, "FFmpegDriver.Conversion", true);
 	newestVideoFrameTimestamp = -1.0;
 	newestVideoFrameEstimatedEndTimestamp = 0.0;
 	newestAudioFrameTimestamp = -1.0;
@@ -87,6 +155,19 @@ FFmpegDriver::FFmpegDriver(Status *myStatus, FrameServer *myFrameServer, bool my
 	if((audioStreamMutex = SDL_CreateMutex()) == NULL) {
 		throw runtime_error("Failed creating mutex!");
 	}
+	if((demuxerWakeMutex = SDL_CreateMutex()) == NULL) {
+		throw runtime_error("Failed creating mutex!");
+	}
+	if((demuxerWakeCond = SDL_CreateCond()) == NULL) {
+		throw runtime_error("Failed creating condition!");
+	}
+	demuxerWakeups = 0;
+
+	//Idle demuxers block without a timeout, so pause, resume, stop and emergency have to wake them.
+	StatusChangeEventCallback statusChangeCallback;
+	statusChangeCallback.userdata = (void *)this;
+	statusChangeCallback.callback = handleStatusChangeEvent;
+	status->onStatusChangeEvent(statusChangeCallback);
 
 	if((videoInContext.demuxerMutex = SDL_CreateMutex()) == NULL) {
 		throw runtime_error("Failed creating video demuxer mutex!");
@@ -114,11 +195,25 @@ FFmpegDriver::~FFmpegDriver() noexcept(false) {
 	destroyDemuxerThread(&videoInContext);
 	destroyDemuxerThread(&audioInContext);
 	destroyMuxerThread();
+	status->removeStatusChangeEvent((void *)this);
+
+	if(conversionWorkerPool != NULL) {
+		conversionWorkerPool->stopWorkerNow();
+		delete conversionWorkerPool;
+	}
+	for(ConversionSlice slice : conversionSlices) {
+		sws_freeContext(slice.swsContext);
+		av_freep(&slice.scratchData[0]);
+	}
+	SDL_DestroyCond(conversionCond);
+	SDL_DestroyMutex(conversionMutex);
 
 	SDL_DestroyMutex(videoFrameBufferMutex);
 	SDL_DestroyMutex(audioFrameHandlersMutex);
 	SDL_DestroyMutex(videoStreamMutex);
 	SDL_DestroyMutex(audioStreamMutex);
+	SDL_DestroyCond(demuxerWakeCond);
+	SDL_DestroyMutex(demuxerWakeMutex);
 	for(MediaInputContext *inputContext : {&videoInContext, &audioInContext}) {
 		string contextName = "UNKNOWN";
 		if(inputContext == &videoInContext) {
@@ -167,6 +262,9 @@ FFmpegDriver::~FFmpegDriver() noexcept(false) {
 	}
 	// logger->debug3("Calling sws_freeContext(swsContext)");
 	sws_freeContext(swsContext);
+	sws_freeContext(detectionSwsContext);
+	delete videoDecodeMetrics;
+	delete conversionMetrics;
 	delete logger;
 
 	//This helps force the AV logs to flush. (Note the \n at the end of the line.)
@@ -307,9 +405,10 @@ void FFmpegDriver::openInputMedia(string inFile, enum AVMediaType type, string i
 		}
 
 		pixelFormatBacking = AV_PIX_FMT_BGR24;
-		if((swsContext = sws_getContext(width, height, pixelFormat, width, height, pixelFormatBacking, SWS_BICUBIC, NULL, NULL, NULL)) == NULL) {
+		if((swsContext = sws_getContext(width, height, pixelFormat, width, height, pixelFormatBacking, workingFrameScaler, NULL, NULL, NULL)) == NULL) {
 			throw runtime_error("failed creating software scaling context");
 		}
+		setupSlicedConversion();
 
 		for(int i = 0; i < YERFACE_INITIAL_VIDEO_BACKING_FRAMES; i++) {
 			allocateNewVideoFrameBacking();
@@ -352,6 +451,29 @@ void FFmpegDriver::openOutputMedia(string outFile) {
 	if((outputContext.multiplexerCond = SDL_CreateCond()) == NULL) {
 		throw runtime_error("Failed creating multiplexer condition!");
 	}
+	if((outputContext.ringSpaceCond = SDL_CreateCond()) == NULL) {
+		throw runtime_error("Failed creating packet ring space condition!");
+	}
+
+	int ringSize = config["YerFace"]["FFmpegDriver"]["Output"]["packetRingSize"];
+	int drainBatchSize = config["YerFace"]["FFmpegDriver"]["Output"]["drainBatchSize"];
+	if(ringSize < 1 || drainBatchSize < 1) {
+		throw invalid_argument("Output packetRingSize and drainBatchSize must be positive.");
+	}
+	size_t packetRingSize = 1;
+	while(packetRingSize < (size_t)ringSize) {
+		packetRingSize = packetRingSize << 1;
+	}
+	outputContext.packetRing = new OutputPacketRingCell[packetRingSize];
+	for(size_t i = 0; i < packetRingSize; i++) {
+		outputContext.packetRing[i].sequence.store(i);
+		if((outputContext.packetRing[i].packet = av_packet_alloc()) == NULL) {
+			throw runtime_error("failed allocating output packet ring!");
+		}
+	}
+	outputContext.packetRingMask = packetRingSize - 1;
+	outputContext.drainBatchSize = (size_t)drainBatchSize;
+	logger->debug1("Output packet ring holds %lu packets.", packetRingSize);
 
 	avformat_alloc_output_context2(&outputContext.formatContext, NULL, NULL, outFile.c_str());
 	if(!outputContext.formatContext) {
@@ -399,9 +521,32 @@ void FFmpegDriver::openOutputMedia(string outFile) {
 
 	av_dump_format(outputContext.formatContext, 0, outFile.c_str(), 1);
 	if(!(outputContext.outputFormat->flags & AVFMT_NOFILE)) {
-		ret = avio_open(&outputContext.formatContext->pb, outFile.c_str(), AVIO_FLAG_WRITE);
-		if(ret < 0) {
-			throw runtime_error("failed opening output file for output media!");
+		int avioBufferBytes = config["YerFace"]["FFmpegDriver"]["Output"]["avioBufferBytes"];
+		if(avioBufferBytes < 0) {
+			throw invalid_argument("Output avioBufferBytes is nonsense.");
+		}
+		if(avioBufferBytes == 0) {
+			ret = avio_open(&outputContext.formatContext->pb, outFile.c_str(), AVIO_FLAG_WRITE);
+			if(ret < 0) {
+				throw runtime_error("failed opening output file for output media!");
+			}
+		} else {
+			//avio_open() doesn't let us size its buffer, so we open the file unbuffered
+			//(AVIO_FLAG_DIRECT) and put our own buffer of the requested size in front of it.
+			ret = avio_open(&outputContext.fileIO, outFile.c_str(), AVIO_FLAG_WRITE | AVIO_FLAG_DIRECT);
+			if(ret < 0) {
+				throw runtime_error("failed opening output file for output media!");
+			}
+			unsigned char *avioBuffer = (unsigned char *)av_malloc(avioBufferBytes);
+			if(avioBuffer == NULL) {
+				throw runtime_error("failed allocating output buffer!");
+			}
+			if((outputContext.formatContext->pb = avio_alloc_context(avioBuffer, avioBufferBytes, 1, (void *)outputContext.fileIO, NULL, writeOutputIO, seekOutputIO)) == NULL) {
+				av_free(avioBuffer);
+				throw runtime_error("failed allocating output AVIO context!");
+			}
+			outputContext.formatContext->pb->seekable = outputContext.fileIO->seekable;
+			logger->debug1("Output media is buffered in %d byte writes.", avioBufferBytes);
 		}
 	}
 	ret = avformat_write_header(outputContext.formatContext, NULL);
@@ -413,7 +558,18 @@ void FFmpegDriver::openOutputMedia(string outFile) {
 }
 
 void FFmpegDriver::setVideoCaptureWorkerPool(WorkerPool *workerPool) {
+	YerFace_MutexLock(videoFrameBufferMutex);
 	videoCaptureWorkerPool = workerPool;
+	YerFace_MutexUnlock(videoFrameBufferMutex);
+}
+
+void FFmpegDriver::signalVideoCaptureWorker(void) {
+	//Locked, so the pool can't be unset and destroyed out from under us.
+	YerFace_MutexLock(videoFrameBufferMutex);
+	if(videoCaptureWorkerPool != NULL) {
+		videoCaptureWorkerPool->sendWorkerSignal();
+	}
+	YerFace_MutexUnlock(videoFrameBufferMutex);
 }
 
 void FFmpegDriver::openCodecContext(int *streamIndex, AVCodecContext **decoderContext, AVFormatContext *myFormatContext, enum AVMediaType type) {
@@ -443,15 +599,300 @@ void FFmpegDriver::openCodecContext(int *streamIndex, AVCodecContext **decoderCo
 		throw runtime_error("failed to copy codec parameters to decoder context");
 	}
 
+	//Must be set before avcodec_open2(), which spins up the decoder's thread pool.
+	DecoderThreading threading = audioDecoderThreading;
+	if(type == AVMEDIA_TYPE_VIDEO) {
+		threading = videoDecoderThreading;
+	}
+	(*decoderContext)->thread_count = threading.threadCount;
+	(*decoderContext)->thread_type = threading.threadType;
+
 	av_dict_set(&options, "refcounted_frames", "1", 0);
 	if((ret = avcodec_open2(*decoderContext, decoder, &options)) < 0) {
 		logAVErr("failed to open codec", ret);
 		throw runtime_error("failed to open codec");
 	}
 
+	//The codec may not support every kind of threading we asked for, so report what we actually got.
+	logger->info("Opened %s decoder %s with %d thread(s). Requested %s threading, codec is using %s threading.", av_get_media_type_string(type), decoder->name, (*decoderContext)->thread_count, describeThreadType(threading.threadType).c_str(), describeThreadType((*decoderContext)->active_thread_type).c_str());
+
 	*streamIndex = myStreamIndex;
 }
 
+DecoderThreading FFmpegDriver::parseDecoderThreading(json decoderConfig, string mediaType) {
+	DecoderThreading threading;
+	threading.threadCount = decoderConfig[mediaType + "DecoderThreads"];
+	double threadsPerCPU = decoderConfig[mediaType + "DecoderThreadsPerCPU"];
+	if(threading.threadCount < 0 || threadsPerCPU < 0.0) {
+		throw invalid_argument("Decoder thread count is nonsense.");
+	}
+	if(threading.threadCount == 0) {
+		//Decoder threads compete with our worker pools for the same cores, so take a share of the thread budget when there is one.
+		ThreadBudgetPlanner *threadBudgetPlanner = ThreadBudgetPlanner::getInstance();
+		if(threadBudgetPlanner != NULL) {
+			int coreBudget = threadBudgetPlanner->getCoreBudget();
+			threading.threadCount = (int)ceil((double)coreBudget * threadsPerCPU);
+			logger->debug1("Calculating %s decoder threads: Thread budget is %d Cores, at %.02lf threads per Core that's %d threads.", mediaType.c_str(), coreBudget, threadsPerCPU, threading.threadCount);
+		} else {
+			int numCPUs = SDL_GetCPUCount();
+			threading.threadCount = (int)ceil((double)numCPUs * threadsPerCPU);
+			logger->debug1("Calculating %s decoder threads: System has %d CPUs, at %.02lf threads per CPU that's %d threads.", mediaType.c_str(), numCPUs, threadsPerCPU, threading.threadCount);
+		}
+	}
+	if(threading.threadCount < 1) {
+		threading.threadCount = 1;
+	}
+	if(threading.threadCount > YERFACE_MAX_DECODER_THREADS) {
+		threading.threadCount = YERFACE_MAX_DECODER_THREADS;
+	}
+
+	string threadType = decoderConfig[mediaType + "DecoderThreadType"];
+	if(threadType == "frame") {
+		threading.threadType = FF_THREAD_FRAME;
+	} else if(threadType == "slice") {
+		threading.threadType = FF_THREAD_SLICE;
+	} else if(threadType == "frame+slice") {
+		threading.threadType = FF_THREAD_FRAME | FF_THREAD_SLICE;
+	} else {
+		throw invalid_argument("Decoder thread type must be one of: frame, slice, frame+slice");
+	}
+	if(lowLatency && (threading.threadType & FF_THREAD_FRAME) && threading.threadCount > 1) {
+		logger->warning("Frame threading the %s decoder adds %d frame(s) of delay, which is a poor fit for low latency mode.", mediaType.c_str(), threading.threadCount - 1);
+	}
+	return threading;
+}
+
+int FFmpegDriver::parseScalerAlgorithm(string scaler) {
+	if(scaler == "fast_bilinear") {
+		return SWS_FAST_BILINEAR;
+	} else if(scaler == "bilinear") {
+		return SWS_BILINEAR;
+	} else if(scaler == "bicubic") {
+		return SWS_BICUBIC;
+	} else if(scaler == "area") {
+		return SWS_AREA;
+	} else if(scaler == "gauss") {
+		return SWS_GAUSS;
+	} else if(scaler == "lanczos") {
+		return SWS_LANCZOS;
+	} else if(scaler == "spline") {
+		return SWS_SPLINE;
+	}
+	throw invalid_argument("Scaler must be one of: fast_bilinear, bilinear, bicubic, area, gauss, lanczos, spline");
+}
+
+void FFmpegDriver::scaleDetectionFrame(AVFrame *frame, VideoFrame *videoFrame) {
+	Size frameSize = Size(width, height);
+	double scaleFactor = frameServer->calculateDetectionScaleFactor(frameSize);
+	videoFrame->detectionScaleFactor = scaleFactor;
+	if(scaleFactor >= 1.0) {
+		//Nothing to scale, so detection can share the working frame.
+		videoFrame->detectionFrameCV = videoFrame->frameCV;
+		return;
+	}
+
+	//Same rounding as cv::resize(), so the result matches what FrameServer would have produced.
+	Size mySize = Size((int)round((double)width * scaleFactor), (int)round((double)height * scaleFactor));
+	if(mySize.width < 1 || mySize.height < 1) {
+		throw runtime_error("Detection frame size is degenerate!");
+	}
+	if((detectionSwsContext = sws_getCachedContext(detectionSwsContext, width, height, pixelFormat, mySize.width, mySize.height, pixelFormatBacking, detectionFrameScaler, NULL, NULL, NULL)) == NULL) {
+		throw runtime_error("failed creating detection software scaling context");
+	}
+	if(mySize != detectionFrameSize) {
+		logger->debug1("Scaling decoded frames <%dx%d> straight down to <%dx%d> for detection.", width, height, mySize.width, mySize.height);
+		detectionFrameSize = mySize;
+	}
+
+	Mat *detectionFrame = &videoFrame->frameBacking->detectionFrame;
+	detectionFrame->create(mySize, CV_8UC3);
+	uint8_t *destData[4] = { detectionFrame->data, NULL, NULL, NULL };
+	int destLineSize[4] = { (int)detectionFrame->step[0], 0, 0, 0 };
+	sws_scale(detectionSwsContext, frame->data, frame->linesize, 0, height, destData, destLineSize);
+	videoFrame->detectionFrameCV = *detectionFrame;
+}
+
+void FFmpegDriver::setupSlicedConversion(void) {
+	if(conversionMinimumPixels == 0 || width * height < conversionMinimumPixels) {
+		logger->debug1("Converting <%dx%d> video frames in a single pass.", width, height);
+		return;
+	}
+	const AVPixFmtDescriptor *descriptor = av_pix_fmt_desc_get(pixelFormat);
+	if(descriptor == NULL || (descriptor->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM))) {
+		logger->warning("Input pixel format %s cannot be converted in slices. Falling back to a single pass.", av_get_pix_fmt_name(pixelFormat));
+		return;
+	}
+	int numSlices = conversionSliceCount;
+	if(numSlices > height / YERFACE_CONVERSION_SLICE_ALIGNMENT) {
+		numSlices = height / YERFACE_CONVERSION_SLICE_ALIGNMENT;
+	}
+	if(numSlices < 2) {
+		logger->debug1("Not enough slices to be worth converting <%dx%d> video frames in parallel.", width, height);
+		return;
+	}
+	conversionChromaShift = descriptor->log2_chroma_h;
+
+	//Each slice gets its own context, since a context remembers where the
+	//previous call left off and can't be shared. A context only sees the rows
+	//it is given, so its vertical filters (chroma upsampling in particular)
+	//clamp at its edges. Converting a margin past each inner edge into scratch
+	//and keeping only the owned rows makes the seams match a single pass.
+	for(int i = 0; i < numSlices; i++) {
+		ConversionSlice slice;
+		slice.y = ((height * i) / numSlices) / YERFACE_CONVERSION_SLICE_ALIGNMENT * YERFACE_CONVERSION_SLICE_ALIGNMENT;
+		int end = height;
+		if(i + 1 < numSlices) {
+			end = ((height * (i + 1)) / numSlices) / YERFACE_CONVERSION_SLICE_ALIGNMENT * YERFACE_CONVERSION_SLICE_ALIGNMENT;
+		}
+		slice.height = end - slice.y;
+		slice.sourceY = slice.y - YERFACE_CONVERSION_SLICE_OVERLAP;
+		if(slice.sourceY < 0) {
+			slice.sourceY = 0;
+		}
+		int sourceEnd = end + YERFACE_CONVERSION_SLICE_OVERLAP;
+		if(sourceEnd > height) {
+			sourceEnd = height;
+		}
+		slice.sourceHeight = sourceEnd - slice.sourceY;
+		if((slice.swsContext = sws_getContext(width, slice.sourceHeight, pixelFormat, width, slice.sourceHeight, pixelFormatBacking, workingFrameScaler, NULL, NULL, NULL)) == NULL) {
+			throw runtime_error("failed creating sliced software scaling context");
+		}
+		if(av_image_alloc(slice.scratchData, slice.scratchLineSize, width, slice.sourceHeight, pixelFormatBacking, 32) < 0) {
+			sws_freeContext(slice.swsContext);
+			throw runtime_error("failed allocating sliced conversion scratch buffer");
+		}
+		conversionSlices.push_back(slice);
+	}
+
+	//The demuxer thread converts slices too, so we need one fewer helper than slices.
+	WorkerPoolParameters workerPoolParameters;
+	workerPoolParameters.name = "FFmpegDriver.Conversion";
+	workerPoolParameters.numWorkers = numSlices - 1;
+	workerPoolParameters.numWorkersPerCPU = 0.0;
+	workerPoolParameters.dedicatedThreads = true;
+	workerPoolParameters.initializer = NULL;
+	workerPoolParameters.deinitializer = NULL;
+	workerPoolParameters.usrPtr = (void *)this;
+	workerPoolParameters.handler = NULL;
+	workerPoolParameters.taskHandler = conversionTaskHandler;
+	workerPoolParameters.backlog = NULL;
+	conversionWorkerPool = new WorkerPool(config, status, frameServer, workerPoolParameters);
+
+	logger->info("Converting <%dx%d> video frames in %d parallel slices.", width, height, numSlices);
+}
+
+void FFmpegDriver::convertVideoFrame(AVFrame *frame, VideoFrame *videoFrame) {
+	MetricsTick tick = conversionMetrics->startClock();
+	videoFrame->frameCV = Mat(height, width, CV_8UC3, videoFrame->frameBacking->frameBGR->data[0]);
+
+	if(conversionWorkerPool == NULL) {
+		sws_scale(swsContext, frame->data, frame->linesize, 0, height, videoFrame->frameBacking->frameBGR->data, videoFrame->frameBacking->frameBGR->linesize);
+		scaleDetectionFrame(frame, videoFrame);
+		conversionMetrics->endClock(tick);
+		return;
+	}
+
+	SlicedConversionJob *job = new SlicedConversionJob();
+	job->source = frame;
+	job->destination = videoFrame->frameBacking;
+	job->completedSlices = 0;
+	SDL_AtomicSet(&job->nextSlice, 0);
+	SDL_AtomicSet(&job->refCount, (int)conversionSlices.size());
+
+	WorkerPoolTask task;
+	task.frameNumber = videoFrame->timestamp.frameNumber;
+	task.deadline = frameServer->getFrameDeadline(videoFrame->timestamp);
+	task.shedIfLate = false;
+	task.missedDeadline = false;
+	task.payload = (void *)job;
+	for(size_t i = 1; i < conversionSlices.size(); i++) {
+		conversionWorkerPool->pushTask(task);
+	}
+
+	//The detection frame is scaled from the whole source frame, so it runs here while the helpers get started.
+	scaleDetectionFrame(frame, videoFrame);
+	while(convertNextSlice(job)) {
+		continue;
+	}
+
+	YerFace_MutexLock(conversionMutex);
+	while(job->completedSlices < (int)conversionSlices.size()) {
+		if(SDL_CondWait(conversionCond, conversionMutex) < 0) {
+			YerFace_MutexUnlock(conversionMutex);
+			throw runtime_error("CondWait() failed!");
+		}
+	}
+	YerFace_MutexUnlock(conversionMutex);
+
+	releaseConversionJob(job);
+	conversionMetrics->endClock(tick);
+}
+
+bool FFmpegDriver::convertNextSlice(SlicedConversionJob *job) {
+	int sliceNum = SDL_AtomicAdd(&job->nextSlice, 1);
+	if(sliceNum >= (int)conversionSlices.size()) {
+		return false;
+	}
+	ConversionSlice *slice = &conversionSlices[sliceNum];
+
+	const uint8_t *sourceData[4];
+	int sourceLineSize[4];
+	for(int plane = 0; plane < 4; plane++) {
+		sourceLineSize[plane] = job->source->linesize[plane];
+		if(job->source->data[plane] == NULL) {
+			sourceData[plane] = NULL;
+			continue;
+		}
+		int sliceY = slice->sourceY;
+		if(plane == 1 || plane == 2) {
+			sliceY = sliceY >> conversionChromaShift;
+		}
+		sourceData[plane] = job->source->data[plane] + (ptrdiff_t)sliceY * job->source->linesize[plane];
+	}
+	sws_scale(slice->swsContext, sourceData, sourceLineSize, 0, slice->sourceHeight, slice->scratchData, slice->scratchLineSize);
+
+	//Crop the overlap. Neighbouring slices own those rows.
+	AVFrame *destination = job->destination->frameBGR;
+	av_image_copy_plane(
+		destination->data[0] + (ptrdiff_t)slice->y * destination->linesize[0], destination->linesize[0],
+		slice->scratchData[0] + (ptrdiff_t)(slice->y - slice->sourceY) * slice->scratchLineSize[0], slice->scratchLineSize[0],
+		av_image_get_linesize(pixelFormatBacking, width, 0), slice->height);
+
+	YerFace_MutexLock(conversionMutex);
+	job->completedSlices++;
+	if(job->completedSlices == (int)conversionSlices.size()) {
+		SDL_CondBroadcast(conversionCond);
+	}
+	YerFace_MutexUnlock(conversionMutex);
+	return true;
+}
+
+void FFmpegDriver::releaseConversionJob(SlicedConversionJob *job) {
+	if(SDL_AtomicDecRef(&job->refCount)) {
+		delete job;
+	}
+}
+
+void FFmpegDriver::conversionTaskHandler(WorkerPoolWorker *worker, WorkerPoolTask task) {
+	FFmpegDriver *self = (FFmpegDriver *)worker->ptr;
+	SlicedConversionJob *job = (SlicedConversionJob *)task.payload;
+	while(self->convertNextSlice(job)) {
+		continue;
+	}
+	self->releaseConversionJob(job);
+}
+
+string FFmpegDriver::describeThreadType(int threadType) {
+	if((threadType & FF_THREAD_FRAME) && (threadType & FF_THREAD_SLICE)) {
+		return "frame+slice";
+	} else if(threadType & FF_THREAD_FRAME) {
+		return "frame";
+	} else if(threadType & FF_THREAD_SLICE) {
+		return "slice";
+	}
+	return "no";
+}
+
 bool FFmpegDriver::getIsVideoFrameBufferEmpty(void) {
 	YerFace_MutexLock(videoFrameBufferMutex);
 	bool status = (readyVideoFrameBuffer.size() < 1);
@@ -466,6 +907,7 @@ VideoFrame FFmpegDriver::getNextVideoFrame(void) {
 	if(readyVideoFrameBuffer.size() > 0) {
 		result = readyVideoFrameBuffer.back();
 		readyVideoFrameBuffer.pop_back();
+		wakeDemuxers(); //There's room in the frame buffer now.
 	} else {
 		YerFace_MutexUnlock(videoFrameBufferMutex);
 		throw runtime_error("getNextVideoFrame() was called, but no video frames are pending");
@@ -490,6 +932,7 @@ bool FFmpegDriver::pollForNextVideoFrame(VideoFrame *videoFrame) {
 		VideoFrame invalid;
 		invalid.valid = false;
 		invalid.frameBacking = NULL;
+		invalid.detectionScaleFactor = 0.0;
 		*videoFrame = invalid;
 	} else {
 		*videoFrame = getNextVideoFrame();
@@ -500,9 +943,8 @@ bool FFmpegDriver::pollForNextVideoFrame(VideoFrame *videoFrame) {
 }
 
 void FFmpegDriver::releaseVideoFrame(VideoFrame videoFrame) {
-	YerFace_MutexLock(videoFrameBufferMutex);
-	videoFrame.frameBacking->inUse = false;
-	YerFace_MutexUnlock(videoFrameBufferMutex);
+	videoFrame.frameBacking->release();
+	wakeDemuxers();
 }
 
 void FFmpegDriver::registerAudioFrameCallback(AudioFrameCallback audioFrameCallback) {
@@ -514,6 +956,7 @@ void FFmpegDriver::registerAudioFrameCallback(AudioFrameCallback audioFrameCallb
 	handler->resampler.audioFrameBackings.clear();
 	audioFrameHandlers.push_back(handler);
 	YerFace_MutexUnlock(audioFrameHandlersMutex);
+	wakeDemuxers();
 }
 
 void FFmpegDriver::logAVErr(string msg, int err) {
@@ -527,10 +970,10 @@ VideoFrameBacking *FFmpegDriver::getNextAvailableVideoFrameBacking(void) {
 	VideoFrameBacking *myBacking = NULL;
 	unsigned int availableBackings = 0;
 	for(VideoFrameBacking *backing : allocatedVideoFrameBackings) {
-		if(!backing->inUse) {
+		if(!backing->getIsInUse()) {
 			availableBackings++;
 			if(myBacking == NULL) {
-				backing->inUse = true;
+				backing->retain();
 				myBacking = backing;
 			}
 		}
@@ -539,7 +982,7 @@ VideoFrameBacking *FFmpegDriver::getNextAvailableVideoFrameBacking(void) {
 	if(myBacking == NULL) {
 		logger->notice("Out of spare frames in the video frame buffer! Allocating a new one.");
 		myBacking = allocateNewVideoFrameBacking();
-		myBacking->inUse = true;
+		myBacking->retain();
 	}
 	YerFace_MutexUnlock(videoFrameBufferMutex);
 	return myBacking;
@@ -547,7 +990,7 @@ VideoFrameBacking *FFmpegDriver::getNextAvailableVideoFrameBacking(void) {
 
 VideoFrameBacking *FFmpegDriver::allocateNewVideoFrameBacking(void) {
 	VideoFrameBacking *backing = new VideoFrameBacking();
-	backing->inUse = false;
+	SDL_AtomicSet(&backing->refCount, 0);
 	if(!(backing->frameBGR = av_frame_alloc())) {
 		throw runtime_error("failed allocating backing video frame");
 	}
@@ -570,12 +1013,15 @@ bool FFmpegDriver::decodePacket(MediaInputContext *inputContext, int streamIndex
 
 	if(inputContext->videoStream != NULL && streamIndex == inputContext->videoStreamIndex) {
 		logger->debug3("Got video %s. Sending to codec...", drain ? "flush call" : "packet");
+		MetricsTick decodeTick = videoDecodeMetrics->startClock();
 		if(avcodec_send_packet(inputContext->videoDecoderContext, drain ? NULL : inputContext->packet) < 0) {
 			logger->err("Error decoding video frame");
 			return false;
 		}
 
 		while(avcodec_receive_frame(inputContext->videoDecoderContext, inputContext->frame) == 0) {
+			videoDecodeMetrics->endClock(decodeTick);
+
 			if(inputContext->frame->width != width || inputContext->frame->height != height || inputContext->frame->format != pixelFormat) {
 				logger->crit("We cannot handle runtime changes to video width, height, or pixel format. Unfortunately, the width, height or pixel format of the input video has changed: old [ width = %d, height = %d, format = %s ], new [ width = %d, height = %d, format = %s ]", width, height, av_get_pix_fmt_name(pixelFormat), inputContext->frame->width, inputContext->frame->height, av_get_pix_fmt_name((AVPixelFormat)inputContext->frame->format));
 				av_frame_unref(inputContext->frame);
@@ -596,8 +1042,7 @@ bool FFmpegDriver::decodePacket(MediaInputContext *inputContext, int streamIndex
 			YerFace_MutexUnlock(videoStreamMutex);
 			logger->debug4("Inserted a VideoFrame with timestamps: %.04lf - (estimated) %.04lf", videoFrame.timestamp.startTimestamp, videoFrame.timestamp.estimatedEndTimestamp);
 
-			sws_scale(swsContext, inputContext->frame->data, inputContext->frame->linesize, 0, height, videoFrame.frameBacking->frameBGR->data, videoFrame.frameBacking->frameBGR->linesize);
-			videoFrame.frameCV = Mat(height, width, CV_8UC3, videoFrame.frameBacking->frameBGR->data[0]);
+			convertVideoFrame(inputContext->frame, &videoFrame);
 
 			YerFace_MutexLock(videoFrameBufferMutex);
 			if(lowLatency) {
@@ -613,8 +1058,11 @@ bool FFmpegDriver::decodePacket(MediaInputContext *inputContext, int streamIndex
 			}
 			readyVideoFrameBuffer.push_front(videoFrame);
 			YerFace_MutexUnlock(videoFrameBufferMutex);
+			wakeDemuxers(); //The audio demuxer may have been waiting for video to catch up.
 
 			av_frame_unref(inputContext->frame);
+			//Restart only once conversion and buffering are done, so VideoDecode times just the decoder.
+			decodeTick = videoDecodeMetrics->startClock();
 		}
 	}
 	if(inputContext->audioStream != NULL && streamIndex == inputContext->audioStreamIndex) {
@@ -631,6 +1079,7 @@ bool FFmpegDriver::decodePacket(MediaInputContext *inputContext, int streamIndex
 			newestAudioFrameTimestamp = timestamps.startTimestamp;
 			newestAudioFrameEstimatedEndTimestamp = timestamps.estimatedEndTimestamp;
 			YerFace_MutexUnlock(audioStreamMutex);
+			wakeDemuxers(); //The video demuxer may have been waiting for audio to catch up.
 
 			YerFace_MutexLock(audioFrameHandlersMutex);
 			for(AudioFrameHandler *handler : audioFrameHandlers) {
@@ -701,6 +1150,22 @@ bool FFmpegDriver::decodePacket(MediaInputContext *inputContext, int streamIndex
 }
 
 void FFmpegDriver::rollWorkerThreads(void) {
+	//The muxer goes first, so an offline demuxer which fills the packet ring right away has someone to wait on.
+	if(outputContext.initialized) {
+		YerFace_MutexLock(outputContext.multiplexerMutex);
+		if(outputContext.multiplexerThread != NULL) {
+			YerFace_MutexUnlock(outputContext.multiplexerMutex);
+			throw runtime_error("rollWorkerThreads was called, but muxer was already set rolling!");
+		}
+		outputContext.multiplexerThreadRunning = true;
+		outputContext.multiplexerThread = SDL_CreateThread(FFmpegDriver::runOuterMuxerLoop, "Muxer", (void *)this);
+		if(outputContext.multiplexerThread == NULL) {
+			YerFace_MutexUnlock(outputContext.multiplexerMutex);
+			throw runtime_error("Failed starting muxer thread!");
+		}
+		YerFace_MutexUnlock(outputContext.multiplexerMutex);
+	}
+
 	if(videoInContext.initialized) {
 		YerFace_MutexLock(videoInContext.demuxerMutex);
 		if(videoInContext.demuxerThread != NULL) {
@@ -730,21 +1195,6 @@ void FFmpegDriver::rollWorkerThreads(void) {
 		}
 		YerFace_MutexUnlock(audioInContext.demuxerMutex);
 	}
-
-	if(outputContext.initialized) {
-		YerFace_MutexLock(outputContext.multiplexerMutex);
-		if(outputContext.multiplexerThread != NULL) {
-			YerFace_MutexUnlock(outputContext.multiplexerMutex);
-			throw runtime_error("rollWorkerThreads was called, but muxer was already set rolling!");
-		}
-		outputContext.multiplexerThreadRunning = true;
-		outputContext.multiplexerThread = SDL_CreateThread(FFmpegDriver::runOuterMuxerLoop, "Muxer", (void *)this);
-		if(outputContext.multiplexerThread == NULL) {
-			YerFace_MutexUnlock(outputContext.multiplexerMutex);
-			throw runtime_error("Failed starting muxer thread!");
-		}
-		YerFace_MutexUnlock(outputContext.multiplexerMutex);
-	}
 }
 
 void FFmpegDriver::destroyDemuxerThread(MediaInputContext *inputContext) {
@@ -757,6 +1207,7 @@ void FFmpegDriver::destroyDemuxerThread(MediaInputContext *inputContext) {
 		inputContext->demuxerThreadRunning = false;
 		inputContext->demuxerDraining = true;
 		YerFace_MutexUnlock(inputContext->demuxerMutex);
+		wakeDemuxers();
 
 		if(inputContext->demuxerThread != NULL) {
 			SDL_WaitThread(inputContext->demuxerThread, NULL);
@@ -774,6 +1225,7 @@ void FFmpegDriver::destroyMuxerThread(void) {
 	YerFace_MutexLock(outputContext.multiplexerMutex);
 	outputContext.multiplexerThreadRunning = false;
 	SDL_CondBroadcast(outputContext.multiplexerCond);
+	SDL_CondBroadcast(outputContext.ringSpaceCond);
 	YerFace_MutexUnlock(outputContext.multiplexerMutex);
 	if(outputContext.multiplexerThread != NULL) {
 		SDL_WaitThread(outputContext.multiplexerThread, NULL);
@@ -783,7 +1235,13 @@ void FFmpegDriver::destroyMuxerThread(void) {
 		logger->info("Closing output video file...");
 		// logger->debug3("Calling av_write_trailer(outputContext.formatContext)");
 		av_write_trailer(outputContext.formatContext);
-		if(outputContext.formatContext && !(outputContext.outputFormat->flags & AVFMT_NOFILE)) {
+		if(outputContext.fileIO != NULL) {
+			avio_flush(outputContext.formatContext->pb);
+			av_freep(&outputContext.formatContext->pb->buffer);
+			av_freep(&outputContext.formatContext->pb);
+			avio_close(outputContext.fileIO);
+			outputContext.fileIO = NULL;
+		} else if(outputContext.formatContext && !(outputContext.outputFormat->flags & AVFMT_NOFILE)) {
 			// logger->debug3("Calling avio_close(outputContext.formatContext->pb)");
 			avio_close(outputContext.formatContext->pb);
 		}
@@ -792,12 +1250,28 @@ void FFmpegDriver::destroyMuxerThread(void) {
 		logger->info("All done closing output video file.");
 	}
 
-	if(outputContext.outputPackets.size() > 0) {
-		logger->err("Multiplexer thread failed to multiplex all of the output packets!");
+	size_t leftoverPackets = outputContext.packetRingEnqueuePos.load() - outputContext.packetRingDequeuePos;
+	if(leftoverPackets > 0) {
+		logger->err("Multiplexer thread failed to multiplex all of the output packets! (%lu left over.)", leftoverPackets);
+	}
+	uint64_t packetsDropped = outputContext.packetsDropped.load();
+	logger->info("Multiplexed %lu packets in %lu batches (largest batch: %lu, ring size: %lu).", (unsigned long)outputContext.packetsMultiplexed, (unsigned long)outputContext.packetBatches, outputContext.largestPacketBatch, outputContext.packetRingMask + 1);
+	if(packetsDropped > 0) {
+		logger->err("The output packet ring overflowed, so %lu packets are missing from the output media! Consider a larger packetRingSize.", (unsigned long)packetsDropped);
 	}
+	uint64_t packetRingWaits = outputContext.packetRingWaits.load();
+	if(packetRingWaits > 0) {
+		logger->info("Demuxers waited on a full output packet ring %lu times. Consider a larger packetRingSize.", (unsigned long)packetRingWaits);
+	}
+	for(size_t i = 0; i <= outputContext.packetRingMask; i++) {
+		av_packet_free(&outputContext.packetRing[i].packet);
+	}
+	delete[] outputContext.packetRing;
+	outputContext.packetRing = NULL;
 
 	SDL_DestroyMutex(outputContext.multiplexerMutex);
 	SDL_DestroyCond(outputContext.multiplexerCond);
+	SDL_DestroyCond(outputContext.ringSpaceCond);
 }
 
 int FFmpegDriver::runOuterDemuxerLoop(void *ptr) {
@@ -806,16 +1280,21 @@ int FFmpegDriver::runOuterDemuxerLoop(void *ptr) {
 	const char *demuxerName = inputContext == &driver->videoInContext ? "VIDEO" : "AUDIO";
 	try {
 		driver->logger->debug1("%s Demuxer Thread alive!", demuxerName);
+		string threadName = (string)demuxerName + " Demuxer Thread";
+		CPUAffinity::isolated().applyToCurrentThread(0, 1, driver->logger, threadName.c_str());
 		if(!driver->getIsAudioInputPresent()) {
 			driver->logger->notice("NO AUDIO STREAM IS PRESENT! We can still proceed, but mouth shapes won't be informed by audible speech.");
 		}
 		int ret = driver->innerDemuxerLoop(inputContext);
 		driver->logger->debug1("%s Demuxer Thread quitting...", demuxerName);
+		//The capture worker only sleeps until signalled, and it is the one which notices that every demuxer has finished.
+		driver->signalVideoCaptureWorker();
 		return ret;
 	} catch(exception &e) {
 		driver->logger->emerg("Uncaught exception in %s demuxer worker thread: %s\n", demuxerName, e.what());
 		driver->status->setEmergency();
 	}
+	driver->signalVideoCaptureWorker();
 	return 1;
 }
 
@@ -823,6 +1302,7 @@ int FFmpegDriver::runOuterMuxerLoop(void *ptr) {
 	FFmpegDriver *driver = (FFmpegDriver *)ptr;
 	try {
 		driver->logger->debug1("Media Muxer Thread alive!");
+		CPUAffinity::isolated().applyToCurrentThread(0, 1, driver->logger, "Media Muxer Thread");
 		if(!driver->outputContext.initialized) {
 			throw logic_error("Trying to kick off a muxer thread, but muxer initialization did not occur!");
 		}
@@ -839,32 +1319,27 @@ int FFmpegDriver::runOuterMuxerLoop(void *ptr) {
 int FFmpegDriver::innerMuxerLoop(void) {
 	YerFace_MutexLock(outputContext.multiplexerMutex);
 	while(outputContext.multiplexerThreadRunning) {
-		bool didWork = false;
-
-		if(outputContext.outputPackets.size() > 0) {
-			AVPacket *packet = outputContext.outputPackets.back();
-			outputContext.outputPackets.pop_back();
-
-			YerFace_MutexUnlock(outputContext.multiplexerMutex);
-			int ret = av_interleaved_write_frame(outputContext.formatContext, packet);
-			if(ret < 0) {
-				throw runtime_error("Failed during packet multiplexing!");
-			}
-			av_packet_free(&packet); // av_packet_free() also handles reference counting.
-			didWork = true;
-			YerFace_MutexLock(outputContext.multiplexerMutex);
-		}
+		YerFace_MutexUnlock(outputContext.multiplexerMutex);
+		size_t batch = drainOutputPackets(outputContext.drainBatchSize);
+		YerFace_MutexLock(outputContext.multiplexerMutex);
 
-		//Sleep, waiting for work.
-		if(!didWork) {
-			int result = SDL_CondWaitTimeout(outputContext.multiplexerCond, outputContext.multiplexerMutex, 100);
-			if(result < 0) {
-				throw runtime_error("CondWaitTimeout() failed!");
-			} else if(result == SDL_MUTEX_TIMEDOUT) {
-				if(!status->getIsPaused()) {
-					logger->debug1("Multiplexer thread timed out waiting for Condition signal!");
+		//Sleep, waiting for work. Demuxers check multiplexerWaiting after publishing a packet, so
+		//with the fences on both sides, either they see it set or we see their packet.
+		if(batch == 0) {
+			outputContext.multiplexerWaiting.store(true);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if(!getIsOutputPacketReady() && outputContext.multiplexerThreadRunning) {
+				int result = SDL_CondWaitTimeout(outputContext.multiplexerCond, outputContext.multiplexerMutex, YERFACE_MULTIPLEXER_IDLE_MILLISECONDS);
+				if(result < 0) {
+					YerFace_MutexUnlock(outputContext.multiplexerMutex);
+					throw runtime_error("CondWaitTimeout() failed!");
+				} else if(result == SDL_MUTEX_TIMEDOUT) {
+					if(!status->getIsPaused()) {
+						logger->debug1("Multiplexer thread timed out waiting for Condition signal!");
+					}
 				}
 			}
+			outputContext.multiplexerWaiting.store(false);
 		}
 		if(status->getEmergency()) {
 			logger->debug1("Multiplexer thread honoring emergency stop.");
@@ -872,9 +1347,124 @@ int FFmpegDriver::innerMuxerLoop(void) {
 		}
 	}
 	YerFace_MutexUnlock(outputContext.multiplexerMutex);
+
+	//The demuxers are gone by the time we are stopped, so whatever they handed us still belongs in the output.
+	if(!status->getEmergency()) {
+		while(drainOutputPackets(outputContext.drainBatchSize) > 0) {
+			continue;
+		}
+	}
 	return 0;
 }
 
+bool FFmpegDriver::enqueueOutputPacket(AVPacket *packet) {
+	size_t pos = outputContext.packetRingEnqueuePos.load(std::memory_order_relaxed);
+	OutputPacketRingCell *cell;
+	for(;;) {
+		cell = &outputContext.packetRing[pos & outputContext.packetRingMask];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+		if(diff == 0) {
+			//The cell is free. Claim it, unless another demuxer got there first. (In which case pos is refreshed for us.)
+			if(outputContext.packetRingEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if(diff < 0) {
+			//The multiplexer hasn't finished with this cell from the previous lap. We're full.
+			return false;
+		} else {
+			pos = outputContext.packetRingEnqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+	av_packet_move_ref(cell->packet, packet);
+	cell->sequence.store(pos + 1, std::memory_order_release);
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(outputContext.multiplexerWaiting.load(std::memory_order_relaxed)) {
+		YerFace_MutexLock(outputContext.multiplexerMutex);
+		SDL_CondSignal(outputContext.multiplexerCond);
+		YerFace_MutexUnlock(outputContext.multiplexerMutex);
+	}
+	return true;
+}
+
+bool FFmpegDriver::waitToEnqueueOutputPacket(AVPacket *packet) {
+	//Same handshake as the multiplexer's own sleep. We announce ourselves before retrying, and the multiplexer
+	//checks ringSpaceWaiters after handing back cells, so either our retry succeeds or it signals us.
+	outputContext.packetRingWaits++;
+	YerFace_MutexLock(outputContext.multiplexerMutex);
+	outputContext.ringSpaceWaiters++;
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	bool enqueued = false;
+	while(!(enqueued = enqueueOutputPacket(packet))) {
+		if(!outputContext.multiplexerThreadRunning || status->getEmergency()) {
+			break;
+		}
+		if(SDL_CondWaitTimeout(outputContext.ringSpaceCond, outputContext.multiplexerMutex, YERFACE_MULTIPLEXER_IDLE_MILLISECONDS) < 0) {
+			outputContext.ringSpaceWaiters--;
+			YerFace_MutexUnlock(outputContext.multiplexerMutex);
+			throw runtime_error("CondWaitTimeout() failed!");
+		}
+	}
+	outputContext.ringSpaceWaiters--;
+	YerFace_MutexUnlock(outputContext.multiplexerMutex);
+	return enqueued;
+}
+
+size_t FFmpegDriver::drainOutputPackets(size_t maxPackets) {
+	// NOTE: Only the multiplexer thread may call this.
+	size_t count = 0;
+	while(count < maxPackets && getIsOutputPacketReady()) {
+		OutputPacketRingCell *cell = &outputContext.packetRing[outputContext.packetRingDequeuePos & outputContext.packetRingMask];
+		int ret = av_interleaved_write_frame(outputContext.formatContext, cell->packet);
+		av_packet_unref(cell->packet);
+		//Hand the cell back to the demuxers for the next lap around the ring.
+		cell->sequence.store(outputContext.packetRingDequeuePos + outputContext.packetRingMask + 1, std::memory_order_release);
+		outputContext.packetRingDequeuePos++;
+		if(ret < 0) {
+			throw runtime_error("Failed during packet multiplexing!");
+		}
+		count++;
+	}
+	if(count > 0) {
+		outputContext.packetsMultiplexed += count;
+		outputContext.packetBatches++;
+		if(count > outputContext.largestPacketBatch) {
+			outputContext.largestPacketBatch = count;
+		}
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(outputContext.ringSpaceWaiters.load(std::memory_order_relaxed) > 0) {
+			YerFace_MutexLock(outputContext.multiplexerMutex);
+			SDL_CondBroadcast(outputContext.ringSpaceCond);
+			YerFace_MutexUnlock(outputContext.multiplexerMutex);
+		}
+	}
+	return count;
+}
+
+bool FFmpegDriver::getIsOutputPacketReady(void) {
+	// NOTE: Only the multiplexer thread may call this.
+	OutputPacketRingCell *cell = &outputContext.packetRing[outputContext.packetRingDequeuePos & outputContext.packetRingMask];
+	return cell->sequence.load(std::memory_order_acquire) == outputContext.packetRingDequeuePos + 1;
+}
+
+int FFmpegDriver::writeOutputIO(void *opaque, uint8_t *buf, int bufSize) {
+	AVIOContext *fileIO = (AVIOContext *)opaque;
+	avio_write(fileIO, buf, bufSize);
+	if(fileIO->error < 0) {
+		return fileIO->error;
+	}
+	return bufSize;
+}
+
+int64_t FFmpegDriver::seekOutputIO(void *opaque, int64_t offset, int whence) {
+	AVIOContext *fileIO = (AVIOContext *)opaque;
+	if(whence & AVSEEK_SIZE) {
+		return avio_size(fileIO);
+	}
+	return avio_seek(fileIO, offset, whence & ~AVSEEK_FORCE);
+}
+
 int FFmpegDriver::innerDemuxerLoop(MediaInputContext *inputContext) {
 	bool blockedWarning = false;
 	const char *demuxerName = inputContext == &videoInContext ? "VIDEO" : "AUDIO";
@@ -885,10 +1475,14 @@ int FFmpegDriver::innerDemuxerLoop(MediaInputContext *inputContext) {
 	while(inputContext->demuxerThreadRunning) {
 		// logger->debug4("%s Demuxer thread top-of-loop.", demuxerName);
 
+		// Anything which changes after this point will wake us from waitForDemuxerWakeup().
+		Uint32 wakeupsSeen = getDemuxerWakeups();
+		bool didPump = false;
+
 		// Handle pausing
 		if(status->getIsPaused() && status->getIsRunning()) {
 			YerFace_MutexUnlock(inputContext->demuxerMutex);
-			SDL_Delay(100);
+			status->waitWhilePaused();
 			YerFace_MutexLock(inputContext->demuxerMutex);
 			continue;
 		}
@@ -900,7 +1494,7 @@ int FFmpegDriver::innerDemuxerLoop(MediaInputContext *inputContext) {
 				blockedWarning = true;
 			}
 			YerFace_MutexUnlock(inputContext->demuxerMutex);
-			SDL_Delay(10);
+			waitForDemuxerWakeup(wakeupsSeen);
 			YerFace_MutexLock(inputContext->demuxerMutex);
 			continue;
 		} else {
@@ -934,6 +1528,7 @@ int FFmpegDriver::innerDemuxerLoop(MediaInputContext *inputContext) {
 				if(!getIsVideoDraining()) {
 					// logger->debug3("%s Demuxer Pumping VIDEO stream.", demuxerName);
 					pumpDemuxer(inputContext, AVMEDIA_TYPE_VIDEO);
+					didPump = true;
 					// logger->debug3("%s Demuxer Finished pumping VIDEO stream.", demuxerName);
 				}
 			}
@@ -945,6 +1540,7 @@ int FFmpegDriver::innerDemuxerLoop(MediaInputContext *inputContext) {
 				if(!getIsAudioDraining()) {
 					// logger->debug3("%s Demuxer Pumping AUDIO stream.", demuxerName);
 					pumpDemuxer(inputContext, AVMEDIA_TYPE_AUDIO);
+					didPump = true;
 					// logger->debug3("%s Demuxer Finished pumping AUDIO stream.", demuxerName);
 				}
 
@@ -954,9 +1550,9 @@ int FFmpegDriver::innerDemuxerLoop(MediaInputContext *inputContext) {
 
 		// Handle downstream thread wakeups
 		if(videoIsMyResponsibility) {
-			if(videoCaptureWorkerPool != NULL && !getIsVideoFrameBufferEmpty()) {
+			if(!getIsVideoFrameBufferEmpty()) {
 				// logger->debug4("%s Demuxer Sending a signal to the Video Capture thread!", demuxerName);
-				videoCaptureWorkerPool->sendWorkerSignal();
+				signalVideoCaptureWorker();
 			}
 		}
 
@@ -966,11 +1562,11 @@ int FFmpegDriver::innerDemuxerLoop(MediaInputContext *inputContext) {
 			inputContext->demuxerThreadRunning = false;
 		}
 
-		// Sleep
-		if(inputContext->demuxerThreadRunning) {
+		// Sleep, if this pass had nothing to do. (Waiting on the other stream, or on draining.)
+		if(inputContext->demuxerThreadRunning && !didPump) {
 			YerFace_MutexUnlock(inputContext->demuxerMutex);
 			// logger->debug4("%s Demuxer going to sleep!", demuxerName);
-			SDL_Delay(0); //All we want to do here is relinquish our execution thread. We still want to get it back asap.
+			waitForDemuxerWakeup(wakeupsSeen);
 			// logger->debug4("%s Demuxer thread awake!", demuxerName);
 			YerFace_MutexLock(inputContext->demuxerMutex);
 		}
@@ -1021,6 +1617,7 @@ void FFmpegDriver::pumpDemuxer(MediaInputContext *inputContext, enum AVMediaType
 			YerFace_MutexLock(streamMutex);
 			inputContext->demuxerDraining = true;
 			YerFace_MutexUnlock(streamMutex);
+			wakeDemuxers();
 
 			if(inputContext->videoStream != NULL) {
 				decodePacket(inputContext, inputContext->videoStreamIndex, true);
@@ -1034,8 +1631,8 @@ void FFmpegDriver::pumpDemuxer(MediaInputContext *inputContext, enum AVMediaType
 			}
 
 			// Handle output packet for the multiplexer thread.
+			// NOTE: Each stream's timestamps are only ever touched by the demuxer which owns it, so no lock is needed here.
 			if(outputContext.initialized) {
-				YerFace_MutexLock(outputContext.multiplexerMutex);
 				AVStream *in = NULL, *out = NULL;
 				int outputStreamIndex = -1;
 				int64_t *ptsOffset = NULL;
@@ -1076,17 +1673,23 @@ void FFmpegDriver::pumpDemuxer(MediaInputContext *inputContext, enum AVMediaType
 					} else {
 						*lastPTS = inputContext->packet->pts;
 						*lastDTS = inputContext->packet->dts;
-						outputContext.outputPackets.push_front(inputContext->packet);
-						inputContext->packet = NULL;
-						SDL_CondBroadcast(outputContext.multiplexerCond);
+						bool enqueued = enqueueOutputPacket(inputContext->packet);
+						if(!enqueued && !lowLatency) {
+							//Offline, the recording must be complete, so we wait for the multiplexer to catch up.
+							enqueued = waitToEnqueueOutputPacket(inputContext->packet);
+						}
+						if(!enqueued) {
+							//Never stall live capture on behalf of the recording.
+							uint64_t dropped = ++outputContext.packetsDropped;
+							if(dropped == 1 || dropped % 100 == 0) {
+								logger->err("Output packet ring is full! Dropped %s packet. (%lu dropped so far.)", inputContext->packet->stream_index == outputContext.videoStreamIndex ? "VIDEO" : "AUDIO", (unsigned long)dropped);
+							}
+						}
 					}
 				}
-				YerFace_MutexUnlock(outputContext.multiplexerMutex);
-			} else {
-				// If we have no multiplexer thread...
-				av_packet_free(&inputContext->packet); // av_packet_free() also handles reference counting.
 			}
 		}
+		av_packet_free(&inputContext->packet); // av_packet_free() also handles reference counting. (Enqueued packets were moved out already.)
 	} catch(exception &e) {
 		logger->emerg("Caught Exception: %s", e.what());
 		status->setEmergency();
@@ -1131,6 +1734,36 @@ bool FFmpegDriver::flushAudioHandlers(bool draining) {
 	return completelyFlushed;
 }
 
+Uint32 FFmpegDriver::getDemuxerWakeups(void) {
+	YerFace_MutexLock(demuxerWakeMutex);
+	Uint32 wakeups = demuxerWakeups;
+	YerFace_MutexUnlock(demuxerWakeMutex);
+	return wakeups;
+}
+
+void FFmpegDriver::wakeDemuxers(void) {
+	YerFace_MutexLock(demuxerWakeMutex);
+	demuxerWakeups++;
+	SDL_CondBroadcast(demuxerWakeCond);
+	YerFace_MutexUnlock(demuxerWakeMutex);
+}
+
+void FFmpegDriver::handleStatusChangeEvent(void *userdata) {
+	FFmpegDriver *self = (FFmpegDriver *)userdata;
+	self->wakeDemuxers();
+}
+
+void FFmpegDriver::waitForDemuxerWakeup(Uint32 wakeupsSeen) {
+	YerFace_MutexLock(demuxerWakeMutex);
+	while(demuxerWakeups == wakeupsSeen) {
+		if(SDL_CondWait(demuxerWakeCond, demuxerWakeMutex) < 0) {
+			YerFace_MutexUnlock(demuxerWakeMutex);
+			throw runtime_error("CondWait() failed!");
+		}
+	}
+	YerFace_MutexUnlock(demuxerWakeMutex);
+}
+
 bool FFmpegDriver::getIsAudioInputPresent(void) {
 	return (videoInContext.audioStream != NULL) || (audioInContext.audioStream != NULL);
 }
@@ -1192,6 +1825,7 @@ void FFmpegDriver::stopAudioCallbacksNow(void) {
 	YerFace_MutexLock(audioFrameHandlersMutex);
 	audioFrameHandlersOkay = false;
 	YerFace_MutexUnlock(audioFrameHandlersMutex);
+	wakeDemuxers();
 }
 
 void FFmpegDriver::recursivelyListAllAVOptions(void *obj, string depth) {
@@ -1212,14 +1846,10 @@ void FFmpegDriver::recursivelyListAllAVOptions(void *obj, string depth) {
 }
 
 bool FFmpegDriver::getIsAllocatedVideoFrameBackingsFull(void) {
-	bool isFull = true;
+	// NOTE: Backings retained downstream (by FrameServer) do not count against us here.
+	// Those are bounded by the frame server, and blocking on them would also stall audio demuxing.
 	YerFace_MutexLock(videoFrameBufferMutex);
-	for(VideoFrameBacking *backing : allocatedVideoFrameBackings) {
-		if(!backing->inUse) {
-			isFull = false;
-			break;
-		}
-	}
+	bool isFull = readyVideoFrameBuffer.size() >= YERFACE_INITIAL_VIDEO_BACKING_FRAMES;
 	YerFace_MutexUnlock(videoFrameBufferMutex);
 	return isFull;
 }
@@ -3,13 +3,16 @@
 #include "Logger.hpp"
 #include "Utilities.hpp"
 #include "FrameServer.hpp"
+#include "Metrics.hpp"
 #include "WorkerPool.hpp"
 
 #include <string>
 #include <list>
+#include <atomic>
 
 extern "C" {
 #include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
 // #include <libavutil/timestamp.h>
 #include <libavformat/avformat.h>
 #include <libavdevice/avdevice.h>
@@ -24,6 +27,11 @@ namespace YerFace {
 #define YERFACE_FRAME_DURATION_ESTIMATE_BUFFER 10
 #define YERFACE_INITIAL_VIDEO_BACKING_FRAMES 60
 #define YERFACE_MAX_PUMPTIME 67 //If a/v stream pumping is taking longer than 1/15th of a second, we may have a hardware problem.
+#define YERFACE_MULTIPLEXER_IDLE_MILLISECONDS 100
+#define YERFACE_MAX_DECODER_THREADS 16 //libavcodec does not scale much past this, and frame threading buffers one frame per thread.
+#define YERFACE_MAX_CONVERSION_SLICES 16
+#define YERFACE_CONVERSION_SLICE_ALIGNMENT 16 //Slices start on multiples of this many rows, so they never split a subsampled chroma row.
+#define YERFACE_CONVERSION_SLICE_OVERLAP 16 //Rows converted past each inner slice edge and then cropped, so vertical filter taps never clamp at a seam. (Keep it a multiple of the alignment.)
 
 #define YERFACE_AVLOG_LEVELMAP_MIN 0		//Less than this gets dropped.
 #define YERFACE_AVLOG_LEVELMAP_ALERT 8		//Less than this (libav* defines 0-7 as PANIC) gets mapped to our LOG_SEVERITY_ALERT
@@ -86,6 +94,12 @@ public:
 	bool initialized;
 };
 
+class OutputPacketRingCell {
+public:
+	std::atomic<size_t> sequence; //Equal to the ring position when the cell is free, one past it once a packet has been published into it.
+	AVPacket *packet; //Allocated once, when the output is opened. Packets are moved in and out by reference.
+};
+
 class MediaOutputContext {
 public:
 	MediaOutputContext(void);
@@ -102,17 +116,42 @@ public:
 	SDL_cond *multiplexerCond;
 	SDL_Thread *multiplexerThread;
 	bool multiplexerThreadRunning;
-
-	std::list<AVPacket *> outputPackets;
+	std::atomic<bool> multiplexerWaiting; //Demuxers only take multiplexerMutex (to signal) when this is set.
+	SDL_cond *ringSpaceCond; //Offline, demuxers sleep here (under multiplexerMutex) while the packet ring is full.
+	std::atomic<int> ringSpaceWaiters; //The multiplexer only takes multiplexerMutex (to signal) when this is nonzero.
+
+	//Bounded, lock-free ring of packets from the demuxer threads (many producers)
+	//to the multiplexer thread (one consumer). When it is full in low latency mode,
+	//packets are dropped and counted rather than blocking the demuxers. Offline,
+	//the demuxers wait for space instead, because every packet must be written.
+	OutputPacketRingCell *packetRing;
+	size_t packetRingMask; //Ring size is a power of two.
+	std::atomic<size_t> packetRingEnqueuePos;
+	size_t packetRingDequeuePos; //Only touched by the multiplexer thread.
+	size_t drainBatchSize; //Most packets written per pass before the multiplexer checks its status again.
+	std::atomic<uint64_t> packetsDropped;
+	std::atomic<uint64_t> packetRingWaits;
+	uint64_t packetsMultiplexed, packetBatches;
+	size_t largestPacketBatch;
+
+	AVIOContext *fileIO; //Unbuffered handle underneath our own AVIO buffer, or NULL if libavformat's default buffering is in use.
 
 	bool initialized;
 };
 
+// Decoded video frame memory. Backings are pooled by FFmpegDriver, and are
+// shared (without copying) by anyone who retains a reference. A backing is
+// only reused once every reference has been released.
 class VideoFrameBacking {
 public:
+	void retain(void);
+	void release(void);
+	bool getIsInUse(void);
+
 	AVFrame *frameBGR;
 	uint8_t *buffer;
-	bool inUse;
+	cv::Mat detectionFrame; //BGR, at the detection scale. Only reallocated when the detection size changes.
+	SDL_atomic_t refCount;
 };
 
 class VideoFrame {
@@ -121,6 +160,8 @@ public:
 	FrameTimestamps timestamp;
 	VideoFrameBacking *frameBacking;
 	cv::Mat frameCV;
+	cv::Mat detectionFrameCV; //Scaled straight from the decoder's native pixel format. (Points into frameBacking.)
+	double detectionScaleFactor;
 };
 
 class AudioFrameCallback {
@@ -156,9 +197,36 @@ public:
 	AudioFrameCallback audioFrameCallback;
 };
 
+class DecoderThreading {
+public:
+	int threadCount;
+	int threadType; //Bitmask of FF_THREAD_FRAME and FF_THREAD_SLICE.
+};
+
+class ConversionSlice {
+public:
+	int y, height; //Rows this slice owns in the output.
+	int sourceY, sourceHeight; //Rows actually converted. (Owned rows plus YERFACE_CONVERSION_SLICE_OVERLAP on each inner edge.)
+	struct SwsContext *swsContext; //Only ever used by whichever thread claimed this slice for the current frame.
+	uint8_t *scratchData[4]; //Sized for sourceHeight rows. Only the owned rows get copied out.
+	int scratchLineSize[4];
+};
+
+// One frame's worth of sliced conversion. The demuxer thread and the helper
+// tasks it pushes all claim slices from nextSlice until none are left, so the
+// frame finishes even if no helper ever gets around to running.
+class SlicedConversionJob {
+public:
+	AVFrame *source;
+	VideoFrameBacking *destination;
+	SDL_atomic_t nextSlice;
+	SDL_atomic_t refCount; //Helper tasks which have not finished with the job yet, plus the demuxer thread.
+	int completedSlices; //Protected by FFmpegDriver::conversionMutex.
+};
+
 class FFmpegDriver {
 public:
-	FFmpegDriver(Status *myStatus, FrameServer *myFrameServer, bool myLowLatency, bool myListAllAvailableOptions);
+	FFmpegDriver(json config, Status *myStatus, FrameServer *myFrameServer, bool myLowLatency, bool myListAllAvailableOptions);
 	~FFmpegDriver() noexcept(false);
 	void openInputMedia(string inFile, enum AVMediaType type, string inFormat, string inSize, string inChannels, string inRate, string inCodec, string inputAudioChannelMap, bool tryAudio);
 	void openOutputMedia(string outFile);
@@ -174,6 +242,15 @@ public:
 private:
 	void logAVErr(string msg, int err);
 	void openCodecContext(int *streamIndex, AVCodecContext **decoderContext, AVFormatContext *myFormatContext, enum AVMediaType type);
+	DecoderThreading parseDecoderThreading(json decoderConfig, string mediaType);
+	string describeThreadType(int threadType);
+	int parseScalerAlgorithm(string scaler);
+	void scaleDetectionFrame(AVFrame *frame, VideoFrame *videoFrame);
+	void setupSlicedConversion(void);
+	void convertVideoFrame(AVFrame *frame, VideoFrame *videoFrame);
+	bool convertNextSlice(SlicedConversionJob *job); //False once every slice has been claimed.
+	void releaseConversionJob(SlicedConversionJob *job);
+	static void conversionTaskHandler(WorkerPoolWorker *worker, WorkerPoolTask task);
 	VideoFrameBacking *getNextAvailableVideoFrameBacking(void);
 	VideoFrameBacking *allocateNewVideoFrameBacking(void);
 	bool decodePacket(MediaInputContext *inputContext, int streamIndex, bool drain);
@@ -181,10 +258,21 @@ private:
 	void destroyMuxerThread(void);
 	static int runOuterDemuxerLoop(void *ptr);
 	static int runOuterMuxerLoop(void *ptr);
+	static void handleStatusChangeEvent(void *userdata);
 	int innerDemuxerLoop(MediaInputContext *inputContext);
 	int innerMuxerLoop(void);
 	void pumpDemuxer(MediaInputContext *inputContext, enum AVMediaType type);
 	bool flushAudioHandlers(bool draining);
+	void signalVideoCaptureWorker(void);
+	bool enqueueOutputPacket(AVPacket *packet);
+	bool waitToEnqueueOutputPacket(AVPacket *packet);
+	size_t drainOutputPackets(size_t maxPackets);
+	bool getIsOutputPacketReady(void);
+	static int writeOutputIO(void *opaque, uint8_t *buf, int bufSize);
+	static int64_t seekOutputIO(void *opaque, int64_t offset, int whence);
+	Uint32 getDemuxerWakeups(void);
+	void wakeDemuxers(void);
+	void waitForDemuxerWakeup(Uint32 wakeupsSeen);
 	bool getIsAudioDraining(void);
 	bool getIsVideoDraining(void);
 	FrameTimestamps resolveFrameTimestamp(MediaInputContext *inputContext, enum AVMediaType type);
@@ -194,12 +282,16 @@ private:
 	static void logAVCallback(void *ptr, int level, const char *fmt, va_list args);
 	static void logAVWrapper(int level, const char *fmt, ...);
 
+	json config;
 	Status *status;
 	FrameServer *frameServer;
 	bool lowLatency;
-	WorkerPool *videoCaptureWorkerPool;
+	WorkerPool *videoCaptureWorkerPool; //Protected by videoFrameBufferMutex.
 
 	Logger *logger;
+	Metrics *videoDecodeMetrics;
+
+	DecoderThreading videoDecoderThreading, audioDecoderThreading;
 
 	std::list<double> frameStartTimes;
 
@@ -209,6 +301,19 @@ private:
 	int width, height;
 	enum AVPixelFormat pixelFormat, pixelFormatBacking;
 	struct SwsContext *swsContext;
+	struct SwsContext *detectionSwsContext; //Recreated by sws_getCachedContext() whenever the detection size changes.
+	int workingFrameScaler, detectionFrameScaler; //SWS_* algorithm flags.
+	cv::Size detectionFrameSize;
+
+	//Sliced conversion, for inputs of at least conversionMinimumPixels. (See setupSlicedConversion().)
+	int conversionMinimumPixels;
+	int conversionSliceCount;
+	int conversionChromaShift; //log2 of the input's vertical chroma subsampling.
+	std::vector<ConversionSlice> conversionSlices; //Empty unless sliced conversion is in use.
+	WorkerPool *conversionWorkerPool;
+	SDL_mutex *conversionMutex;
+	SDL_cond *conversionCond;
+	Metrics *conversionMetrics;
 
 	SDL_mutex *videoStreamMutex;
 	double videoStreamTimeBase;
@@ -232,6 +337,13 @@ private:
 	std::vector<AudioFrameHandler *> audioFrameHandlers;
 	bool audioFrameHandlersOkay;
 
+	//Demuxer threads with nothing to do sleep on demuxerWakeCond until anything
+	//they might be waiting on changes. (Room in the frame buffer, the other
+	//stream catching up, draining, or audio handlers coming and going.)
+	SDL_mutex *demuxerWakeMutex;
+	SDL_cond *demuxerWakeCond;
+	Uint32 demuxerWakeups; //Bumped on every wakeup, so a demuxer can tell whether it missed one before it went to sleep.
+
 	static Logger *avLogger;
 	static SDL_mutex *avLoggerMutex;
 };
@@ -1,5 +1,6 @@
 
 #include "FaceDetector.hpp"
+#include "WorkScheduler.hpp"
 #include "Utilities.hpp"
 
 #include "dlib/opencv.h"
@@ -55,10 +56,13 @@ FaceDetector::FaceDetector(json config, Status *myStatus, FrameServer *myFrameSe
 	}
 	metrics = new Metrics(config, "FaceDetector.Detections");
 	assignmentMetrics = new Metrics(config, "FaceDetector.Assignments");
+	assignmentFrameQueue = new SequencedFrameQueue("FaceDetector.Assignment");
 	resultGoodForSeconds = config["YerFace"]["FaceDetector"]["resultGoodForSeconds"];
 	if(resultGoodForSeconds < 0.0) {
 		throw invalid_argument("resultGoodForSeconds cannot be less than zero.");
 	}
+	detectionIntervalSeconds = 0.0;
+	lastDetectionRequestTimestamp = -1.0;
 	faceDetectionModelFileName = Utilities::fileValidPathOrDie(config["YerFace"]["FaceDetector"]["dlibFaceDetector"]);
 	faceBoxSizeAdjustment = config["YerFace"]["FaceDetector"]["faceBoxSizeAdjustment"];
 	if(faceBoxSizeAdjustment < 0.0) {
@@ -72,6 +76,8 @@ FaceDetector::FaceDetector(json config, Status *myStatus, FrameServer *myFrameSe
 	}
 	latestDetection.run = false;
 	latestDetection.set = false;
+	unassignedDetection.run = false;
+	unassignedDetection.set = false;
 	latestDetectionLostWarning = false;
 
 	//Hook into the frame lifecycle.
@@ -84,29 +90,31 @@ FaceDetector::FaceDetector(json config, Status *myStatus, FrameServer *myFrameSe
 	frameServer->onFrameStatusChangeEvent(frameStatusChangeCallback);
 	frameStatusChangeCallback.newStatus = FRAME_STATUS_DETECTION;
 	frameServer->onFrameStatusChangeEvent(frameStatusChangeCallback);
-	frameStatusChangeCallback.newStatus = FRAME_STATUS_GONE;
-	frameServer->onFrameStatusChangeEvent(frameStatusChangeCallback);
 
 	//We also want to introduce a checkpoint so that frames cannot TRANSITION AWAY from FRAME_STATUS_DETECTION without our blessing.
-	frameServer->registerFrameStatusCheckpoint(FRAME_STATUS_DETECTION, "faceDetector.ran");
+	frameServer->registerFrameStatusCheckpoint(FRAME_STATUS_DETECTION, FRAME_CHECKPOINT_FACEDETECTOR);
 
 	WorkerPoolParameters workerPoolParameters;
 	workerPoolParameters.name = "FaceDetector.Detect";
 	workerPoolParameters.numWorkers = config["YerFace"]["FaceDetector"]["numWorkers"];
 	workerPoolParameters.numWorkersPerCPU = config["YerFace"]["FaceDetector"]["numWorkersPerCPU"];
+	workerPoolParameters.dedicatedThreads = false;
 	workerPoolParameters.initializer = detectionWorkerInitializer;
 	workerPoolParameters.deinitializer = NULL;
 	workerPoolParameters.usrPtr = (void *)this;
-	workerPoolParameters.handler = detectionWorkerHandler;
+	workerPoolParameters.handler = NULL;
+	workerPoolParameters.taskHandler = detectionTaskHandler;
 	detectionWorkerPool = new WorkerPool(config, status, frameServer, workerPoolParameters);
 
 	workerPoolParameters.name = "FaceDetector.Assign";
 	workerPoolParameters.numWorkers = 1;
 	workerPoolParameters.numWorkersPerCPU = 0.0;
+	workerPoolParameters.dedicatedThreads = false;
 	workerPoolParameters.initializer = NULL;
 	workerPoolParameters.deinitializer = NULL;
 	workerPoolParameters.usrPtr = (void *)this;
 	workerPoolParameters.handler = assignmentWorkerHandler;
+	workerPoolParameters.taskHandler = NULL;
 	assignmentWorkerPool = new WorkerPool(config, status, frameServer, workerPoolParameters);
 
 	logger->debug1("FaceDetector object constructed with Face Detection Method: %s", usingDNNFaceDetection ? "DNN" : "HOG");
@@ -118,7 +126,7 @@ FaceDetector::~FaceDetector() noexcept(false) {
 	delete detectionWorkerPool;
 	delete assignmentWorkerPool;
 
-	if(assignmentFrameNumbers.size() > 0) {
+	if(assignmentFrameQueue->size() > 0) {
 		logger->err("Assignment Frames are still pending! Woe is me!");
 	}
 	if(detectionTasks.size() > 0) {
@@ -128,23 +136,22 @@ FaceDetector::~FaceDetector() noexcept(false) {
 	SDL_DestroyMutex(myMutex);
 	SDL_DestroyMutex(myAssignmentMutex);
 	SDL_DestroyMutex(detectionsMutex);
+	delete assignmentFrameQueue;
 	delete logger;
 	delete assignmentMetrics;
 	delete metrics;
 }
 
-FacialDetectionBox FaceDetector::getFacialDetection(FrameNumber frameNumber) {
-	FacialDetectionBox detection;
-	YerFace_MutexLock(detectionsMutex);
-	detection = detections[frameNumber];
-	YerFace_MutexUnlock(detectionsMutex);
-	return detection;
+const FacialDetectionBox &FaceDetector::getFacialDetection(FrameNumber frameNumber) {
+	const FacialDetectionBox *detection = frameServer->getWorkingFrame(frameNumber)->getResult<FacialDetectionBox>(FRAME_RESULT_FACEDETECTION);
+	if(detection == NULL) {
+		return unassignedDetection;
+	}
+	return *detection;
 }
 
 void FaceDetector::renderPreviewHUD(Mat previewFrame, FrameNumber frameNumber, int density, bool mirrorMode) {
-	YerFace_MutexLock(detectionsMutex);
-	FacialDetectionBox detection = detections[frameNumber];
-	YerFace_MutexUnlock(detectionsMutex);
+	const FacialDetectionBox &detection = getFacialDetection(frameNumber);
 
 	if(density > 1) {
 		if(detection.set) {
@@ -157,6 +164,26 @@ void FaceDetector::renderPreviewHUD(Mat previewFrame, FrameNumber frameNumber, i
 	}
 }
 
+void FaceDetector::setDetectionIntervalSeconds(double seconds) {
+	if(seconds < 0.0) {
+		throw invalid_argument("Detection interval cannot be less than zero.");
+	}
+	//Any longer, and frames would outlive the last detection and stall assignment until a new one arrives.
+	if(seconds > resultGoodForSeconds) {
+		seconds = resultGoodForSeconds;
+	}
+	YerFace_MutexLock(myMutex);
+	detectionIntervalSeconds = seconds;
+	YerFace_MutexUnlock(myMutex);
+}
+
+double FaceDetector::getDetectionIntervalSeconds(void) {
+	YerFace_MutexLock(myMutex);
+	double val = detectionIntervalSeconds;
+	YerFace_MutexUnlock(myMutex);
+	return val;
+}
+
 void FaceDetector::doDetectFace(WorkerPoolWorker *workerPoolWorker, FaceDetectionTask task) {
 	FaceDetectorWorker *worker = (FaceDetectorWorker *)workerPoolWorker->ptr;
 	dlib::cv_image<dlib::bgr_pixel> dlibDetectionFrame = cv_image<bgr_pixel>(task.detectionFrame);
@@ -231,37 +258,24 @@ void FaceDetector::handleFrameStatusChange(void *userdata, WorkingFrameStatus ne
 	FrameNumber frameNumber = frameTimestamps.frameNumber;
 	FaceDetector *self = (FaceDetector *)userdata;
 	self->logger->debug4("Handling Frame Status Change for Frame Number " YERFACE_FRAMENUMBER_FORMAT " to Status %d", frameNumber, newStatus);
-	FacialDetectionBox detection;
-	FaceDetectorAssignmentTask assignment;
+	bool assignmentReady;
 	switch(newStatus) {
 		default:
 			throw logic_error("Handler passed unsupported frame status change event!");
 		case FRAME_STATUS_NEW:
-			detection.run = false;
-			detection.set = false;
-			YerFace_MutexLock(self->detectionsMutex);
-			self->detections[frameNumber] = detection;
-			YerFace_MutexUnlock(self->detectionsMutex);
-			assignment.frameNumber = frameNumber;
-			assignment.readyForAssignment = false;
 			YerFace_MutexLock(self->myAssignmentMutex);
-			self->assignmentFrameNumbers[frameNumber] = assignment;
+			self->assignmentFrameQueue->insertFrame(frameTimestamps);
 			YerFace_MutexUnlock(self->myAssignmentMutex);
 			break;
 		case FRAME_STATUS_DETECTION:
 			YerFace_MutexLock(self->myAssignmentMutex);
-			self->assignmentFrameNumbers[frameNumber].readyForAssignment = true;
-			self->logger->debug4("handleFrameStatusChange() Frame #" YERFACE_FRAMENUMBER_FORMAT " waiting on me. Queue depth is now %lu", frameNumber, self->assignmentFrameNumbers.size());
+			assignmentReady = self->assignmentFrameQueue->setFrameReady(frameNumber);
+			self->logger->debug4("handleFrameStatusChange() Frame #" YERFACE_FRAMENUMBER_FORMAT " waiting on me. Queue depth is now %lu", frameNumber, self->assignmentFrameQueue->size());
 			YerFace_MutexUnlock(self->myAssignmentMutex);
-			if(self->assignmentWorkerPool != NULL) {
-				self->assignmentWorkerPool->sendWorkerSignal();
+			if(assignmentReady && self->assignmentWorkerPool != NULL) {
+				self->assignmentWorkerPool->sendWorkerSignal(WorkScheduler::getFrameAffinity(self->frameServer->getWorkingFrame(frameNumber)));
 			}
 			break;
-		case FRAME_STATUS_GONE:
-			YerFace_MutexLock(self->detectionsMutex);
-			self->detections.erase(frameNumber);
-			YerFace_MutexUnlock(self->detectionsMutex);
-			break;
 	}
 }
 
@@ -277,10 +291,9 @@ void FaceDetector::detectionWorkerInitializer(WorkerPoolWorker *worker, void *pt
 	worker->ptr = (void *)innerWorker;
 }
 
-bool FaceDetector::detectionWorkerHandler(WorkerPoolWorker *worker) {
+void FaceDetector::detectionTaskHandler(WorkerPoolWorker *worker, WorkerPoolTask poolTask) {
 	FaceDetectorWorker *innerWorker = (FaceDetectorWorker *)worker->ptr;
 	FaceDetector *self = innerWorker->self;
-	bool didWork = false;
 
 	//// CHECK FOR WORK ////
 	bool taskSet = false;
@@ -295,18 +308,18 @@ bool FaceDetector::detectionWorkerHandler(WorkerPoolWorker *worker) {
 	YerFace_MutexUnlock(self->myMutex);
 
 	//// DO THE WORK ////
-	if(taskSet) {
-		self->logger->debug4("Thread #%d handling frame #" YERFACE_FRAMENUMBER_FORMAT, worker->num, task.myFrameNumber);
-		MetricsTick tick = self->metrics->startClock();
+	if(!taskSet) {
+		self->logger->debug4("Thread #%d found the detection request for frame #" YERFACE_FRAMENUMBER_FORMAT " was already superseded.", worker->num, poolTask.frameNumber);
+		return;
+	}
+	self->logger->debug4("Thread #%d handling frame #" YERFACE_FRAMENUMBER_FORMAT, worker->num, task.myFrameNumber);
+	MetricsTick tick = self->metrics->startClock();
 
-		// self->logger->verbose("Thread #%d, Frame #" YERFACE_FRAMENUMBER_FORMAT " - RUNNING Detection", worker->num, task.myFrameNumber);
-		self->doDetectFace(worker, task);
-		// self->logger->verbose("Thread #%d, Frame #" YERFACE_FRAMENUMBER_FORMAT " - FINISHED Detection", worker->num, task.myFrameNumber);
+	// self->logger->verbose("Thread #%d, Frame #" YERFACE_FRAMENUMBER_FORMAT " - RUNNING Detection", worker->num, task.myFrameNumber);
+	self->doDetectFace(worker, task);
+	// self->logger->verbose("Thread #%d, Frame #" YERFACE_FRAMENUMBER_FORMAT " - FINISHED Detection", worker->num, task.myFrameNumber);
 
-		self->metrics->endClock(tick);
-		didWork = true;
-	}
-	return didWork;
+	self->metrics->endClock(tick);
 }
 
 bool FaceDetector::assignmentWorkerHandler(WorkerPoolWorker *worker) {
@@ -322,18 +335,10 @@ bool FaceDetector::assignmentWorkerHandler(WorkerPoolWorker *worker) {
 	YerFace_MutexLock(self->myAssignmentMutex);
 	//// CHECK FOR WORK ////
 	if(myFrameNumber < 0) {
-		for(auto pendingAssignmentPair : self->assignmentFrameNumbers) {
-			if(myFrameNumber < 0 || pendingAssignmentPair.first < myFrameNumber) {
-				myFrameNumber = pendingAssignmentPair.first;
-			}
-		}
-		if(myFrameNumber > 0 && !self->assignmentFrameNumbers[myFrameNumber].readyForAssignment) {
-			self->logger->debug4("BLOCKED on frame " YERFACE_FRAMENUMBER_FORMAT " because it is not ready!", myFrameNumber);
-			myFrameNumber = -1;
-		}
-		if(myFrameNumber > 0) {
+		FrameTimestamps nextFrameTimestamps;
+		if(self->assignmentFrameQueue->popNextReadyFrame(&nextFrameTimestamps)) {
+			myFrameNumber = nextFrameTimestamps.frameNumber;
 			tick = self->assignmentMetrics->startClock();
-			self->assignmentFrameNumbers.erase(myFrameNumber);
 		}
 	}
 	YerFace_MutexUnlock(self->myAssignmentMutex);
@@ -346,6 +351,7 @@ bool FaceDetector::assignmentWorkerHandler(WorkerPoolWorker *worker) {
 		}
 
 		WorkingFrame *workingFrame = self->frameServer->getWorkingFrame(myFrameNumber);
+		WorkScheduler::touchFrame(workingFrame);
 		FrameTimestamps myFrameTimestamps = workingFrame->frameTimestamps;
 
 		bool frameAssigned = false;
@@ -353,14 +359,19 @@ bool FaceDetector::assignmentWorkerHandler(WorkerPoolWorker *worker) {
 		if(self->latestDetection.run) {
 			double latestDetectionUsableUntil = self->latestDetection.timestamps.startTimestamp + self->resultGoodForSeconds;
 			if(myFrameTimestamps.startTimestamp <= latestDetectionUsableUntil) {
-				self->detections[myFrameNumber] = self->latestDetection;
+				workingFrame->publishResult(FRAME_RESULT_FACEDETECTION, self->latestDetection);
 				frameAssigned = true;
 				// self->logger->verbose("==== SUCCESSFUL ASSIGNMENT ON FRAME #" YERFACE_FRAMENUMBER_FORMAT " (LD Frame #" YERFACE_FRAMENUMBER_FORMAT ")", myFrameNumber, self->latestDetection.timestamps.frameNumber);
 			}
 		}
 		YerFace_MutexUnlock(self->detectionsMutex);
 
-		if(myFrameNumber != lastDetectionRequested) {
+		//Frames which are already covered by a detection only request a new one at the configured cadence.
+		YerFace_MutexLock(self->myMutex);
+		bool detectionDue = !frameAssigned || self->lastDetectionRequestTimestamp < 0.0 || myFrameTimestamps.startTimestamp >= self->lastDetectionRequestTimestamp + self->detectionIntervalSeconds;
+		YerFace_MutexUnlock(self->myMutex);
+
+		if(myFrameNumber != lastDetectionRequested && detectionDue) {
 			// self->logger->verbose("==== REQUESTING A DETECTION ON FRAME #" YERFACE_FRAMENUMBER_FORMAT, myFrameNumber);
 			lastDetectionRequested = myFrameNumber;
 			FaceDetectionTask task;
@@ -370,15 +381,23 @@ bool FaceDetector::assignmentWorkerHandler(WorkerPoolWorker *worker) {
 			task.detectionFrame = workingFrame->detectionFrame.clone();
 			YerFace_MutexLock(self->myMutex);
 			self->detectionTasks.push_back(task);
+			self->lastDetectionRequestTimestamp = myFrameTimestamps.startTimestamp;
 			YerFace_MutexUnlock(self->myMutex);
 			if(self->detectionWorkerPool != NULL) {
-				self->detectionWorkerPool->sendWorkerSignal();
+				//The task only carries the deadline. Whichever worker picks it up takes the newest request from detectionTasks.
+				WorkerPoolTask poolTask;
+				poolTask.frameNumber = myFrameNumber;
+				poolTask.deadline = self->frameServer->getFrameDeadline(myFrameTimestamps);
+				poolTask.shedIfLate = false; //Late detections are counted, but never shed, because assignment will wait for them.
+				poolTask.missedDeadline = false;
+				poolTask.payload = NULL;
+				self->detectionWorkerPool->pushTask(poolTask);
 			}
 		}
 
 		if(frameAssigned) {
 			lastFrameNumber = myFrameNumber;
-			self->frameServer->setWorkingFrameStatusCheckpoint(myFrameNumber, FRAME_STATUS_DETECTION, "faceDetector.ran");
+			self->frameServer->setWorkingFrameStatusCheckpoint(myFrameNumber, FRAME_STATUS_DETECTION, FRAME_CHECKPOINT_FACEDETECTOR);
 			self->assignmentMetrics->endClock(tick);
 			myFrameNumber = -1;
 			didWork = true;
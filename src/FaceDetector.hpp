@@ -5,6 +5,7 @@
 #include "FrameServer.hpp"
 #include "Metrics.hpp"
 #include "WorkerPool.hpp"
+#include "SequencedFrameQueue.hpp"
 
 #include <list>
 
@@ -31,23 +32,19 @@ public:
 	bool set; //Is the box valid?
 };
 
-class FaceDetectorAssignmentTask {
-public:
-	FrameNumber frameNumber;
-	bool readyForAssignment;
-};
-
 class FaceDetector {
 public:
 	FaceDetector(json config, Status *myStatus, FrameServer *myFrameServer);
 	~FaceDetector() noexcept(false);
-	FacialDetectionBox getFacialDetection(FrameNumber frameNumber);
+	const FacialDetectionBox &getFacialDetection(FrameNumber frameNumber); //Valid until the frame is gone.
 	void renderPreviewHUD(cv::Mat previewFrame, FrameNumber frameNumber, int density, bool mirrorMode);
+	void setDetectionIntervalSeconds(double seconds); //Minimum time between detection requests. (Capped at resultGoodForSeconds.)
+	double getDetectionIntervalSeconds(void);
 private:
 	void doDetectFace(WorkerPoolWorker *worker, FaceDetectionTask task);
 	static void handleFrameStatusChange(void *userdata, WorkingFrameStatus newStatus, FrameTimestamps frameTimestamps);
 	static void detectionWorkerInitializer(WorkerPoolWorker *worker, void *ptr);
-	static bool detectionWorkerHandler(WorkerPoolWorker *worker);
+	static void detectionTaskHandler(WorkerPoolWorker *worker, WorkerPoolTask task);
 	static bool assignmentWorkerHandler(WorkerPoolWorker *worker);
 
 	string faceDetectionModelFileName;
@@ -66,14 +63,16 @@ private:
 	
 	SDL_mutex *myMutex;
 	list<FaceDetectionTask> detectionTasks;
+	double detectionIntervalSeconds;
+	double lastDetectionRequestTimestamp;
 
 	SDL_mutex *detectionsMutex;
-	unordered_map<FrameNumber, FacialDetectionBox> detections;
 	FacialDetectionBox latestDetection;
+	FacialDetectionBox unassignedDetection; //Read by frames which have not been assigned a detection yet.
 	bool latestDetectionLostWarning;
 
 	SDL_mutex *myAssignmentMutex;
-	unordered_map<FrameNumber, FaceDetectorAssignmentTask> assignmentFrameNumbers;
+	SequencedFrameQueue *assignmentFrameQueue;
 
 	WorkerPool *detectionWorkerPool, *assignmentWorkerPool;
 };
@@ -75,7 +75,7 @@ FaceMapper::FaceMapper(json config, Status *myStatus, FrameServer *myFrameServer
 		markerLipsRightBottom
 	};
 
-	pendingFrames.clear();
+	pendingFrameQueue = new SequencedFrameQueue("FaceMapper");
 
 	if((myMutex = SDL_CreateMutex()) == NULL) {
 		throw runtime_error("Failed creating mutex!");
@@ -91,16 +91,15 @@ FaceMapper::FaceMapper(json config, Status *myStatus, FrameServer *myFrameServer
 	frameServer->onFrameStatusChangeEvent(frameStatusChangeCallback);
 	frameStatusChangeCallback.newStatus = FRAME_STATUS_MAPPING;
 	frameServer->onFrameStatusChangeEvent(frameStatusChangeCallback);
-	frameStatusChangeCallback.newStatus = FRAME_STATUS_GONE;
-	frameServer->onFrameStatusChangeEvent(frameStatusChangeCallback);
 
 	//We also want to introduce a checkpoint so that frames cannot TRANSITION AWAY from FRAME_STATUS_MAPPING without our blessing.
-	frameServer->registerFrameStatusCheckpoint(FRAME_STATUS_MAPPING, "faceMapper.ran");
+	frameServer->registerFrameStatusCheckpoint(FRAME_STATUS_MAPPING, FRAME_CHECKPOINT_FACEMAPPER);
 
 	WorkerPoolParameters workerPoolParameters;
 	workerPoolParameters.name = "FaceMapper";
 	workerPoolParameters.numWorkers = 1; //FaceMapper (and MarkerTracker) cannot handle out-of-order frame processing.
 	workerPoolParameters.numWorkersPerCPU = 0.0;
+	workerPoolParameters.dedicatedThreads = false;
 	workerPoolParameters.initializer = NULL;
 	workerPoolParameters.deinitializer = NULL;
 	workerPoolParameters.usrPtr = (void *)this;
@@ -116,7 +115,7 @@ FaceMapper::~FaceMapper() noexcept(false) {
 	delete workerPool;
 
 	YerFace_MutexLock(myMutex);
-	if(pendingFrames.size() > 0) {
+	if(pendingFrameQueue->size() > 0) {
 		logger->err("Frames are still pending! Woe is me!");
 	}
 	YerFace_MutexUnlock(myMutex);
@@ -127,6 +126,7 @@ FaceMapper::~FaceMapper() noexcept(false) {
 		}
 	}
 	SDL_DestroyMutex(myMutex);
+	delete pendingFrameQueue;
 	delete metrics;
 	delete logger;
 }
@@ -159,7 +159,7 @@ void FaceMapper::renderPreviewHUD(Mat frame, FrameNumber frameNumber, int densit
 			mirrorFlip = -1.0;
 		}
 		for(MarkerTracker *markerTracker : trackers) {
-			MarkerPoint markerPoint = markerTracker->getMarkerPoint(frameNumber);
+			const MarkerPoint &markerPoint = markerTracker->getMarkerPoint(frameNumber);
 			if(markerPoint.set) {
 				Point2d previewPoint = Point2d(
 						(markerPoint.point3d.x * previewPointScale * mirrorFlip) + previewCenter.x,
@@ -211,39 +211,25 @@ FaceTracker *FaceMapper::getFaceTracker(void) {
 void FaceMapper::handleFrameStatusChange(void *userdata, WorkingFrameStatus newStatus, FrameTimestamps frameTimestamps) {
 	FrameNumber frameNumber = frameTimestamps.frameNumber;
 	FaceMapper *self = (FaceMapper *)userdata;
-	FaceMapperPendingFrame newFrame;
+	bool mappingReady;
 	self->logger->debug4("Handling Frame Status Change for Frame Number " YERFACE_FRAMENUMBER_FORMAT " to Status %d", frameNumber, newStatus);
 	switch(newStatus) {
 		default:
 			throw logic_error("Handler passed unsupported frame status change event!");
 		case FRAME_STATUS_NEW:
-			newFrame.frameNumber = frameNumber;
-			newFrame.hasEnteredMapping = false;
-			newFrame.hasCompletedMapping = false;
 			YerFace_MutexLock(self->myMutex);
-			self->pendingFrames[frameNumber] = newFrame;
+			self->pendingFrameQueue->insertFrame(frameTimestamps);
 			YerFace_MutexUnlock(self->myMutex);
-			for(MarkerTracker *markerTracker : self->trackers) {
-				markerTracker->frameStatusNew(frameNumber);
-			}
 			break;
 		case FRAME_STATUS_MAPPING:
 			self->logger->debug4("handleFrameStatusChange() Frame #" YERFACE_FRAMENUMBER_FORMAT " entered MAPPING.", frameNumber);
 			YerFace_MutexLock(self->myMutex);
-			self->pendingFrames[frameNumber].hasEnteredMapping = true;
+			mappingReady = self->pendingFrameQueue->setFrameReady(frameNumber);
 			YerFace_MutexUnlock(self->myMutex);
-			if(self->workerPool != NULL) {
+			if(mappingReady && self->workerPool != NULL) {
 				self->workerPool->sendWorkerSignal();
 			}
 			break;
-		case FRAME_STATUS_GONE:
-			YerFace_MutexLock(self->myMutex);
-			self->pendingFrames.erase(frameNumber);
-			YerFace_MutexUnlock(self->myMutex);
-			for(MarkerTracker *markerTracker : self->trackers) {
-				markerTracker->frameStatusGone(frameNumber);
-			}
-			break;
 	}
 }
 
@@ -255,15 +241,9 @@ bool FaceMapper::workerHandler(WorkerPoolWorker *worker) {
 	YerFace_MutexLock(self->myMutex);
 	//// CHECK FOR WORK ////
 	FrameNumber myFrameNumber = -1;
-	FrameNumber lowestPendingFrameNumber = -1;
-	for(auto pendingFramePair : self->pendingFrames) {
-		FaceMapperPendingFrame *pendingFrame = &pendingFramePair.second;
-		if((lowestPendingFrameNumber < 0 || pendingFrame->frameNumber < lowestPendingFrameNumber) && !pendingFrame->hasCompletedMapping) {
-			lowestPendingFrameNumber = pendingFrame->frameNumber;
-		}
-	}
-	if(lowestPendingFrameNumber > 0 && self->pendingFrames[lowestPendingFrameNumber].hasEnteredMapping) {
-		myFrameNumber = lowestPendingFrameNumber;
+	FrameTimestamps nextFrameTimestamps;
+	if(self->pendingFrameQueue->popNextReadyFrame(&nextFrameTimestamps)) {
+		myFrameNumber = nextFrameTimestamps.frameNumber;
 	}
 	YerFace_MutexUnlock(self->myMutex);
 
@@ -281,10 +261,7 @@ bool FaceMapper::workerHandler(WorkerPoolWorker *worker) {
 		}
 		self->metrics->endClock(tick);
 
-		self->frameServer->setWorkingFrameStatusCheckpoint(myFrameNumber, FRAME_STATUS_MAPPING, "faceMapper.ran");
-		YerFace_MutexLock(self->myMutex);
-		self->pendingFrames[myFrameNumber].hasCompletedMapping = true;
-		YerFace_MutexUnlock(self->myMutex);
+		self->frameServer->setWorkingFrameStatusCheckpoint(myFrameNumber, FRAME_STATUS_MAPPING, FRAME_CHECKPOINT_FACEMAPPER);
 		didWork = true;
 	}
 	return didWork;
@@ -8,6 +8,7 @@
 #include "Metrics.hpp"
 #include "Status.hpp"
 #include "PreviewHUD.hpp"
+#include "SequencedFrameQueue.hpp"
 
 using namespace std;
 
@@ -15,13 +16,6 @@ namespace YerFace {
 
 class MarkerTracker;
 
-class FaceMapperPendingFrame {
-public:
-	FrameNumber frameNumber;
-	bool hasEnteredMapping;
-	bool hasCompletedMapping;
-};
-
 class FaceMapper {
 public:
 	FaceMapper(json config, Status *myStatus, FrameServer *myFrameServer, FaceTracker *myFaceTracker, PreviewHUD *myPreviewHUD);
@@ -67,7 +61,7 @@ private:
 	std::vector<MarkerTracker *> trackers;
 
 	SDL_mutex *myMutex;
-	std::unordered_map<FrameNumber, FaceMapperPendingFrame> pendingFrames;
+	SequencedFrameQueue *pendingFrameQueue;
 	WorkerPool *workerPool;
 };
 
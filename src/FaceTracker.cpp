@@ -1,5 +1,6 @@
 
 #include "FaceTracker.hpp"
+#include "WorkScheduler.hpp"
 #include "Utilities.hpp"
 
 #include "dlib/opencv.h"
@@ -44,6 +45,7 @@ FaceTracker::FaceTracker(json config, Status *myStatus, SDLDriver *mySDLDriver,
 	featureDetectionModelFileName = Utilities::fileValidPathOrDie(config["YerFace"]["FaceTracker"]["dlibFaceLandmarks"]);
 	useFullSizedFrameForLandmarkDetection = config["YerFace"]["FaceTracker"]["useFullSizedFrameForLandmarkDetection"];
 	previouslyReportedFacialPose.set = false;
+	penultimateReportedFacialPose.set = false;
 	facialCameraModel.set = false;
 
 	status = myStatus;
@@ -124,9 +126,17 @@ FaceTracker::FaceTracker(json config, Status *myStatus, SDLDriver *mySDLDriver,
 	depthSliceG = config["YerFace"]["FaceTracker"]["depthSlices"]["G"];
 	depthSliceH = config["YerFace"]["FaceTracker"]["depthSlices"]["H"];
 
+	unassignedOutput.frameNumber = -1;
+	unassignedOutput.set = false;
+	unassignedOutput.facialFeatures.set = false;
+	unassignedOutput.facialFeatures.featuresExposed.set = false;
+	unassignedOutput.facialPose.set = false;
+	unassignedOutput.synthesized = false;
+
 	logger = new Logger("FaceTracker");
 	metricsPredictor = new Metrics(config, "FaceTracker.Predictor");
 	metricsAssignment = new Metrics(config, "FaceTracker.Assignment");
+	assignmentFrameQueue = new SequencedFrameQueue("FaceTracker.Assignment");
 
 	if((myMutex = SDL_CreateMutex()) == NULL) {
 		throw runtime_error("Failed creating mutex!");
@@ -143,29 +153,33 @@ FaceTracker::FaceTracker(json config, Status *myStatus, SDLDriver *mySDLDriver,
 	frameServer->onFrameStatusChangeEvent(frameStatusChangeCallback);
 	frameStatusChangeCallback.newStatus = FRAME_STATUS_TRACKING;
 	frameServer->onFrameStatusChangeEvent(frameStatusChangeCallback);
-	frameStatusChangeCallback.newStatus = FRAME_STATUS_GONE;
-	frameServer->onFrameStatusChangeEvent(frameStatusChangeCallback);
 
 	//We also want to introduce a checkpoint so that frames cannot TRANSITION AWAY from FRAME_STATUS_TRACKING without our blessing.
-	frameServer->registerFrameStatusCheckpoint(FRAME_STATUS_TRACKING, "faceTracker.ran");
+	frameServer->registerFrameStatusCheckpoint(FRAME_STATUS_TRACKING, FRAME_CHECKPOINT_FACETRACKER);
 
 	WorkerPoolParameters workerPoolParameters;
 	workerPoolParameters.name = "FaceTracker.Predictor";
 	workerPoolParameters.numWorkers = config["YerFace"]["FaceTracker"]["numWorkers"];
 	workerPoolParameters.numWorkersPerCPU = config["YerFace"]["FaceTracker"]["numWorkersPerCPU"];
+	workerPoolParameters.dedicatedThreads = false;
 	workerPoolParameters.initializer = predictorWorkerInitializer;
 	workerPoolParameters.deinitializer = NULL;
 	workerPoolParameters.usrPtr = (void *)this;
-	workerPoolParameters.handler = predictorWorkerHandler;
+	workerPoolParameters.handler = NULL;
+	workerPoolParameters.taskHandler = predictorTaskHandler;
+	workerPoolParameters.backlog = NULL;
 	predictorWorkerPool = new WorkerPool(config, status, frameServer, workerPoolParameters);
 
 	workerPoolParameters.name = "FaceTracker.Assignment";
 	workerPoolParameters.numWorkers = 1;
 	workerPoolParameters.numWorkersPerCPU = 0.0;
+	workerPoolParameters.dedicatedThreads = false;
 	workerPoolParameters.initializer = NULL;
 	workerPoolParameters.deinitializer = NULL;
 	workerPoolParameters.usrPtr = (void *)this;
 	workerPoolParameters.handler = assignmentWorkerHandler;
+	workerPoolParameters.taskHandler = NULL;
+	workerPoolParameters.backlog = NULL;
 	assignmentWorkerPool = new WorkerPool(config, status, frameServer, workerPoolParameters);
 
 	logger->debug1("FaceTracker object constructed and ready to go!");
@@ -176,30 +190,22 @@ FaceTracker::~FaceTracker() noexcept(false) {
 
 	delete predictorWorkerPool;
 
-	YerFace_MutexLock(myMutex);
-	if(pendingPredictionFrameNumbers.size() > 0) {
-		logger->err("Frames are still pending! Woe is me!");
-	}
-	if(outputFrames.size() > 0) {
-		logger->err("Outputs are still pending! Woe is me!");
-	}
-	YerFace_MutexUnlock(myMutex);
-
 	YerFace_MutexLock(myAssignmentMutex);
-	if(pendingAssignmentFrameNumbers.size() > 0) {
+	if(assignmentFrameQueue->size() > 0) {
 		logger->err("Assignment Frames are still pending! Woe is me!");
 	}
 	YerFace_MutexUnlock(myAssignmentMutex);
 
 	SDL_DestroyMutex(myMutex);
 	SDL_DestroyMutex(myAssignmentMutex);
+	delete assignmentFrameQueue;
 	delete metricsPredictor;
 	delete logger;
 }
 
 void FaceTracker::doIdentifyFeatures(WorkerPoolWorker *worker, WorkingFrame *workingFrame, FaceTrackerOutput *output) {
 	FaceTrackerWorker *innerWorker = (FaceTrackerWorker *)worker->ptr;
-	FacialDetectionBox facialDetection = faceDetector->getFacialDetection(output->frameNumber);
+	const FacialDetectionBox &facialDetection = faceDetector->getFacialDetection(output->frameNumber);
 	if(!facialDetection.set) {
 		return;
 	}
@@ -207,14 +213,15 @@ void FaceTracker::doIdentifyFeatures(WorkerPoolWorker *worker, WorkingFrame *wor
 	Mat searchFrame;
 	double searchFrameScaleFactor;
 	Rect2d searchRect;
-	if(useFullSizedFrameForLandmarkDetection) {
+	if(getUseFullSizedFrameForLandmarkDetection()) {
 		searchFrame = workingFrame->frame;
 		searchFrameScaleFactor = 1.0;
 		searchRect = facialDetection.boxNormalSize;
 	} else {
 		searchFrame = workingFrame->detectionFrame;
 		searchFrameScaleFactor = workingFrame->detectionScaleFactor;
-		searchRect = facialDetection.box;
+		//NOTE: The detection may have come from a frame with a different detection scale, so work from the normal sized box.
+		searchRect = Utilities::scaleRect(facialDetection.boxNormalSize, searchFrameScaleFactor);
 	}
 
 	dlib::cv_image<dlib::bgr_pixel> dlibSearchFrame = cv_image<bgr_pixel>(searchFrame);
@@ -311,6 +318,7 @@ void FaceTracker::doInitializeCameraModel(WorkingFrame *workingFrame) {
 void FaceTracker::doCalculateFacialTransformation(WorkerPoolWorker *worker, WorkingFrame *workingFrame, FaceTrackerOutput *output) {
 	if(!output->facialFeatures.set) {
 		previouslyReportedFacialPose.set = false;
+		penultimateReportedFacialPose.set = false;
 		return;
 	}
 
@@ -362,6 +370,7 @@ void FaceTracker::doCalculateFacialTransformation(WorkerPoolWorker *worker, Work
 			if(tempPose.timestamp - previouslyReportedFacialPose.timestamp >= poseRejectionResetAfterSeconds) {
 				logger->notice("Facial pose has come back bad consistantly for %.02lf seconds! Unsetting the face pose completely.", tempPose.timestamp - previouslyReportedFacialPose.timestamp);
 				previouslyReportedFacialPose.set = false;
+				penultimateReportedFacialPose.set = false;
 			}
 			output->facialPose = previouslyReportedFacialPose;
 		} else {
@@ -433,9 +442,46 @@ void FaceTracker::doCalculateFacialTransformation(WorkerPoolWorker *worker, Work
 	}
 
 	output->facialPose = tempPose;
+	penultimateReportedFacialPose = previouslyReportedFacialPose;
 	previouslyReportedFacialPose = output->facialPose;
 }
 
+void FaceTracker::doExtrapolateFacialTransformation(WorkerPoolWorker *worker, WorkingFrame *workingFrame, FaceTrackerOutput *output) {
+	// NOTE: We only ever have frames from the past to work with, so this is extrapolation rather than interpolation.
+	double frameTimestamp = workingFrame->frameTimestamps.startTimestamp;
+	output->facialPose.set = false;
+	if(!previouslyReportedFacialPose.set) {
+		return;
+	}
+	double elapsed = frameTimestamp - previouslyReportedFacialPose.timestamp;
+	if(elapsed >= poseRejectionResetAfterSeconds) {
+		//Too long since our last real measurement to trust any guess.
+		return;
+	}
+	output->facialPose = previouslyReportedFacialPose;
+	output->facialPose.timestamp = frameTimestamp;
+	double step = previouslyReportedFacialPose.timestamp - penultimateReportedFacialPose.timestamp;
+	if(!penultimateReportedFacialPose.set || step <= 0.0 || elapsed <= 0.0) {
+		//No velocity to work with, so just hold the last pose.
+		return;
+	}
+	double progress = elapsed / step;
+
+	output->facialPose.translationVector = previouslyReportedFacialPose.translationVector + (previouslyReportedFacialPose.translationVector - penultimateReportedFacialPose.translationVector) * progress;
+	output->facialPose.translationVectorInternal = previouslyReportedFacialPose.translationVectorInternal + (previouslyReportedFacialPose.translationVectorInternal - penultimateReportedFacialPose.translationVectorInternal) * progress;
+
+	//Scale the most recent rotation step (as an axis-angle vector) and apply it again.
+	Mat stepVector, stepMatrix;
+	Rodrigues(previouslyReportedFacialPose.rotationMatrix * penultimateReportedFacialPose.rotationMatrix.t(), stepVector);
+	Rodrigues(stepVector * progress, stepMatrix);
+	output->facialPose.rotationMatrix = stepMatrix * previouslyReportedFacialPose.rotationMatrix;
+	Rodrigues(previouslyReportedFacialPose.rotationMatrixInternal * penultimateReportedFacialPose.rotationMatrixInternal.t(), stepVector);
+	Rodrigues(stepVector * progress, stepMatrix);
+	output->facialPose.rotationMatrixInternal = stepMatrix * previouslyReportedFacialPose.rotationMatrixInternal;
+
+	logger->debug3("Extrapolated facial pose for frame #" YERFACE_FRAMENUMBER_FORMAT " (%.02lf steps past the last measured pose).", output->frameNumber, progress);
+}
+
 void FaceTracker::doPrecalculateFacialPlaneNormal(WorkerPoolWorker *worker, WorkingFrame *workingFrame, FaceTrackerOutput *output) {
 	if(!output->facialPose.set) {
 		return;
@@ -457,13 +503,7 @@ bool FaceTracker::doConvertLandmarkPointToImagePoint(DlibPointPointer pointPoint
 }
 
 void FaceTracker::renderPreviewHUD(Mat frame, FrameNumber frameNumber, int density, bool mirrorMode) {
-	YerFace_MutexLock(myMutex);
-	if(frameNumber < 0 || outputFrames.find(frameNumber) == outputFrames.end()) {
-		YerFace_MutexUnlock(myMutex);
-		throw invalid_argument("FaceTracker::renderPreviewHUD() passed invalid frame number");
-	}
-	FaceTrackerOutput output = outputFrames[frameNumber];
-	YerFace_MutexUnlock(myMutex);
+	const FaceTrackerOutput &output = getOutput(frameNumber);
 
 	YerFace_MutexLock(myAssignmentMutex);
 	FacialCameraModel camera = facialCameraModel;
@@ -539,16 +579,19 @@ void FaceTracker::renderPreviewHUD(Mat frame, FrameNumber frameNumber, int densi
 	}
 }
 
-FacialFeatures FaceTracker::getFacialFeatures(FrameNumber frameNumber) {
-	FacialFeatures val;
-	YerFace_MutexLock(myMutex);
-	if(frameNumber < 0 || outputFrames.find(frameNumber) == outputFrames.end()) {
-		YerFace_MutexUnlock(myMutex);
-		throw invalid_argument("FaceTracker::getFacialFeatures() passed invalid frame number");
+const FaceTrackerOutput &FaceTracker::getOutput(FrameNumber frameNumber) {
+	if(frameNumber < 0) {
+		throw invalid_argument("FaceTracker::getOutput() passed invalid frame number");
 	}
-	val = outputFrames[frameNumber].facialFeatures.featuresExposed;
-	YerFace_MutexUnlock(myMutex);
-	return val;
+	const FaceTrackerOutput *output = frameServer->getWorkingFrame(frameNumber)->getResult<FaceTrackerOutput>(FRAME_RESULT_FACETRACKER);
+	if(output == NULL) {
+		return unassignedOutput;
+	}
+	return *output;
+}
+
+const FacialFeatures &FaceTracker::getFacialFeatures(FrameNumber frameNumber) {
+	return getOutput(frameNumber).facialFeatures.featuresExposed;
 }
 
 FacialCameraModel FaceTracker::getFacialCameraModel(void) {
@@ -559,27 +602,29 @@ FacialCameraModel FaceTracker::getFacialCameraModel(void) {
 	return val;
 }
 
-FacialPose FaceTracker::getFacialPose(FrameNumber frameNumber) {
-	FacialPose val;
+const FacialPose &FaceTracker::getFacialPose(FrameNumber frameNumber) {
+	return getOutput(frameNumber).facialPose;
+}
+
+void FaceTracker::setUseFullSizedFrameForLandmarkDetection(bool useFullSizedFrame) {
 	YerFace_MutexLock(myMutex);
-	if(frameNumber < 0 || outputFrames.find(frameNumber) == outputFrames.end()) {
-		YerFace_MutexUnlock(myMutex);
-		throw invalid_argument("FaceTracker::getFacialPose() passed invalid frame number");
-	}
-	val = outputFrames[frameNumber].facialPose;
+	useFullSizedFrameForLandmarkDetection = useFullSizedFrame;
 	YerFace_MutexUnlock(myMutex);
-	return val;
 }
 
-FacialPlane FaceTracker::getCalculatedFacialPlaneForWorkingFacialPose(FrameNumber frameNumber, MarkerType markerType) {
-	FacialPose facialPose;
+bool FaceTracker::getUseFullSizedFrameForLandmarkDetection(void) {
 	YerFace_MutexLock(myMutex);
-	if(frameNumber < 0 || outputFrames.find(frameNumber) == outputFrames.end()) {
-		YerFace_MutexUnlock(myMutex);
-		throw invalid_argument("FaceTracker::getCalculatedFacialPlaneForWorkingFacialPose() passed invalid frame number");
-	}
-	facialPose = outputFrames[frameNumber].facialPose;
+	bool val = useFullSizedFrameForLandmarkDetection;
 	YerFace_MutexUnlock(myMutex);
+	return val;
+}
+
+bool FaceTracker::getIsSynthesized(FrameNumber frameNumber) {
+	return getOutput(frameNumber).synthesized;
+}
+
+FacialPlane FaceTracker::getCalculatedFacialPlaneForWorkingFacialPose(FrameNumber frameNumber, MarkerType markerType) {
+	const FacialPose &facialPose = getFacialPose(frameNumber);
 
 	if(!facialPose.set) {
 		throw runtime_error("Can't do FaceTracker::getCalculatedFacialPlaneForWorkingFacialPose() when no working FacialPose is set.");
@@ -639,38 +684,41 @@ void FaceTracker::handleFrameStatusChange(void *userdata, WorkingFrameStatus new
 	FrameNumber frameNumber = frameTimestamps.frameNumber;
 	FaceTracker *self = (FaceTracker *)userdata;
 	FaceTrackerOutput output;
-	FaceTrackerAssignmentTask assignment;
+	double deadline;
 	switch(newStatus) {
 		default:
 			throw logic_error("Handler passed unsupported frame status change event!");
 		case FRAME_STATUS_NEW:
-			output.set = false;
-			output.facialFeatures.set = false;
-			output.facialFeatures.featuresExposed.set = false;
-			output.facialPose.set = false;
-			YerFace_MutexLock(self->myMutex);
-			self->outputFrames[frameNumber] = output;
-			YerFace_MutexUnlock(self->myMutex);
-			assignment.frameNumber = frameNumber;
-			assignment.readyForAssignment = false;
 			YerFace_MutexLock(self->myAssignmentMutex);
-			self->pendingAssignmentFrameNumbers[frameNumber] = assignment;
+			self->assignmentFrameQueue->insertFrame(frameTimestamps);
 			YerFace_MutexUnlock(self->myAssignmentMutex);
 			break;
 		case FRAME_STATUS_TRACKING:
-			self->logger->debug4("handleFrameStatusChange() Frame #" YERFACE_FRAMENUMBER_FORMAT " waiting on me. Queue depth is now %lu", frameNumber, self->pendingPredictionFrameNumbers.size());
-			YerFace_MutexLock(self->myMutex);
-			self->pendingPredictionFrameNumbers.push_back(frameNumber);
-			YerFace_MutexUnlock(self->myMutex);
+			//In low latency mode, a frame which is already overdue skips landmark prediction entirely.
+			deadline = self->frameServer->getFrameDeadline(frameTimestamps);
+			if(FrameServer::getWallClock() > deadline) {
+				self->frameServer->checkDeadline("FaceTracker.Predictor", deadline, true);
+				self->logger->debug2("Frame #" YERFACE_FRAMENUMBER_FORMAT " reached tracking after its deadline. Skipping feature prediction.", frameNumber);
+				output.set = false;
+				output.frameNumber = frameNumber;
+				output.facialFeatures.set = false;
+				output.facialFeatures.featuresExposed.set = false;
+				output.facialPose.set = false;
+				output.synthesized = true;
+				self->finishPrediction(output);
+				break;
+			}
+			self->logger->debug4("handleFrameStatusChange() Frame #" YERFACE_FRAMENUMBER_FORMAT " waiting on me.", frameNumber);
 			if(self->predictorWorkerPool != NULL) {
-				self->predictorWorkerPool->sendWorkerSignal();
+				WorkerPoolTask task;
+				task.frameNumber = frameNumber;
+				task.deadline = deadline;
+				task.shedIfLate = true;
+				task.missedDeadline = false;
+				task.payload = NULL;
+				self->predictorWorkerPool->pushTask(task, WorkScheduler::getFrameAffinity(self->frameServer->getWorkingFrame(frameNumber)));
 			}
 			break;
-		case FRAME_STATUS_GONE:
-			YerFace_MutexLock(self->myMutex);
-			self->outputFrames.erase(frameNumber);
-			YerFace_MutexUnlock(self->myMutex);
-			break;
 	}
 }
 
@@ -682,52 +730,45 @@ void FaceTracker::predictorWorkerInitializer(WorkerPoolWorker *worker, void *ptr
 	worker->ptr = (void *)innerWorker;
 }
 
-bool FaceTracker::predictorWorkerHandler(WorkerPoolWorker *worker) {
+void FaceTracker::predictorTaskHandler(WorkerPoolWorker *worker, WorkerPoolTask task) {
 	FaceTrackerWorker *innerWorker = (FaceTrackerWorker *)worker->ptr;
 	FaceTracker *self = innerWorker->self;
+	MetricsTick tick = self->metricsPredictor->startClock();
 
-	bool didWork = false;
-	FrameNumber myFrameNumber = -1;
-
-	YerFace_MutexLock(self->myMutex);
-	//// CHECK FOR WORK ////
-	if(self->pendingPredictionFrameNumbers.size() > 0) {
-		myFrameNumber = self->pendingPredictionFrameNumbers.front();
-		self->pendingPredictionFrameNumbers.pop_front();
-	}
-	YerFace_MutexUnlock(self->myMutex);
-
-	//// DO THE WORK ////
-	if(myFrameNumber > 0) {
-		MetricsTick tick = self->metricsPredictor->startClock();
-
-		WorkingFrame *workingFrame = self->frameServer->getWorkingFrame(myFrameNumber);
-
-		FaceTrackerOutput output;
-		output.set = false;
-		output.facialFeatures.set = false;
-		output.facialFeatures.featuresExposed.set = false;
-		output.facialPose.set = false;
-		output.frameNumber = myFrameNumber;
-
+	FaceTrackerOutput output;
+	output.set = false;
+	output.facialFeatures.set = false;
+	output.facialFeatures.featuresExposed.set = false;
+	output.facialPose.set = false;
+	output.frameNumber = task.frameNumber;
+	output.synthesized = false;
+
+	//In low latency mode, a frame which became overdue while it was queued is shed. Its pose will be extrapolated.
+	if(task.missedDeadline) {
+		self->logger->debug2("Frame #" YERFACE_FRAMENUMBER_FORMAT " missed its deadline. Shedding feature prediction.", task.frameNumber);
+		output.synthesized = true;
+	} else {
+		WorkingFrame *workingFrame = self->frameServer->getWorkingFrame(task.frameNumber);
+		WorkScheduler::touchFrame(workingFrame);
 		self->doIdentifyFeatures(worker, workingFrame, &output);
+	}
 
-		YerFace_MutexLock(self->myMutex);
-		self->outputFrames[myFrameNumber] = output;
-		YerFace_MutexUnlock(self->myMutex);
-
-		YerFace_MutexLock(self->myAssignmentMutex);
-		self->pendingAssignmentFrameNumbers[myFrameNumber].readyForAssignment = true;
-		YerFace_MutexUnlock(self->myAssignmentMutex);
-		if(self->assignmentWorkerPool != NULL) {
-			self->assignmentWorkerPool->sendWorkerSignal();
-		}
+	self->finishPrediction(output);
 
+	if(!output.synthesized) {
 		self->metricsPredictor->endClock(tick);
-		didWork = true;
 	}
+}
 
-	return didWork;
+void FaceTracker::finishPrediction(FaceTrackerOutput output) {
+	frameServer->getWorkingFrame(output.frameNumber)->publishResult(FRAME_RESULT_FACEPREDICTION, output);
+
+	YerFace_MutexLock(myAssignmentMutex);
+	bool assignmentReady = assignmentFrameQueue->setFrameReady(output.frameNumber);
+	YerFace_MutexUnlock(myAssignmentMutex);
+	if(assignmentReady && assignmentWorkerPool != NULL) {
+		assignmentWorkerPool->sendWorkerSignal();
+	}
 }
 
 bool FaceTracker::assignmentWorkerHandler(WorkerPoolWorker *worker) {
@@ -739,27 +780,12 @@ bool FaceTracker::assignmentWorkerHandler(WorkerPoolWorker *worker) {
 
 	YerFace_MutexLock(self->myAssignmentMutex);
 	//// CHECK FOR WORK ////
-	for(auto pendingAssignmentPair : self->pendingAssignmentFrameNumbers) {
-		if(myFrameNumber < 0 || pendingAssignmentPair.first < myFrameNumber) {
-			myFrameNumber = pendingAssignmentPair.first;
-		}
-	}
-	if(myFrameNumber > 0 && !self->pendingAssignmentFrameNumbers[myFrameNumber].readyForAssignment) {
-		self->logger->debug4("BLOCKED on frame " YERFACE_FRAMENUMBER_FORMAT " because it is not ready!", myFrameNumber);
-		myFrameNumber = -1;
-	}
-	if(myFrameNumber > 0) {
-		self->pendingAssignmentFrameNumbers.erase(myFrameNumber);
+	FrameTimestamps nextFrameTimestamps;
+	if(self->assignmentFrameQueue->popNextReadyFrame(&nextFrameTimestamps)) {
+		myFrameNumber = nextFrameTimestamps.frameNumber;
 	}
 	YerFace_MutexUnlock(self->myAssignmentMutex);
 
-	YerFace_MutexLock(self->myMutex);
-	FaceTrackerOutput output;
-	if(myFrameNumber > 0) {
-		output = self->outputFrames[myFrameNumber];
-	}
-	YerFace_MutexUnlock(self->myMutex);
-
 	//// DO THE WORK ////
 	if(myFrameNumber > 0) {
 		self->logger->debug4("Face Tracker Assignment Thread handling frame #" YERFACE_FRAMENUMBER_FORMAT, myFrameNumber);
@@ -771,20 +797,23 @@ bool FaceTracker::assignmentWorkerHandler(WorkerPoolWorker *worker) {
 		MetricsTick tick = self->metricsAssignment->startClock();
 
 		WorkingFrame *workingFrame = self->frameServer->getWorkingFrame(myFrameNumber);
-		
+		FaceTrackerOutput output = *workingFrame->getResult<FaceTrackerOutput>(FRAME_RESULT_FACEPREDICTION);
+
 		YerFace_MutexLock(self->myAssignmentMutex);
 		if(!self->facialCameraModel.set) {
 			self->doInitializeCameraModel(workingFrame);
 		}
-		self->doCalculateFacialTransformation(worker, workingFrame, &output);
+		if(output.synthesized) {
+			self->doExtrapolateFacialTransformation(worker, workingFrame, &output);
+		} else {
+			self->doCalculateFacialTransformation(worker, workingFrame, &output);
+		}
 		self->doPrecalculateFacialPlaneNormal(worker, workingFrame, &output);
 		YerFace_MutexUnlock(self->myAssignmentMutex);
 
-		YerFace_MutexLock(self->myMutex);
-		self->outputFrames[myFrameNumber] = output;
-		YerFace_MutexUnlock(self->myMutex);
+		workingFrame->publishResult(FRAME_RESULT_FACETRACKER, output);
 
-		self->frameServer->setWorkingFrameStatusCheckpoint(myFrameNumber, FRAME_STATUS_TRACKING, "faceTracker.ran");
+		self->frameServer->setWorkingFrameStatusCheckpoint(myFrameNumber, FRAME_STATUS_TRACKING, FRAME_CHECKPOINT_FACETRACKER);
 		self->metricsAssignment->endClock(tick);
 
 		didWork = true;
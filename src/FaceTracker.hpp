@@ -11,6 +11,7 @@
 #include "Metrics.hpp"
 #include "Utilities.hpp"
 #include "WorkerPool.hpp"
+#include "SequencedFrameQueue.hpp"
 
 using namespace std;
 
@@ -125,12 +126,7 @@ public:
 	FrameNumber frameNumber;
 	FacialFeaturesInternal facialFeatures;
 	FacialPose facialPose;
-};
-
-class FaceTrackerAssignmentTask {
-public:
-	FrameNumber frameNumber;
-	bool readyForAssignment;
+	bool synthesized; //Landmark prediction was skipped because the frame was late, so the pose is extrapolated from earlier frames.
 };
 
 class FaceTracker {
@@ -138,19 +134,25 @@ public:
 	FaceTracker(json config, Status *myStatus, SDLDriver *mySDLDriver, FrameServer *myFrameServer, FaceDetector *myFaceDetector);
 	~FaceTracker() noexcept(false);
 	void renderPreviewHUD(cv::Mat frame, FrameNumber frameNumber, int density, bool mirrorMode);
-	FacialFeatures getFacialFeatures(FrameNumber frameNumber);
+	const FacialFeatures &getFacialFeatures(FrameNumber frameNumber); //Valid until the frame is gone.
 	FacialCameraModel getFacialCameraModel(void);
-	FacialPose getFacialPose(FrameNumber frameNumber);
+	const FacialPose &getFacialPose(FrameNumber frameNumber); //Valid until the frame is gone.
+	bool getIsSynthesized(FrameNumber frameNumber);
+	void setUseFullSizedFrameForLandmarkDetection(bool useFullSizedFrame);
+	bool getUseFullSizedFrameForLandmarkDetection(void);
 	FacialPlane getCalculatedFacialPlaneForWorkingFacialPose(FrameNumber frameNumber, MarkerType markerType);
 private:
 	void doIdentifyFeatures(WorkerPoolWorker *worker, WorkingFrame *workingFrame, FaceTrackerOutput *output);
 	void doInitializeCameraModel(WorkingFrame *workingFrame);
 	void doCalculateFacialTransformation(WorkerPoolWorker *worker, WorkingFrame *workingFrame, FaceTrackerOutput *output);
+	void doExtrapolateFacialTransformation(WorkerPoolWorker *worker, WorkingFrame *workingFrame, FaceTrackerOutput *output);
+	void finishPrediction(FaceTrackerOutput output);
+	const FaceTrackerOutput &getOutput(FrameNumber frameNumber);
 	void doPrecalculateFacialPlaneNormal(WorkerPoolWorker *worker, WorkingFrame *workingFrame, FaceTrackerOutput *output);
 	bool doConvertLandmarkPointToImagePoint(DlibPointPointer pointPointer, cv::Point2d *dst, double detectionScaleFactor);
 	static void handleFrameStatusChange(void *userdata, WorkingFrameStatus newStatus, FrameTimestamps frameTimestamps);
 	static void predictorWorkerInitializer(WorkerPoolWorker *worker, void *ptr);
-	static bool predictorWorkerHandler(WorkerPoolWorker *worker);
+	static void predictorTaskHandler(WorkerPoolWorker *worker, WorkerPoolTask task);
 	static bool assignmentWorkerHandler(WorkerPoolWorker *worker);
 
 	string featureDetectionModelFileName, faceDetectionModelFileName;
@@ -192,13 +194,13 @@ private:
 
 	list<FacialPose> facialPoseSmoothingBuffer;
 	FacialPose previouslyReportedFacialPose;
+	FacialPose penultimateReportedFacialPose; //Together with previouslyReportedFacialPose, gives us a velocity for extrapolation.
 	FacialCameraModel facialCameraModel;
 
 	SDL_mutex *myMutex, *myAssignmentMutex;
 
-	std::list<FrameNumber> pendingPredictionFrameNumbers;
-	unordered_map<FrameNumber, FaceTrackerAssignmentTask> pendingAssignmentFrameNumbers;
-	unordered_map<FrameNumber, FaceTrackerOutput> outputFrames;
+	SequencedFrameQueue *assignmentFrameQueue;
+	FaceTrackerOutput unassignedOutput; //Read by frames which have not finished assignment yet.
 
 	WorkerPool *predictorWorkerPool, *assignmentWorkerPool;
 };
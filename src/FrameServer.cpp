@@ -1,14 +1,41 @@
 
 #include "FrameServer.hpp"
+#include "WorkScheduler.hpp"
 #include "Utilities.hpp"
 #include <exception>
 #include <cstdio>
+#include <limits>
 
 using namespace std;
 using namespace cv;
 
 namespace YerFace {
 
+void WorkingFrame::initializeResults(void) {
+	for(unsigned int slot = 0; slot < FRAME_RESULT_MAX; slot++) {
+		results[slot].value.store(NULL, std::memory_order_relaxed);
+		results[slot].type = NULL;
+		results[slot].destroy = NULL;
+	}
+}
+
+void WorkingFrame::destroyResults(void) {
+	// NOTE: Only safe once every consumer is done with the frame. (FRAME_STATUS_GONE.)
+	for(unsigned int slot = 0; slot < FRAME_RESULT_MAX; slot++) {
+		const void *value = results[slot].value.exchange(NULL, std::memory_order_acquire);
+		if(value != NULL) {
+			results[slot].destroy(value);
+		}
+	}
+}
+
+WorkingFrameResult *WorkingFrame::getResultSlot(unsigned int slot) {
+	if(slot >= FRAME_RESULT_MAX) {
+		throw invalid_argument("Frame result slot is out of range.");
+	}
+	return &results[slot];
+}
+
 FrameServer::FrameServer(json config, Status *myStatus, bool myLowLatency) {
 	logger = new Logger("FrameServer");
 	status = myStatus;
@@ -28,31 +55,114 @@ FrameServer::FrameServer(json config, Status *myStatus, bool myLowLatency) {
 	if(detectionScaleFactor < 0.0 || detectionScaleFactor > 1.0) {
 		throw invalid_argument("Detection Scale Factor is invalid.");
 	}
+	qualityLevel = -1;
+	qualityReason = "";
+	double myMaxBytesInFlight = config["YerFace"]["FrameServer"][lowLatencyKey]["maxBytesInFlight"];
+	if(myMaxBytesInFlight <= 0.0) {
+		throw invalid_argument("Max Bytes In Flight is invalid.");
+	}
+	maxBytesInFlight = (size_t)myMaxBytesInFlight;
+	maxLatencySeconds = 0.0;
+	decimationFactor = 1;
+	deadlineSeconds = 0.0;
+	deadlineOffsetSet = false;
+	deadlineOffset = 0.0;
+	if(lowLatency) {
+		maxLatencySeconds = config["YerFace"]["FrameServer"][lowLatencyKey]["maxLatencySeconds"];
+		if(maxLatencySeconds < 0.0) {
+			throw invalid_argument("Max Latency Seconds is invalid.");
+		}
+		int myDecimationFactor = config["YerFace"]["FrameServer"][lowLatencyKey]["decimationFactor"];
+		if(myDecimationFactor < 1) {
+			throw invalid_argument("Decimation Factor is invalid.");
+		}
+		decimationFactor = (unsigned int)myDecimationFactor;
+		deadlineSeconds = config["YerFace"]["FrameServer"][lowLatencyKey]["deadlineSeconds"];
+		if(deadlineSeconds <= 0.0) {
+			throw invalid_argument("Deadline Seconds is invalid.");
+		}
+	}
+	bytesInFlight = 0;
+	admissionProgress = 0;
+	admissionStalled = false;
+	admissionStalledProgress = 0;
+	decimationCounter = 0;
+	admissionThrottled = false;
+	framesBlocked = 0;
+	framesDropped = 0;
+	framesDecimated = 0;
+	framesOverBudget = 0;
+	blockedSeconds = 0.0;
 
 	for(unsigned int i = 0; i <= FRAME_STATUS_MAX; i++) {
 		onFrameStatusChangeCallbacks[i].clear();
+		statusCheckpoints[i] = 0;
 	}
 
 	if((myMutex = SDL_CreateMutex()) == NULL) {
 		throw runtime_error("Failed creating mutex!");
 	}
 
+	size_t frameStoreCapacity = lowLatency ? YERFACE_FRAMESERVER_RING_CAPACITY_LOWLATENCY : YERFACE_FRAMESERVER_RING_CAPACITY_OFFLINE;
+	frameStore = new FrameStoreSlot[frameStoreCapacity];
+	for(size_t i = 0; i < frameStoreCapacity; i++) {
+		frameStore[i].frameNumber.store(-1);
+		frameStore[i].frame.store(NULL);
+	}
+	frameStoreMask = frameStoreCapacity - 1;
+	frameStoreSize = 0;
+
+	if((preprocessMutex = SDL_CreateMutex()) == NULL) {
+		throw runtime_error("Failed creating mutex!");
+	}
+	reportedDetectionScaleFactor = 0.0;
+	if((admissionCond = SDL_CreateCond()) == NULL) {
+		throw runtime_error("Failed creating condition!");
+	}
+	if((deadlineMutex = SDL_CreateMutex()) == NULL) {
+		throw runtime_error("Failed creating mutex!");
+	}
+
 	metrics = new Metrics(config, "FrameServer");
+	latencyMetrics = new Metrics(config, "FrameServer.Latency");
+	preprocessMetrics = new Metrics(config, "FrameServer.Preprocess");
 
 	draining = false;
+	dispatchingTransitions = false;
 	mirrorMode = false;
 	workerPool = NULL;
+	preprocessWorkerPool = NULL;
+
+	//Hook into our own frame lifecycle, so preview and detection frames are prepared in parallel during FRAME_STATUS_PREPROCESS.
+	FrameStatusChangeEventCallback frameStatusChangeCallback;
+	frameStatusChangeCallback.userdata = (void *)this;
+	frameStatusChangeCallback.callback = handleFrameStatusChange;
+	frameStatusChangeCallback.newStatus = FRAME_STATUS_PREPROCESS;
+	onFrameStatusChangeEvent(frameStatusChangeCallback);
+	registerFrameStatusCheckpoint(FRAME_STATUS_PREPROCESS, FRAME_CHECKPOINT_FRAMESERVER);
 
 	WorkerPoolParameters workerPoolParameters;
 	workerPoolParameters.name = "FrameServer.Herder";
 	workerPoolParameters.numWorkers = 1;
 	workerPoolParameters.numWorkersPerCPU = 0.0;
+	workerPoolParameters.dedicatedThreads = false;
 	workerPoolParameters.initializer = NULL;
 	workerPoolParameters.deinitializer = workerDeinitializer;
 	workerPoolParameters.usrPtr = (void *)this;
 	workerPoolParameters.handler = workerHandler;
 	workerPool = new WorkerPool(config, status, this, workerPoolParameters);
 
+	workerPoolParameters.name = "FrameServer.Preprocess";
+	workerPoolParameters.numWorkers = config["YerFace"]["FrameServer"]["numWorkers"];
+	workerPoolParameters.numWorkersPerCPU = config["YerFace"]["FrameServer"]["numWorkersPerCPU"];
+	workerPoolParameters.dedicatedThreads = false;
+	workerPoolParameters.initializer = NULL;
+	workerPoolParameters.deinitializer = NULL;
+	workerPoolParameters.usrPtr = (void *)this;
+	workerPoolParameters.handler = NULL;
+	workerPoolParameters.taskHandler = preprocessTaskHandler;
+	preprocessWorkerPool = new WorkerPool(config, status, this, workerPoolParameters);
+
 	logger->debug1("FrameServer constructed and ready to go!");
 }
 
@@ -67,14 +177,38 @@ FrameServer::~FrameServer() noexcept(false) {
 	YerFace_MutexUnlock(myMutex);
 
 	delete workerPool;
-	
+	delete preprocessWorkerPool;
+
 	YerFace_MutexLock(myMutex);
-	if(frameStore.size() > 0) {
+	if(frameStoreSize > 0) {
 		logger->err("Frames are still sitting in the frame store! Draining did not complete!");
 	}
+	if(pendingTransitions.size() > 0) {
+		logger->err("Frame status changes were never dispatched! Draining did not complete!");
+	}
 	YerFace_MutexUnlock(myMutex);
 
+	if(lowLatency) {
+		logger->info("Admission control dropped " YERFACE_FRAMENUMBER_FORMAT " frames and decimated " YERFACE_FRAMENUMBER_FORMAT " frames.", framesDropped, framesDecimated);
+		YerFace_MutexLock(deadlineMutex);
+		for(auto &entry : deadlineCounters) {
+			logger->info("Stage %s missed " YERFACE_FRAMENUMBER_FORMAT " of " YERFACE_FRAMENUMBER_FORMAT " deadlines, and shed " YERFACE_FRAMENUMBER_FORMAT " of those tasks.", entry.first.c_str(), entry.second.missed, entry.second.tasks, entry.second.shed);
+		}
+		YerFace_MutexUnlock(deadlineMutex);
+	} else {
+		logger->info("Admission control blocked " YERFACE_FRAMENUMBER_FORMAT " frames for a total of %.03lf seconds.", framesBlocked, blockedSeconds);
+		if(framesOverBudget > 0) {
+			logger->warning("Admission control admitted " YERFACE_FRAMENUMBER_FORMAT " frames over the bytes in flight budget because the pipeline stalled.", framesOverBudget);
+		}
+	}
+
 	SDL_DestroyMutex(myMutex);
+	SDL_DestroyMutex(preprocessMutex);
+	SDL_DestroyCond(admissionCond);
+	SDL_DestroyMutex(deadlineMutex);
+	delete[] frameStore;
+	delete latencyMetrics;
+	delete preprocessMetrics;
 	delete metrics;
 	delete logger;
 }
@@ -92,88 +226,323 @@ void FrameServer::onFrameStatusChangeEvent(FrameStatusChangeEventCallback callba
 	YerFace_MutexUnlock(myMutex);
 }
 
-void FrameServer::registerFrameStatusCheckpoint(WorkingFrameStatus status, string checkpointKey) {
+void FrameServer::registerFrameStatusCheckpoint(WorkingFrameStatus status, FrameStatusCheckpoint checkpoint) {
 	checkStatusValue(status);
+	checkCheckpointValue(checkpoint);
 	if(status == FRAME_STATUS_GONE) {
 		throw invalid_argument("Somebody tried to register a checkpoint for FRAME_STATUS_GONE, but this doesn't make sense because FRAME_STATUS_GONE means the frame is about to be cleaned up.");
 	}
 	YerFace_MutexLock(myMutex);
-	statusCheckpoints[status].push_back(checkpointKey);
+	statusCheckpoints[status] |= FRAME_CHECKPOINT_BIT(checkpoint);
 	YerFace_MutexUnlock(myMutex);
 }
 
 void FrameServer::insertNewFrame(VideoFrame *videoFrame) {
 	MetricsTick tick = metrics->startClock();
 
+	// NOTE: The full resolution frame is NOT copied. We hold a reference to the
+	// decoder's frame backing instead. Preview and detection frames are
+	// prepared later, in FRAME_STATUS_PREPROCESS.
+	WorkingFrame *workingFrame = new WorkingFrame();
+	if((workingFrame->previewFrameMutex = SDL_CreateMutex()) == NULL) {
+		delete workingFrame;
+		throw runtime_error("Failed creating mutex!");
+	}
+	workingFrame->initializeResults();
+	workingFrame->frameBacking = videoFrame->frameBacking;
+	workingFrame->frameBacking->retain();
+	workingFrame->frame = videoFrame->frameCV;
+	workingFrame->frameTimestamps = videoFrame->timestamp;
+	workingFrame->detectionScaleFactor = 0.0;
+	if(!videoFrame->detectionFrameCV.empty()) {
+		workingFrame->detectionFrame = videoFrame->detectionFrameCV;
+		workingFrame->detectionScaleFactor = videoFrame->detectionScaleFactor;
+	}
+	SDL_AtomicSet(&workingFrame->affinityThread, 0);
+	SDL_AtomicSet(&workingFrame->affinityCPU, CPUAffinity::getCurrentCPU() + 1);
+	// NOTE: We count the full resolution frame and its preview copy. (The detection frame is comparatively tiny.)
+	workingFrame->bitmapBytes = 2 * workingFrame->frame.total() * workingFrame->frame.elemSize();
+
 	YerFace_MutexLock(myMutex);
 
 	if(draining) {
 		YerFace_MutexUnlock(myMutex);
+		workingFrame->frame.release();
+		workingFrame->detectionFrame.release();
+		workingFrame->frameBacking->release();
+		SDL_DestroyMutex(workingFrame->previewFrameMutex);
+		delete workingFrame;
 		throw logic_error("Can't insert new frame while draining!");
 	}
 
-	if(lowLatency && frameStore.size() >= YERFACE_FRAMESERVER_MAX_QUEUEDEPTH) {
-		logger->err("FrameStore has hit the maximum allowable queue depth of %d! Main loop is now BLOCKED! If this happens a lot, consider some tuning.", YERFACE_FRAMESERVER_MAX_QUEUEDEPTH);
-		while(frameStore.size() >= YERFACE_FRAMESERVER_MAX_QUEUEDEPTH) {
-			YerFace_MutexUnlock(myMutex);
-			SDL_Delay(5);
-			YerFace_MutexLock(myMutex);
+	if(!admitFrame(workingFrame)) {
+		YerFace_MutexUnlock(myMutex);
+		workingFrame->frame.release();
+		workingFrame->detectionFrame.release();
+		workingFrame->frameBacking->release();
+		SDL_DestroyMutex(workingFrame->previewFrameMutex);
+		delete workingFrame;
+		metrics->endClock(tick);
+		return;
+	}
+
+	FrameStoreSlot *slot = getFrameStoreSlot(workingFrame->frameTimestamps.frameNumber);
+	workingFrame->qualityLevel = qualityLevel;
+	workingFrame->qualityReason = qualityReason;
+
+	// Mark all of the registered checkpoints as pending to accurately record the frame's status.
+	for(unsigned int i = 0; i <= FRAME_STATUS_MAX; i++) {
+		workingFrame->checkpoints[i] = statusCheckpoints[i];
+	}
+
+	// NOTE: Publish the frame pointer BEFORE the generation tag, so lock-free readers never see a tag without its frame.
+	slot->frame.store(workingFrame);
+	slot->frameNumber.store(workingFrame->frameTimestamps.frameNumber);
+	frameStoreSize++;
+	bytesInFlight += workingFrame->bitmapBytes;
+	workingFrame->latencyTick = latencyMetrics->startClock();
+	if(lowLatency) {
+		double offset = workingFrame->latencyTick.startTime - workingFrame->frameTimestamps.startTimestamp;
+		YerFace_MutexLock(deadlineMutex);
+		if(!deadlineOffsetSet || offset < deadlineOffset) {
+			deadlineOffset = offset;
+			deadlineOffsetSet = true;
 		}
+		YerFace_MutexUnlock(deadlineMutex);
 	}
+	logger->debug4("Inserted new working frame " YERFACE_FRAMENUMBER_FORMAT " into frame store. Frame store size is now %lu", workingFrame->frameTimestamps.frameNumber, frameStoreSize);
 
-	WorkingFrame *workingFrame = new WorkingFrame();
+	setFrameStatus(workingFrame->frameTimestamps, FRAME_STATUS_NEW);
+	if(statusCheckpoints[FRAME_STATUS_NEW] == 0) {
+		readyFrames.push_back(workingFrame->frameTimestamps.frameNumber);
+	}
+	//The herder dispatches the NEW transition. The capture thread must never get stuck running everybody's callbacks.
+	if(workerPool != NULL) {
+		workerPool->sendWorkerSignal();
+	}
 
-	if((workingFrame->previewFrameMutex = SDL_CreateMutex()) == NULL) {
-		throw runtime_error("Failed creating mutex!");
+	YerFace_MutexUnlock(myMutex);
+
+	metrics->endClock(tick);
+}
+
+bool FrameServer::admitFrame(WorkingFrame *workingFrame) {
+	// NOTE: Caller must hold myMutex.
+	FrameStoreSlot *slot = getFrameStoreSlot(workingFrame->frameTimestamps.frameNumber);
+
+	if(!lowLatency) {
+		// Offline, every frame must be processed, so we wait (without spinning) until there is room.
+		// An empty frame store always admits, so a single oversized frame cannot wedge us.
+		// The byte budget is only soft, though. Frames in flight may be parked at a checkpoint waiting on
+		// audio which the demuxer can't reach while we hold up capture. If nothing gets released for
+		// YERFACE_FRAMESERVER_ADMISSION_STALL_SECONDS, we stop enforcing it until something does.
+		bool blocked = false;
+		double blockedStart = 0.0;
+		double progressSeenAt = 0.0;
+		size_t progressSeen = admissionProgress;
+		if(admissionStalled && admissionProgress != admissionStalledProgress) {
+			logger->info("Pipeline is making progress again. Resuming the bytes in flight budget.");
+			admissionStalled = false;
+		}
+		while(slot->frameNumber.load() != -1 || (!admissionStalled && frameStoreSize > 0 && bytesInFlight + workingFrame->bitmapBytes > maxBytesInFlight)) {
+			if(status->getEmergency()) {
+				return false;
+			}
+			double now = (double)cv::getTickCount() / (double)cv::getTickFrequency();
+			if(!blocked) {
+				logger->debug1("Admission of frame " YERFACE_FRAMENUMBER_FORMAT " is BLOCKED. (Frame store size: %lu, bytes in flight: %lu)", workingFrame->frameTimestamps.frameNumber, frameStoreSize, bytesInFlight);
+				blocked = true;
+				blockedStart = now;
+				progressSeenAt = now;
+			}
+			if(admissionProgress != progressSeen) {
+				progressSeen = admissionProgress;
+				progressSeenAt = now;
+			} else if(slot->frameNumber.load() == -1 && now - progressSeenAt >= YERFACE_FRAMESERVER_ADMISSION_STALL_SECONDS) {
+				logger->warning("No frames have been released for %.0lf seconds with %lu bytes in flight. (Probably waiting on audio.) Admitting frames over the budget until the pipeline makes progress.", YERFACE_FRAMESERVER_ADMISSION_STALL_SECONDS, bytesInFlight);
+				admissionStalled = true;
+				admissionStalledProgress = progressSeen;
+				break;
+			}
+			SDL_CondWaitTimeout(admissionCond, myMutex, 1000);
+		}
+		if(blocked) {
+			framesBlocked++;
+			blockedSeconds += ((double)cv::getTickCount() / (double)cv::getTickFrequency()) - blockedStart;
+		}
+		if(admissionStalled && frameStoreSize > 0 && bytesInFlight + workingFrame->bitmapBytes > maxBytesInFlight) {
+			framesOverBudget++;
+		}
+		return true;
+	}
+
+	// In low latency mode, we never block the capture thread. Frames we cannot keep up with are discarded.
+	const char *dropReason = NULL;
+	bool decimated = false;
+	if(slot->frameNumber.load() != -1) {
+		dropReason = "frame store ring is full";
+	} else if(frameStoreSize > 0 && bytesInFlight + workingFrame->bitmapBytes > maxBytesInFlight) {
+		dropReason = "bytes in flight exceeds the budget";
+	} else if(maxLatencySeconds > 0.0 && latencyMetrics->getAverageTimeSeconds() > maxLatencySeconds) {
+		decimationCounter++;
+		if(decimationCounter % decimationFactor != 0) {
+			decimated = true;
+		}
+	} else {
+		decimationCounter = 0;
+	}
+
+	if(dropReason != NULL || decimated) {
+		if(!admissionThrottled) {
+			if(dropReason != NULL) {
+				logger->warning("Dropping frames because %s! (Frame store size: %lu, bytes in flight: %lu) If this happens a lot, consider some tuning.", dropReason, frameStoreSize, bytesInFlight);
+			} else {
+				logger->warning("Decimating frames because pipeline latency (%.03lf seconds) exceeds the budget (%.03lf seconds)! If this happens a lot, consider some tuning.", latencyMetrics->getAverageTimeSeconds(), maxLatencySeconds);
+			}
+			admissionThrottled = true;
+		}
+		if(dropReason != NULL) {
+			framesDropped++;
+		} else {
+			framesDecimated++;
+		}
+		logger->debug2("Discarded frame " YERFACE_FRAMENUMBER_FORMAT " at ingest.", workingFrame->frameTimestamps.frameNumber);
+		return false;
+	}
+	if(admissionThrottled && decimationCounter == 0) {
+		logger->info("Admission control recovered. (So far: " YERFACE_FRAMENUMBER_FORMAT " frames dropped, " YERFACE_FRAMENUMBER_FORMAT " frames decimated.)", framesDropped, framesDecimated);
+		admissionThrottled = false;
 	}
+	return true;
+}
 
-	workingFrame->frame = videoFrame->frameCV.clone();
-	if(mirrorMode) {
+void FrameServer::doPreprocessFrame(WorkingFrame *workingFrame) {
+	YerFace_MutexLock(myMutex);
+	bool myMirrorMode = mirrorMode;
+	YerFace_MutexUnlock(myMutex);
+
+	Size myFrameSize = workingFrame->frame.size();
+
+	YerFace_MutexLock(workingFrame->previewFrameMutex);
+	if(myMirrorMode) {
 		cv::flip(workingFrame->frame, workingFrame->previewFrame, 1);
 	} else {
 		workingFrame->previewFrame = workingFrame->frame.clone();
 	}
+	YerFace_MutexUnlock(workingFrame->previewFrameMutex);
 
-	frameSize = workingFrame->frame.size();
-	frameSizeSet = true;
+	//The decoder normally hands us a detection frame already, scaled straight from its native pixel format.
+	if(!workingFrame->detectionFrame.empty()) {
+		return;
+	}
 
-	workingFrame->frameTimestamps = videoFrame->timestamp;
+	double myDetectionScaleFactor = calculateDetectionScaleFactor(myFrameSize);
+	workingFrame->detectionScaleFactor = myDetectionScaleFactor;
 
-	if(detectionBoundingBox > 0) {
-		if(frameSize.width >= frameSize.height) {
-			detectionScaleFactor = (double)detectionBoundingBox / (double)frameSize.width;
-		} else {
-			detectionScaleFactor = (double)detectionBoundingBox / (double)frameSize.height;
-		}
-	}
-	workingFrame->detectionScaleFactor = detectionScaleFactor;
+	resize(workingFrame->frame, workingFrame->detectionFrame, Size(), myDetectionScaleFactor, myDetectionScaleFactor);
 
-	resize(workingFrame->frame, workingFrame->detectionFrame, Size(), detectionScaleFactor, detectionScaleFactor);
+	YerFace_MutexLock(preprocessMutex);
+	if(reportedDetectionScaleFactor != myDetectionScaleFactor) {
+		logger->debug1("Scaled current frame <%dx%d> down to <%dx%d> for detection", myFrameSize.width, myFrameSize.height, workingFrame->detectionFrame.size().width, workingFrame->detectionFrame.size().height);
+		reportedDetectionScaleFactor = myDetectionScaleFactor;
+	}
+	YerFace_MutexUnlock(preprocessMutex);
+}
 
-	static bool reportedScale = false;
-	if(!reportedScale) {
-		logger->debug1("Scaled current frame <%dx%d> down to <%dx%d> for detection", frameSize.width, frameSize.height, workingFrame->detectionFrame.size().width, workingFrame->detectionFrame.size().height);
-		reportedScale = true;
+double FrameServer::getFrameDeadline(FrameTimestamps frameTimestamps) {
+	if(!lowLatency) {
+		return std::numeric_limits<double>::infinity();
+	}
+	YerFace_MutexLock(deadlineMutex);
+	double deadline = std::numeric_limits<double>::infinity();
+	if(deadlineOffsetSet) {
+		deadline = deadlineOffset + frameTimestamps.startTimestamp + deadlineSeconds;
 	}
+	YerFace_MutexUnlock(deadlineMutex);
+	return deadline;
+}
 
-	// Set all of the registered checkpoints to FALSE to accurately record the frame's status.
-	for(unsigned int i = 0; i <= FRAME_STATUS_MAX; i++) {
-		for(string checkpointKey : statusCheckpoints[i]) {
-			workingFrame->checkpoints[i][checkpointKey] = false;
+bool FrameServer::checkDeadline(string stageName, double deadline, bool shedIfMissed) {
+	if(!lowLatency) {
+		return false;
+	}
+	bool missed = getWallClock() > deadline;
+	YerFace_MutexLock(deadlineMutex);
+	auto iter = deadlineCounters.find(stageName);
+	if(iter == deadlineCounters.end()) {
+		FrameDeadlineCounters counters;
+		counters.tasks = 0;
+		counters.missed = 0;
+		counters.shed = 0;
+		iter = deadlineCounters.insert(std::make_pair(stageName, counters)).first;
+	}
+	iter->second.tasks++;
+	if(missed) {
+		iter->second.missed++;
+		if(shedIfMissed) {
+			iter->second.shed++;
 		}
 	}
+	YerFace_MutexUnlock(deadlineMutex);
+	return missed;
+}
+
+void FrameServer::setDetectionScale(int myDetectionBoundingBox, double myDetectionScaleFactor) {
+	if(myDetectionBoundingBox < 0) {
+		throw invalid_argument("Detection Bounding Box is invalid.");
+	}
+	if(myDetectionScaleFactor < 0.0 || myDetectionScaleFactor > 1.0) {
+		throw invalid_argument("Detection Scale Factor is invalid.");
+	}
+	YerFace_MutexLock(myMutex);
+	detectionBoundingBox = myDetectionBoundingBox;
+	detectionScaleFactor = myDetectionScaleFactor;
+	YerFace_MutexUnlock(myMutex);
+}
 
-	frameStore[workingFrame->frameTimestamps.frameNumber] = workingFrame;
-	logger->debug4("Inserted new working frame " YERFACE_FRAMENUMBER_FORMAT " into frame store. Frame store size is now %lu", workingFrame->frameTimestamps.frameNumber, frameStore.size());
+void FrameServer::setQualityLevel(int myQualityLevel, string myQualityReason) {
+	YerFace_MutexLock(myMutex);
+	qualityLevel = myQualityLevel;
+	qualityReason = myQualityReason;
+	YerFace_MutexUnlock(myMutex);
+}
 
-	setFrameStatus(workingFrame->frameTimestamps, FRAME_STATUS_NEW);
+int FrameServer::getDetectionBoundingBox(void) {
+	YerFace_MutexLock(myMutex);
+	int val = detectionBoundingBox;
+	YerFace_MutexUnlock(myMutex);
+	return val;
+}
 
-	metrics->endClock(tick);
+double FrameServer::getDetectionScaleFactor(void) {
+	YerFace_MutexLock(myMutex);
+	double val = detectionScaleFactor;
+	YerFace_MutexUnlock(myMutex);
+	return val;
+}
 
-	if(workerPool != NULL) {
-		workerPool->sendWorkerSignal();
-	}
+double FrameServer::calculateDetectionScaleFactor(Size myFrameSize) {
+	YerFace_MutexLock(myMutex);
+	int myDetectionBoundingBox = detectionBoundingBox;
+	double myDetectionScaleFactor = detectionScaleFactor;
 	YerFace_MutexUnlock(myMutex);
+
+	if(myDetectionBoundingBox > 0) {
+		if(myFrameSize.width >= myFrameSize.height) {
+			myDetectionScaleFactor = (double)myDetectionBoundingBox / (double)myFrameSize.width;
+		} else {
+			myDetectionScaleFactor = (double)myDetectionBoundingBox / (double)myFrameSize.height;
+		}
+	}
+	return myDetectionScaleFactor;
+}
+
+Metrics *FrameServer::getLatencyMetrics(void) {
+	return latencyMetrics;
+}
+
+double FrameServer::getWallClock(void) {
+	return (double)getTickCount() / (double)getTickFrequency();
 }
 
 void FrameServer::setDraining(void) {
@@ -201,18 +570,26 @@ void FrameServer::setMirrorMode(bool myMirrorMode) {
 }
 
 WorkingFrame *FrameServer::getWorkingFrame(FrameNumber frameNumber) {
-	YerFace_MutexLock(myMutex);
-	auto frameIter = frameStore.find(frameNumber);
-	if(frameIter == frameStore.end()) {
-		YerFace_MutexUnlock(myMutex);
-		throw runtime_error("getWorkingFrame() called, but the referenced frame does not exist in the frame store!");
+	// Lock-free. The generation tag is checked on both sides of loading the
+	// frame pointer, so we never hand back a frame which was swapped out underneath us.
+	FrameStoreSlot *slot = getFrameStoreSlot(frameNumber);
+	if(slot->frameNumber.load() == frameNumber) {
+		WorkingFrame *frame = slot->frame.load();
+		if(frame != NULL && slot->frameNumber.load() == frameNumber) {
+			return frame;
+		}
 	}
-	YerFace_MutexUnlock(myMutex);
-	return frameIter->second;
+	throw runtime_error("getWorkingFrame() called, but the referenced frame does not exist in the frame store!");
+}
+
+FrameStoreSlot *FrameServer::getFrameStoreSlot(FrameNumber frameNumber) {
+	return &frameStore[(size_t)frameNumber & frameStoreMask];
 }
 
-void FrameServer::setWorkingFrameStatusCheckpoint(FrameNumber frameNumber, WorkingFrameStatus status, string checkpointKey) {
+void FrameServer::setWorkingFrameStatusCheckpoint(FrameNumber frameNumber, WorkingFrameStatus status, FrameStatusCheckpoint checkpoint) {
 	checkStatusValue(status);
+	checkCheckpointValue(checkpoint);
+	FrameCheckpointMask checkpointBit = FRAME_CHECKPOINT_BIT(checkpoint);
 	YerFace_MutexLock(myMutex);
 	WorkingFrame *frame;
 	try {
@@ -226,18 +603,20 @@ void FrameServer::setWorkingFrameStatusCheckpoint(FrameNumber frameNumber, Worki
 		YerFace_MutexUnlock(myMutex);
 		throw logic_error("Trying to set a checkpoint on a status for a frame whose current status does not match!");
 	}
-	auto checkpointIter = frame->checkpoints[status].find(checkpointKey);
-	if(checkpointIter == frame->checkpoints[status].end()) {
+	if(!(statusCheckpoints[status] & checkpointBit)) {
 		YerFace_MutexUnlock(myMutex);
 		throw logic_error("Trying to set a checkpoint on a status for a frame but that checkpoint was never registered!");
 	}
-	if(checkpointIter->second) {
+	if(!(frame->checkpoints[status] & checkpointBit)) {
 		YerFace_MutexUnlock(myMutex);
 		throw logic_error("Trying to set a checkpoint on a status for a frame, but the checkpoint was already set!");
 	}
-	frame->checkpoints[status][checkpointKey] = true;
-	if(workerPool != NULL) {
-		workerPool->sendWorkerSignal();
+	frame->checkpoints[status] &= ~checkpointBit;
+	if(frame->checkpoints[status] == 0) {
+		readyFrames.push_back(frameNumber);
+		if(workerPool != NULL) {
+			workerPool->sendWorkerSignal();
+		}
 	}
 	YerFace_MutexUnlock(myMutex);
 }
@@ -245,95 +624,200 @@ void FrameServer::setWorkingFrameStatusCheckpoint(FrameNumber frameNumber, Worki
 bool FrameServer::isDrained(void) {
 	bool drained;
 	YerFace_MutexLock(myMutex);
-	drained = draining && frameStore.size() == 0;
-	// logger->debug4("Drained? %s Draining? %s FrameStoreSize? %ld", drained ? "TRUE" : "FALSE", draining ? "TRUE" : "FALSE", frameStore.size());
+	drained = draining && frameStoreSize == 0;
+	// logger->debug4("Drained? %s Draining? %s FrameStoreSize? %ld", drained ? "TRUE" : "FALSE", draining ? "TRUE" : "FALSE", frameStoreSize);
 	YerFace_MutexUnlock(myMutex);
 	return drained;
 }
 
 void FrameServer::destroyFrame(FrameNumber frameNumber) {
 	logger->debug4("Cleaning up GONE Frame #" YERFACE_FRAMENUMBER_FORMAT " ...", frameNumber);
-	SDL_DestroyMutex(frameStore[frameNumber]->previewFrameMutex);
-	delete frameStore[frameNumber];
-	frameStore.erase(frameNumber);
+	YerFace_MutexLock(myMutex);
+	FrameStoreSlot *slot = getFrameStoreSlot(frameNumber);
+	WorkingFrame *workingFrame = slot->frame.load();
+	// NOTE: Retire the generation tag BEFORE clearing the frame pointer, so lock-free readers fail their lookup.
+	slot->frameNumber.store(-1);
+	slot->frame.store(NULL);
+	frameStoreSize--;
+	admissionProgress++;
+	SDL_CondBroadcast(admissionCond);
 
 	if(isDrained()) {
 		if(workerPool != NULL) {
 			workerPool->stopWorkerNow();
 		}
 	}
+	YerFace_MutexUnlock(myMutex);
+
+	releaseFrameBitmaps(workingFrame);
+	workingFrame->destroyResults();
+	SDL_DestroyMutex(workingFrame->previewFrameMutex);
+	delete workingFrame;
 }
 
 void FrameServer::setFrameStatus(FrameTimestamps frameTimestamps, WorkingFrameStatus newStatus) {
+	// NOTE: Caller must hold myMutex. Callbacks are NOT invoked here. The transition is
+	// recorded, and callbacks run later in dispatchFrameStatusTransitions() without myMutex.
 	checkStatusValue(newStatus);
-	YerFace_MutexLock(myMutex);
-	frameStore[frameTimestamps.frameNumber]->status = newStatus;
+	WorkingFrame *workingFrame = getWorkingFrame(frameTimestamps.frameNumber);
+	workingFrame->status = newStatus;
 	logger->debug4("Setting Frame #" YERFACE_FRAMENUMBER_FORMAT " Status to %d ...", frameTimestamps.frameNumber, newStatus);
-	for(auto callback : onFrameStatusChangeCallbacks[newStatus]) {
-		callback.callback(callback.userdata, newStatus, frameTimestamps);
+	FrameStatusTransition transition;
+	transition.frameTimestamps = frameTimestamps;
+	transition.newStatus = newStatus;
+	pendingTransitions.push_back(transition);
+}
+
+void FrameServer::advanceFrame(WorkingFrame *workingFrame) {
+	YerFace_MutexLock(myMutex);
+	WorkingFrameStatus status = workingFrame->status;
+	FrameTimestamps frameTimestamps = workingFrame->frameTimestamps;
+
+	// Statuses with no registered checkpoints are fast-forwarded in a single pass.
+	while(status != FRAME_STATUS_GONE) {
+		status = (WorkingFrameStatus)(status + 1);
+		// NOTE: Sample the pending checkpoints now, because once dispatched, callbacks may pass them at any time.
+		bool hasCheckpoints = workingFrame->checkpoints[status] != 0;
+		setFrameStatus(frameTimestamps, status);
+
+		if(hasCheckpoints) {
+			//Once the callbacks pass every checkpoint, the frame will be put back into the ready queue.
+			break;
+		}
+	}
+
+	YerFace_MutexUnlock(myMutex);
+}
+
+void FrameServer::dispatchFrameStatusTransitions(void) {
+	YerFace_MutexLock(myMutex);
+	// Only the herder dispatches, so callbacks fire in exactly the order the
+	// transitions were recorded. Anybody else just records their transitions and
+	// signals the herder, which keeps going until the queue is empty.
+	if(dispatchingTransitions) {
+		YerFace_MutexUnlock(myMutex);
+		return;
 	}
+	dispatchingTransitions = true;
+	while(pendingTransitions.size() > 0) {
+		FrameStatusTransition transition = pendingTransitions.front();
+		pendingTransitions.pop_front();
+		std::vector<FrameStatusChangeEventCallback> callbacks = onFrameStatusChangeCallbacks[transition.newStatus];
+		YerFace_MutexUnlock(myMutex);
+
+		try {
+			// NOTE: We release image mats after PREVIEW_DISPLAY to prevent unbounded RAM usage
+			// when Sphinx holds frames in LATE_PROCESSING for an indeterminate amount of time.
+			if(transition.newStatus == FRAME_STATUS_LATE_PROCESSING) {
+				releaseFrameBitmaps(getWorkingFrame(transition.frameTimestamps.frameNumber));
+			}
+
+			for(auto callback : callbacks) {
+				callback.callback(callback.userdata, transition.newStatus, transition.frameTimestamps);
+			}
+
+			if(transition.newStatus == FRAME_STATUS_GONE) {
+				destroyFrame(transition.frameTimestamps.frameNumber);
+			}
+		} catch(exception &e) {
+			YerFace_MutexLock(myMutex);
+			dispatchingTransitions = false;
+			YerFace_MutexUnlock(myMutex);
+			throw;
+		}
+
+		YerFace_MutexLock(myMutex);
+	}
+	dispatchingTransitions = false;
 	YerFace_MutexUnlock(myMutex);
 }
 
+void FrameServer::releaseFrameBitmaps(WorkingFrame *workingFrame) {
+	YerFace_MutexLock(myMutex);
+	if(workingFrame->bitmapBytes > 0) {
+		latencyMetrics->endClock(workingFrame->latencyTick);
+		bytesInFlight -= workingFrame->bitmapBytes;
+		workingFrame->bitmapBytes = 0;
+		admissionProgress++;
+		SDL_CondBroadcast(admissionCond);
+	}
+	YerFace_MutexUnlock(myMutex);
+
+	workingFrame->frame.release();
+	workingFrame->detectionFrame.release();
+	YerFace_MutexLock(workingFrame->previewFrameMutex);
+	workingFrame->previewFrame.release();
+	YerFace_MutexUnlock(workingFrame->previewFrameMutex);
+	if(workingFrame->frameBacking != NULL) {
+		workingFrame->frameBacking->release();
+		workingFrame->frameBacking = NULL;
+	}
+}
+
 void FrameServer::checkStatusValue(WorkingFrameStatus status) {
 	if(status < 0 || status > FRAME_STATUS_MAX) {
 		throw invalid_argument("passed invalid WorkingFrameStatus!");
 	}
 }
 
+void FrameServer::checkCheckpointValue(FrameStatusCheckpoint checkpoint) {
+	if(checkpoint < 0 || checkpoint > FRAME_CHECKPOINT_MAX) {
+		throw invalid_argument("passed invalid FrameStatusCheckpoint!");
+	}
+}
+
 bool FrameServer::workerHandler(WorkerPoolWorker *worker) {
 	FrameServer *self = (FrameServer *)worker->ptr;
 
 	bool didWork = false;
-	std::list<FrameNumber> garbageFrames;
 
 	YerFace_MutexLock(self->myMutex);
 
-	// self->logger->verbose("Frame Herder Top-of-loop. FrameStore size: %lu", self->frameStore.size());
-	for(auto framePair : self->frameStore) {
-		FrameNumber frameNumber = framePair.first;
-		WorkingFrame *workingFrame = framePair.second;
-		WorkingFrameStatus status = workingFrame->status;
-
-		//Does this frame need to be garbage collected?
-		if(status == FRAME_STATUS_GONE) {
-			didWork = true;
-			garbageFrames.push_back(frameNumber);
-			continue;
-		}
+	//Advance every frame which has passed all of its checkpoints.
+	while(self->readyFrames.size() > 0) {
+		FrameNumber frameNumber = self->readyFrames.front();
+		self->readyFrames.pop_front();
+		didWork = true;
+		self->advanceFrame(self->getWorkingFrame(frameNumber));
+	}
 
-		//Is this frame eligible for a new status?
-		bool checkpointsPassed = true;
-		for(auto checkpointPair : workingFrame->checkpoints[status]) {
-			if(!checkpointPair.second) {
-				checkpointsPassed = false;
-			}
-		}
+	YerFace_MutexUnlock(self->myMutex);
 
-		//Advance this frame to the next status.
-		if(checkpointsPassed) {
-			// NOTE: We release image mats after PREVIEW_DISPLAY to prevent unbounded RAM usage
-			// when Sphinx holds frames in LATE_PROCESSING for an indeterminate amount of time.
-			if(status == FRAME_STATUS_PREVIEW_DISPLAY) {
-				workingFrame->frame.release();
-				workingFrame->detectionFrame.release();
-				workingFrame->previewFrame.release();
-			}
+	self->dispatchFrameStatusTransitions();
 
-			didWork = true;
-			self->setFrameStatus(workingFrame->frameTimestamps, (WorkingFrameStatus)(status + 1));
-		}
-	}
+	return didWork;
+}
 
-	//Destroy GONE frames.
-	while(garbageFrames.size() > 0) {
-		self->destroyFrame(garbageFrames.front());
-		garbageFrames.pop_front();
+void FrameServer::handleFrameStatusChange(void *userdata, WorkingFrameStatus newStatus, FrameTimestamps frameTimestamps) {
+	FrameServer *self = (FrameServer *)userdata;
+	switch(newStatus) {
+		default:
+			throw logic_error("Handler passed unsupported frame status change event!");
+		case FRAME_STATUS_PREPROCESS:
+			if(self->preprocessWorkerPool != NULL) {
+				WorkerPoolTask task;
+				task.frameNumber = frameTimestamps.frameNumber;
+				task.deadline = self->getFrameDeadline(frameTimestamps);
+				task.shedIfLate = false;
+				task.missedDeadline = false;
+				task.payload = NULL;
+				self->preprocessWorkerPool->pushTask(task);
+			}
+			break;
 	}
+}
 
-	YerFace_MutexUnlock(self->myMutex);
+void FrameServer::preprocessTaskHandler(WorkerPoolWorker *worker, WorkerPoolTask task) {
+	FrameServer *self = (FrameServer *)worker->ptr;
 
-	return didWork;
+	MetricsTick tick = self->preprocessMetrics->startClock();
+
+	WorkingFrame *workingFrame = self->getWorkingFrame(task.frameNumber);
+	WorkScheduler::touchFrame(workingFrame);
+	self->doPreprocessFrame(workingFrame);
+	self->setWorkingFrameStatusCheckpoint(task.frameNumber, FRAME_STATUS_PREPROCESS, FRAME_CHECKPOINT_FRAMESERVER);
+
+	self->preprocessMetrics->endClock(tick);
 }
 
 void FrameServer::workerDeinitializer(WorkerPoolWorker *worker, void *usrPtr) {
@@ -342,10 +826,11 @@ void FrameServer::workerDeinitializer(WorkerPoolWorker *worker, void *usrPtr) {
 		return;
 	}
 	YerFace_MutexLock(self->myMutex);
-	for(auto callback : self->onFrameServerDrainedCallbacks) {
+	std::vector<FrameServerDrainedEventCallback> callbacks = self->onFrameServerDrainedCallbacks;
+	YerFace_MutexUnlock(self->myMutex);
+	for(auto callback : callbacks) {
 		callback.callback(callback.userdata);
 	}
-	YerFace_MutexUnlock(self->myMutex);
 }
 
 }; //namespace YerFace
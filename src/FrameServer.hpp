@@ -6,8 +6,12 @@
 #include "Utilities.hpp"
 #include "FFmpegDriver.hpp"
 #include "WorkerPool.hpp"
+#include "MarkerType.hpp"
 
 #include <list>
+#include <map>
+#include <atomic>
+#include <typeinfo>
 
 #include "SDL.h"
 
@@ -17,11 +21,18 @@ using namespace std;
 
 namespace YerFace {
 
-#define YERFACE_FRAMESERVER_MAX_QUEUEDEPTH 200
+//Frame store ring capacities. (Must be powers of two.)
+#define YERFACE_FRAMESERVER_RING_CAPACITY_LOWLATENCY 256
+#define YERFACE_FRAMESERVER_RING_CAPACITY_OFFLINE 4096
+
+//Offline, if no frame releases its bitmaps for this long while admission is blocked, the byte budget is suspended until one does.
+#define YERFACE_FRAMESERVER_ADMISSION_STALL_SECONDS 5.0
 
 class VideoFrame;
+class VideoFrameBacking;
 class WorkerPool;
 class WorkerPoolWorker;
+class WorkerPoolTask;
 
 #define FRAME_STATUS_MAX 9
 enum WorkingFrameStatus: unsigned int {
@@ -36,17 +47,99 @@ enum WorkingFrameStatus: unsigned int {
 	FRAME_STATUS_GONE = 8 //This frame is about to be freed and purged from the frame store. (No checkpoints can be registered for this status!)
 };
 
+//Checkpoints are interned at compile time, so each frame can track them with a simple bitmask per status.
+#define FRAME_CHECKPOINT_MAX 7
+enum FrameStatusCheckpoint: unsigned int {
+	FRAME_CHECKPOINT_EVENTLOGGER = 0, //EventLogger has replayed any events for this frame.
+	FRAME_CHECKPOINT_FACEDETECTOR = 1, //FaceDetector has assigned a face detection to this frame.
+	FRAME_CHECKPOINT_FACETRACKER = 2, //FaceTracker has assigned landmarks and pose to this frame.
+	FRAME_CHECKPOINT_FACEMAPPER = 3, //FaceMapper has mapped markers for this frame.
+	FRAME_CHECKPOINT_SPHINXDRIVER = 4, //SphinxDriver has processed audio for this frame.
+	FRAME_CHECKPOINT_OUTPUTDRIVER = 5, //OutputDriver has emitted this frame.
+	FRAME_CHECKPOINT_PREVIEWDISPLAYED = 6, //The main loop has displayed this frame's preview.
+	FRAME_CHECKPOINT_FRAMESERVER = 7 //FrameServer has prepared the preview and detection frames.
+};
+typedef uint32_t FrameCheckpointMask;
+#define FRAME_CHECKPOINT_BIT(checkpoint) ((FrameCheckpointMask)1 << (checkpoint))
+
+//Per-frame results which the pipeline stages publish onto each WorkingFrame. (See WorkingFrame::publishResult().)
+enum FrameResultSlot: unsigned int {
+	FRAME_RESULT_FACEDETECTION = 0, //FacialDetectionBox, published by FaceDetector when it assigns a detection to the frame.
+	FRAME_RESULT_FACEPREDICTION = 1, //FaceTrackerOutput with raw landmarks only, published by the FaceTracker predictor.
+	FRAME_RESULT_FACETRACKER = 2, //FaceTrackerOutput with pose, published by FaceTracker assignment.
+	FRAME_RESULT_MARKERS = 3 //MarkerPoint, published by each MarkerTracker. (One slot per MarkerTypeEnum, counting up from here.)
+};
+#define FRAME_RESULT_MAX (FRAME_RESULT_MARKERS + NoMarkerAssigned)
+
+class WorkingFrameResult {
+public:
+	std::atomic<const void *> value; //NULL until published. Immutable afterward.
+	const std::type_info *type; //Written before value is published.
+	void (*destroy)(const void *value);
+};
+
 class WorkingFrame {
 public:
-	cv::Mat frame; //BGR format, at the native resolution of the input.
-	cv::Mat detectionFrame; //BGR, scaled down to DetectionScaleFactor.
+	// Results are write-once. The producer publishes an immutable copy with a
+	// release store, and consumers read it by reference with an acquire load,
+	// so neither side takes a lock. Published results live until the frame is
+	// destroyed (after FRAME_STATUS_GONE), so references remain valid for as
+	// long as the frame itself is.
+	template<typename T> void publishResult(unsigned int slot, const T &result) {
+		WorkingFrameResult *myResult = getResultSlot(slot);
+		if(myResult->value.load(std::memory_order_relaxed) != NULL) {
+			throw logic_error("Frame result was published twice!");
+		}
+		myResult->type = &typeid(T);
+		myResult->destroy = destroyResult<T>;
+		myResult->value.store(new T(result), std::memory_order_release);
+	}
+	template<typename T> const T *getResult(unsigned int slot) { //NULL if nothing has been published yet.
+		WorkingFrameResult *myResult = getResultSlot(slot);
+		const void *value = myResult->value.load(std::memory_order_acquire);
+		if(value == NULL) {
+			return NULL;
+		}
+		if(*myResult->type != typeid(T)) {
+			throw logic_error("Frame result was read as the wrong type!");
+		}
+		return (const T *)value;
+	}
+	void initializeResults(void);
+	void destroyResults(void);
+
+
+	cv::Mat frame; //BGR format, at the native resolution of the input. (Points directly into frameBacking, so do not write to it!)
+	VideoFrameBacking *frameBacking; //Reference to the decoder's frame memory, held until bitmaps are released after FRAME_STATUS_PREVIEW_DISPLAY.
+	cv::Mat detectionFrame; //BGR, scaled down to DetectionScaleFactor. (Usually produced by the decoder, see VideoFrame::detectionFrameCV.)
 	double detectionScaleFactor;
 	cv::Mat previewFrame; //BGR, same as the input frame, but possibly with some HUD stuff scribbled onto it.
 	SDL_mutex *previewFrameMutex; //IMPORTANT - make sure you lock previewFrameMutex before WRITING TO or READING FROM previewFrame.
 	FrameTimestamps frameTimestamps;
+	size_t bitmapBytes; //Bytes this frame counts against the admission budget, until its bitmaps are released.
+	MetricsTick latencyTick; //Started when the frame is admitted, ended when its bitmaps are released.
+	int qualityLevel; //LatencyController quality level in effect when the frame was admitted, or -1 if there is no controller.
+	string qualityReason; //...and why the controller moved to that level.
+	SDL_atomic_t affinityThread; //WorkScheduler thread number which last touched this frame's bitmaps, or zero. (See WorkScheduler::touchFrame().)
+	SDL_atomic_t affinityCPU; //CPU which last touched this frame's bitmaps, plus one, or zero.
 
 	WorkingFrameStatus status;
-	unordered_map<string, bool> checkpoints[FRAME_STATUS_MAX + 1];
+	FrameCheckpointMask checkpoints[FRAME_STATUS_MAX + 1]; //Bits are set for each checkpoint which has NOT been passed yet.
+private:
+	WorkingFrameResult *getResultSlot(unsigned int slot);
+	template<typename T> static void destroyResult(const void *value) {
+		delete (const T *)value;
+	}
+
+	WorkingFrameResult results[FRAME_RESULT_MAX];
+};
+
+//One slot of the frame store ring. The frame number doubles as a generation tag,
+//so readers can tell whether the slot still holds the frame they asked for.
+class FrameStoreSlot {
+public:
+	std::atomic<FrameNumber> frameNumber; //-1 if the slot is empty.
+	std::atomic<WorkingFrame *> frame;
 };
 
 class FrameStatusChangeEventCallback {
@@ -56,6 +149,21 @@ public:
 	function<void(void *userdata, WorkingFrameStatus newStatus, FrameTimestamps frameTimestamps)> callback;
 };
 
+//A frame status change which was recorded under the FrameServer lock, but whose callbacks have not been dispatched yet.
+class FrameStatusTransition {
+public:
+	FrameTimestamps frameTimestamps;
+	WorkingFrameStatus newStatus;
+};
+
+//Per-stage deadline bookkeeping, for the low latency EDF policy.
+class FrameDeadlineCounters {
+public:
+	FrameNumber tasks;
+	FrameNumber missed; //Tasks which were started after their frame's deadline.
+	FrameNumber shed; //...of which, tasks which were skipped instead of run late.
+};
+
 class FrameServerDrainedEventCallback {
 public:
 	void *userdata;
@@ -70,17 +178,35 @@ public:
 	void setMirrorMode(bool myMirrorMode);
 	void onFrameServerDrainedEvent(FrameServerDrainedEventCallback callback);
 	void onFrameStatusChangeEvent(FrameStatusChangeEventCallback callback);
-	void registerFrameStatusCheckpoint(WorkingFrameStatus status, string checkpointKey);
+	void registerFrameStatusCheckpoint(WorkingFrameStatus status, FrameStatusCheckpoint checkpoint);
 	void insertNewFrame(VideoFrame *videoFrame);
 	WorkingFrame *getWorkingFrame(FrameNumber frameNumber);
-	void setWorkingFrameStatusCheckpoint(FrameNumber frameNumber, WorkingFrameStatus status, string checkpointKey);
+	void setWorkingFrameStatusCheckpoint(FrameNumber frameNumber, WorkingFrameStatus status, FrameStatusCheckpoint checkpoint);
+	double getFrameDeadline(FrameTimestamps frameTimestamps); //Wall clock time (see getWallClock()) by which the frame should be done. Infinity unless we are in low latency mode.
+	bool checkDeadline(string stageName, double deadline, bool shedIfMissed); //Counts a task against the stage, and returns true if its deadline has already passed.
+	static double getWallClock(void);
+	void setDetectionScale(int myDetectionBoundingBox, double myDetectionScaleFactor); //A non-zero bounding box takes precedence over the scale factor.
+	void setQualityLevel(int myQualityLevel, string myQualityReason); //Stamped onto every frame admitted from now on. (See LatencyController.)
+	int getDetectionBoundingBox(void);
+	double getDetectionScaleFactor(void);
+	double calculateDetectionScaleFactor(cv::Size myFrameSize); //Resolves the current bounding box / scale factor settings against a particular frame size.
+	Metrics *getLatencyMetrics(void);
 private:
 	bool isDrained(void);
 	void destroyFrame(FrameNumber frameNumber);
+	void releaseFrameBitmaps(WorkingFrame *workingFrame);
+	bool admitFrame(WorkingFrame *workingFrame);
+	FrameStoreSlot *getFrameStoreSlot(FrameNumber frameNumber);
 	void setFrameStatus(FrameTimestamps frameTimestamps, WorkingFrameStatus newStatus);
+	void advanceFrame(WorkingFrame *workingFrame);
+	void dispatchFrameStatusTransitions(void);
 	void checkStatusValue(WorkingFrameStatus status);
+	void checkCheckpointValue(FrameStatusCheckpoint checkpoint);
+	void doPreprocessFrame(WorkingFrame *workingFrame);
+	static void handleFrameStatusChange(void *userdata, WorkingFrameStatus newStatus, FrameTimestamps frameTimestamps);
 	static bool workerHandler(WorkerPoolWorker *worker);
 	static void workerDeinitializer(WorkerPoolWorker *worker, void *usrPtr);
+	static void preprocessTaskHandler(WorkerPoolWorker *worker, WorkerPoolTask task);
 
 	Status *status;
 	bool lowLatency;
@@ -88,20 +214,56 @@ private:
 	bool mirrorMode;
 	int detectionBoundingBox;
 	double detectionScaleFactor;
+	int qualityLevel;
+	string qualityReason;
 	Logger *logger;
 	SDL_mutex *myMutex;
 	Metrics *metrics;
-	cv::Size frameSize;
-	bool frameSizeSet;
 
-	unordered_map<FrameNumber, WorkingFrame *> frameStore;
+	//Frame store is a ring indexed by frame number modulo capacity. Slots are only
+	//written under myMutex, but getWorkingFrame() reads them without locking.
+	FrameStoreSlot *frameStore;
+	size_t frameStoreMask;
+	size_t frameStoreSize;
+	std::list<FrameNumber> readyFrames; //Frames whose checkpoints have all been passed, waiting for the herder to advance them.
+
+	//Admission control. Offline, insertNewFrame() blocks on admissionCond until there
+	//is room. In low latency mode, frames are dropped or decimated at ingest instead.
+	SDL_cond *admissionCond;
+	size_t maxBytesInFlight;
+	size_t bytesInFlight;
+	size_t admissionProgress; //Bumped whenever a frame gives back its bytes or its slot.
+	bool admissionStalled; //Offline only. The byte budget is ignored until admissionProgress moves past admissionStalledProgress.
+	size_t admissionStalledProgress;
+	double maxLatencySeconds; //Low latency mode only. Zero disables latency-based decimation.
+	unsigned int decimationFactor; //While over the latency budget, only one in this many frames is admitted.
+	unsigned int decimationCounter;
+	bool admissionThrottled;
+	Metrics *latencyMetrics;
+	FrameNumber framesBlocked, framesDropped, framesDecimated, framesOverBudget;
+	double blockedSeconds;
+
+	//Deadlines. In low latency mode, a frame is due deadlineSeconds after its presentation time. Presentation
+	//times are mapped onto the wall clock by the smallest (wall clock - presentation time) offset seen at ingest.
+	SDL_mutex *deadlineMutex;
+	double deadlineSeconds;
+	bool deadlineOffsetSet;
+	double deadlineOffset;
+	std::map<string, FrameDeadlineCounters> deadlineCounters;
 
 	std::vector<FrameStatusChangeEventCallback> onFrameStatusChangeCallbacks[FRAME_STATUS_MAX + 1];
-	std::vector<string> statusCheckpoints[FRAME_STATUS_MAX + 1];
+	std::list<FrameStatusTransition> pendingTransitions; //Recorded in order under myMutex, dispatched in the same order without it.
+	bool dispatchingTransitions; //True while the herder is draining pendingTransitions.
+	FrameCheckpointMask statusCheckpoints[FRAME_STATUS_MAX + 1];
 
 	std::vector<FrameServerDrainedEventCallback> onFrameServerDrainedCallbacks;
 
 	WorkerPool *workerPool;
+
+	SDL_mutex *preprocessMutex;
+	double reportedDetectionScaleFactor; //Guarded by preprocessMutex. Only used to avoid logging the same scale factor for every frame.
+	Metrics *preprocessMetrics;
+	WorkerPool *preprocessWorkerPool;
 };
 
 }; //namespace YerFace
@@ -0,0 +1,219 @@
+
+#include "LatencyController.hpp"
+#include "Metrics.hpp"
+#include "Utilities.hpp"
+
+#include <cstdio>
+
+using namespace std;
+
+namespace YerFace {
+
+LatencyController *LatencyController::instance = NULL;
+
+LatencyController::LatencyController(json config, Status *myStatus, FrameServer *myFrameServer, FaceDetector *myFaceDetector, FaceTracker *myFaceTracker) {
+	status = myStatus;
+	if(status == NULL) {
+		throw invalid_argument("status cannot be NULL");
+	}
+	frameServer = myFrameServer;
+	if(frameServer == NULL) {
+		throw invalid_argument("frameServer cannot be NULL");
+	}
+	faceDetector = myFaceDetector;
+	if(faceDetector == NULL) {
+		throw invalid_argument("faceDetector cannot be NULL");
+	}
+	faceTracker = myFaceTracker;
+	if(faceTracker == NULL) {
+		throw invalid_argument("faceTracker cannot be NULL");
+	}
+	if(instance != NULL) {
+		throw logic_error("Only one LatencyController may exist at a time!");
+	}
+	logger = new Logger("LatencyController");
+	if((myMutex = SDL_CreateMutex()) == NULL) {
+		throw runtime_error("Failed creating mutex!");
+	}
+	if((myCond = SDL_CreateCond()) == NULL) {
+		throw runtime_error("Failed creating condition!");
+	}
+
+	targetLatencySeconds = config["YerFace"]["LatencyController"]["targetLatencySeconds"];
+	if(targetLatencySeconds <= 0.0) {
+		throw invalid_argument("targetLatencySeconds is nonsense.");
+	}
+	evaluateEverySeconds = config["YerFace"]["LatencyController"]["evaluateEverySeconds"];
+	if(evaluateEverySeconds <= 0.0) {
+		throw invalid_argument("evaluateEverySeconds is nonsense.");
+	}
+	settleSeconds = config["YerFace"]["LatencyController"]["settleSeconds"];
+	if(settleSeconds < 0.0) {
+		throw invalid_argument("settleSeconds is nonsense.");
+	}
+	//FrameServer.Latency is averaged over this window. Until a whole window has passed since our last
+	//change, most of the samples predate it, and we would keep stepping down on stale latency.
+	double averageOverSeconds = config["YerFace"]["Metrics"]["averageOverSeconds"];
+	if(settleSeconds < averageOverSeconds) {
+		logger->warning("settleSeconds (%.02lf) is shorter than the metrics averaging window. Using %.02lf seconds instead.", settleSeconds, averageOverSeconds);
+		settleSeconds = averageOverSeconds;
+	}
+	recoverBelowFraction = config["YerFace"]["LatencyController"]["recoverBelowFraction"];
+	if(recoverBelowFraction <= 0.0 || recoverBelowFraction >= 1.0) {
+		throw invalid_argument("recoverBelowFraction must be between zero and one.");
+	}
+	recoverAfterSeconds = config["YerFace"]["LatencyController"]["recoverAfterSeconds"];
+	if(recoverAfterSeconds < 0.0) {
+		throw invalid_argument("recoverAfterSeconds is nonsense.");
+	}
+
+	//Level zero is the configuration we were started with.
+	LatencyControllerLevel baseline;
+	baseline.detectionBoundingBox = frameServer->getDetectionBoundingBox();
+	baseline.detectionScaleFactor = frameServer->getDetectionScaleFactor();
+	baseline.useFullSizedFrameForLandmarkDetection = faceTracker->getUseFullSizedFrameForLandmarkDetection();
+	baseline.detectionIntervalSeconds = faceDetector->getDetectionIntervalSeconds();
+	levels.push_back(baseline);
+	for(json levelConfig : config["YerFace"]["LatencyController"]["levels"]) {
+		LatencyControllerLevel myLevel = levels.back();
+		if(levelConfig.contains("detectionBoundingBox")) {
+			myLevel.detectionBoundingBox = levelConfig["detectionBoundingBox"];
+			if(myLevel.detectionBoundingBox < 0) {
+				throw invalid_argument("Latency controller level has an invalid detectionBoundingBox.");
+			}
+		}
+		if(levelConfig.contains("detectionScaleFactor")) {
+			myLevel.detectionScaleFactor = levelConfig["detectionScaleFactor"];
+			if(myLevel.detectionScaleFactor < 0.0 || myLevel.detectionScaleFactor > 1.0) {
+				throw invalid_argument("Latency controller level has an invalid detectionScaleFactor.");
+			}
+		}
+		if(levelConfig.contains("useFullSizedFrameForLandmarkDetection")) {
+			myLevel.useFullSizedFrameForLandmarkDetection = levelConfig["useFullSizedFrameForLandmarkDetection"];
+		}
+		if(levelConfig.contains("detectionIntervalSeconds")) {
+			myLevel.detectionIntervalSeconds = levelConfig["detectionIntervalSeconds"];
+			if(myLevel.detectionIntervalSeconds < 0.0) {
+				throw invalid_argument("Latency controller level has an invalid detectionIntervalSeconds.");
+			}
+		}
+		levels.push_back(myLevel);
+	}
+
+	level = 0;
+	levelReason = "initial configuration";
+	frameServer->setQualityLevel(level, levelReason);
+	lastChange = FrameServer::getWallClock();
+	underTargetSince = -1.0;
+	for(size_t i = 0; i < levels.size(); i++) {
+		logger->debug1("Quality level %lu: %s", i, describeLevel((int)i).c_str());
+	}
+
+	running = true;
+	if((controllerThread = SDL_CreateThread(controllerLoop, "LatencyController", (void *)this)) == NULL) {
+		throw runtime_error("Failed starting thread!");
+	}
+
+	instance = this;
+	logger->debug1("LatencyController object constructed with a target of %.01lfms across %lu quality levels.", targetLatencySeconds * 1000.0, levels.size());
+}
+
+LatencyController::~LatencyController() noexcept(false) {
+	logger->debug1("LatencyController object destructing...");
+
+	instance = NULL;
+
+	YerFace_MutexLock(myMutex);
+	running = false;
+	SDL_CondBroadcast(myCond);
+	YerFace_MutexUnlock(myMutex);
+
+	SDL_WaitThread(controllerThread, NULL);
+
+	logger->info("Finished at quality level %d (%s).", level, levelReason.c_str());
+
+	SDL_DestroyCond(myCond);
+	SDL_DestroyMutex(myMutex);
+	delete logger;
+}
+
+LatencyController *LatencyController::getInstance(void) {
+	return instance;
+}
+
+string LatencyController::describeLevel(int myLevel) {
+	LatencyControllerLevel settings = levels[myLevel];
+	char description[METRICS_STRING_LENGTH];
+	if(settings.detectionBoundingBox > 0) {
+		snprintf(description, METRICS_STRING_LENGTH, "detection box %dpx, landmarks on %s frame, detection every %.02lfs", settings.detectionBoundingBox, settings.useFullSizedFrameForLandmarkDetection ? "full sized" : "detection", settings.detectionIntervalSeconds);
+	} else {
+		snprintf(description, METRICS_STRING_LENGTH, "detection scale %.02lf, landmarks on %s frame, detection every %.02lfs", settings.detectionScaleFactor, settings.useFullSizedFrameForLandmarkDetection ? "full sized" : "detection", settings.detectionIntervalSeconds);
+	}
+	return (string)description;
+}
+
+void LatencyController::applyLevel(int newLevel, string reason) {
+	// NOTE: Caller must hold myMutex.
+	LatencyControllerLevel settings = levels[newLevel];
+	frameServer->setDetectionScale(settings.detectionBoundingBox, settings.detectionScaleFactor);
+	faceTracker->setUseFullSizedFrameForLandmarkDetection(settings.useFullSizedFrameForLandmarkDetection);
+	faceDetector->setDetectionIntervalSeconds(settings.detectionIntervalSeconds);
+	frameServer->setQualityLevel(newLevel, reason);
+	logger->notice("%s quality from level %d to level %d because %s. Now using %s.", newLevel > level ? "Reducing" : "Restoring", level, newLevel, reason.c_str(), describeLevel(newLevel).c_str());
+	level = newLevel;
+	levelReason = reason;
+	lastChange = FrameServer::getWallClock();
+}
+
+void LatencyController::evaluate(void) {
+	// NOTE: Caller must hold myMutex.
+	double latency = frameServer->getLatencyMetrics()->getAverageTimeSeconds();
+	if(latency <= 0.0) {
+		//No frames have made it all the way through yet.
+		return;
+	}
+	double now = FrameServer::getWallClock();
+	char reason[METRICS_STRING_LENGTH];
+	if(latency > targetLatencySeconds) {
+		underTargetSince = -1.0;
+		if(level + 1 < (int)levels.size() && now - lastChange >= settleSeconds) {
+			snprintf(reason, METRICS_STRING_LENGTH, "average latency %.01lfms is over the %.01lfms target", latency * 1000.0, targetLatencySeconds * 1000.0);
+			applyLevel(level + 1, reason);
+		}
+	} else if(latency < targetLatencySeconds * recoverBelowFraction) {
+		if(underTargetSince < 0.0) {
+			underTargetSince = now;
+		}
+		if(level > 0 && now - underTargetSince >= recoverAfterSeconds && now - lastChange >= settleSeconds) {
+			snprintf(reason, METRICS_STRING_LENGTH, "average latency %.01lfms has stayed under %.01lfms for %.01lfs", latency * 1000.0, targetLatencySeconds * recoverBelowFraction * 1000.0, now - underTargetSince);
+			applyLevel(level - 1, reason);
+			underTargetSince = now;
+		}
+	} else {
+		underTargetSince = -1.0;
+	}
+}
+
+int LatencyController::controllerLoop(void *ptr) {
+	LatencyController *self = (LatencyController *)ptr;
+	try {
+		YerFace_MutexLock(self->myMutex);
+		while(self->running) {
+			int result = SDL_CondWaitTimeout(self->myCond, self->myMutex, (Uint32)(self->evaluateEverySeconds * 1000.0));
+			if(result < 0) {
+				throw runtime_error("CondWaitTimeout() failed!");
+			}
+			if(self->running && !self->status->getIsPaused()) {
+				self->evaluate();
+			}
+		}
+		YerFace_MutexUnlock(self->myMutex);
+		return 0;
+	} catch(exception &e) {
+		self->logger->emerg("Uncaught exception in controller thread: %s\n", e.what());
+		self->status->setEmergency();
+	}
+	return 1;
+}
+
+}; //namespace YerFace
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Logger.hpp"
+#include "Status.hpp"
+#include "FrameServer.hpp"
+#include "FaceDetector.hpp"
+#include "FaceTracker.hpp"
+#include "Utilities.hpp"
+
+#include "SDL.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace YerFace {
+
+class LatencyControllerLevel {
+public:
+	int detectionBoundingBox;
+	double detectionScaleFactor;
+	bool useFullSizedFrameForLandmarkDetection;
+	double detectionIntervalSeconds;
+};
+
+// Keeps live (low latency) runs under YerFace.LatencyController.targetLatencySeconds
+// by trading away quality. Level zero is whatever the modules were configured
+// with, and each entry in YerFace.LatencyController.levels is one step
+// cheaper than the last (keys which are left out carry over from the previous
+// level). Feedback is FrameServer.Latency, the average time from admission to
+// preview display. Over the target, we step down one level at a time (waiting
+// settleSeconds between steps so the metrics can catch up, which is never less
+// than the metrics averaging window). Comfortably under the target
+// (recoverBelowFraction) for recoverAfterSeconds, we step back up. Each frame
+// is stamped with the level in effect when it was admitted, which is what the
+// output reports.
+class LatencyController {
+public:
+	LatencyController(json config, Status *myStatus, FrameServer *myFrameServer, FaceDetector *myFaceDetector, FaceTracker *myFaceTracker);
+	~LatencyController() noexcept(false);
+	static LatencyController *getInstance(void); //Returns NULL if no controller is running.
+private:
+	void evaluate(void);
+	void applyLevel(int newLevel, string reason);
+	string describeLevel(int myLevel);
+	static int controllerLoop(void *ptr);
+
+	Status *status;
+	FrameServer *frameServer;
+	FaceDetector *faceDetector;
+	FaceTracker *faceTracker;
+	Logger *logger;
+	SDL_mutex *myMutex;
+	SDL_cond *myCond;
+	SDL_Thread *controllerThread;
+	bool running;
+
+	double targetLatencySeconds;
+	double evaluateEverySeconds;
+	double settleSeconds;
+	double recoverBelowFraction;
+	double recoverAfterSeconds;
+	std::vector<LatencyControllerLevel> levels;
+
+	int level;
+	string levelReason;
+	double lastChange;
+	double underTargetSince; //Negative while we are not comfortably under the target.
+
+	static LatencyController *instance;
+};
+
+}; //namespace YerFace
@@ -55,10 +55,12 @@ MarkerTracker::MarkerTracker(json config, MarkerType myMarkerType, FaceMapper *m
 	frameServer = faceMapper->getFrameServer();
 	faceTracker = faceMapper->getFaceTracker();
 
+	unassignedMarkerPoint.set = false;
 	previouslyReportedMarkerPoint.set = false;
 	previouslyReportedMarkerPoint.timestamp.startTimestamp = -1.0;
 	previouslyReportedMarkerPoint.timestamp.estimatedEndTimestamp = -1.0;
 	previouslyReportedMarkerPoint.timestamp.frameNumber = -1;
+	penultimateReportedMarkerPoint = previouslyReportedMarkerPoint;
 
 	if((myMutex = SDL_CreateMutex()) == NULL) {
 		throw runtime_error("Failed creating mutex!");
@@ -91,21 +93,30 @@ void MarkerTracker::processFrame(FrameNumber frameNumber) {
 	MarkerPoint markerPoint;
 	markerPoint.set = false;
 
+	WorkingFrame *workingFrame = frameServer->getWorkingFrame(frameNumber);
+
+	//Frames which skipped landmark prediction have no features to work from.
+	if(faceTracker->getIsSynthesized(frameNumber)) {
+		YerFace_MutexLock(myMutex);
+		extrapolateMarkerPoint(workingFrame, &markerPoint);
+		YerFace_MutexUnlock(myMutex);
+		workingFrame->publishResult(FRAME_RESULT_MARKERS + markerType.type, markerPoint);
+		return;
+	}
+
 	assignMarkerPoint(frameNumber, &markerPoint);
 
 	calculate3dMarkerPoint(frameNumber, &markerPoint);
 
-	WorkingFrame *workingFrame = frameServer->getWorkingFrame(frameNumber);
-
 	YerFace_MutexLock(myMutex);
 	performMarkerPointValidationAndSmoothing(workingFrame, frameNumber, &markerPoint);
-
-	markerPoints[frameNumber] = markerPoint;
 	YerFace_MutexUnlock(myMutex);
+
+	workingFrame->publishResult(FRAME_RESULT_MARKERS + markerType.type, markerPoint);
 }
 
 void MarkerTracker::assignMarkerPoint(FrameNumber frameNumber, MarkerPoint *markerPoint) {
-	FacialFeatures facialFeatures = faceTracker->getFacialFeatures(frameNumber);
+	const FacialFeatures &facialFeatures = faceTracker->getFacialFeatures(frameNumber);
 	if(!facialFeatures.set) {
 		return;
 	}
@@ -243,7 +254,7 @@ void MarkerTracker::calculate3dMarkerPoint(FrameNumber frameNumber, MarkerPoint
 	if(!markerPoint->set) {
 		return;
 	}
-	FacialPose facialPose = faceTracker->getFacialPose(frameNumber);
+	const FacialPose &facialPose = faceTracker->getFacialPose(frameNumber);
 	FacialCameraModel cameraModel = faceTracker->getFacialCameraModel();
 	if(!facialPose.set || !cameraModel.set) {
 		markerPoint->set = false;
@@ -292,6 +303,7 @@ void MarkerTracker::performMarkerPointValidationAndSmoothing(WorkingFrame *worki
 			if(markerPoint->timestamp.startTimestamp - previouslyReportedMarkerPoint.timestamp.startTimestamp >= markerRejectionResetAfterSeconds) {
 				logger->notice("Marker position has come back bad consistantly for %.02lf seconds! Unsetting the marker completely.", markerPoint->timestamp.startTimestamp - previouslyReportedMarkerPoint.timestamp.startTimestamp);
 				previouslyReportedMarkerPoint.set = false;
+				penultimateReportedMarkerPoint.set = false;
 			}
 			*markerPoint = previouslyReportedMarkerPoint;
 			YerFace_MutexUnlock(myMutex);
@@ -333,6 +345,7 @@ void MarkerTracker::performMarkerPointValidationAndSmoothing(WorkingFrame *worki
 
 	if(reportNewPoint) {
 		*markerPoint = tempPoint;
+		penultimateReportedMarkerPoint = previouslyReportedMarkerPoint;
 		previouslyReportedMarkerPoint = *markerPoint;
 	} else {
 		*markerPoint = previouslyReportedMarkerPoint;
@@ -341,6 +354,28 @@ void MarkerTracker::performMarkerPointValidationAndSmoothing(WorkingFrame *worki
 	YerFace_MutexUnlock(myMutex);
 }
 
+void MarkerTracker::extrapolateMarkerPoint(WorkingFrame *workingFrame, MarkerPoint *markerPoint) {
+	// NOTE: Caller must hold myMutex.
+	FrameTimestamps frameTimestamps = workingFrame->frameTimestamps;
+	markerPoint->set = false;
+	if(!previouslyReportedMarkerPoint.set) {
+		return;
+	}
+	double elapsed = frameTimestamps.startTimestamp - previouslyReportedMarkerPoint.timestamp.startTimestamp;
+	if(elapsed >= markerRejectionResetAfterSeconds) {
+		return;
+	}
+	*markerPoint = previouslyReportedMarkerPoint;
+	markerPoint->timestamp = frameTimestamps;
+	double step = previouslyReportedMarkerPoint.timestamp.startTimestamp - penultimateReportedMarkerPoint.timestamp.startTimestamp;
+	if(!penultimateReportedMarkerPoint.set || step <= 0.0 || elapsed <= 0.0) {
+		return;
+	}
+	double progress = elapsed / step;
+	markerPoint->point = previouslyReportedMarkerPoint.point + (previouslyReportedMarkerPoint.point - penultimateReportedMarkerPoint.point) * progress;
+	markerPoint->point3d = previouslyReportedMarkerPoint.point3d + (previouslyReportedMarkerPoint.point3d - penultimateReportedMarkerPoint.point3d) * progress;
+}
+
 void MarkerTracker::renderPreviewHUD(Mat frame, FrameNumber frameNumber, int density, bool mirrorMode) {
 	Scalar color = Scalar(0, 0, 255);
 	if(markerType.type == EyelidLeftBottom || markerType.type == EyelidRightBottom || markerType.type == EyelidLeftTop || markerType.type == EyelidRightTop) {
@@ -368,37 +403,22 @@ void MarkerTracker::renderPreviewHUD(Mat frame, FrameNumber frameNumber, int den
 			color[1] = 127;
 		}
 	}
-	YerFace_MutexLock(myMutex);
-	if(density > 0 && markerPoints[frameNumber].set) {
-		cv::Point2d point = markerPoints[frameNumber].point;
+	const MarkerPoint &markerPoint = getMarkerPoint(frameNumber);
+	if(density > 0 && markerPoint.set) {
+		cv::Point2d point = markerPoint.point;
 		if(mirrorMode) {
 			point.x = frame.size().width - point.x;
 		}
 		Utilities::drawX(frame, point, color, 10, 2); // FIXME - proportional drawing
 	}
-	YerFace_MutexUnlock(myMutex);
-}
-
-void MarkerTracker::frameStatusNew(FrameNumber frameNumber) {
-	MarkerPoint markerPoint;
-	markerPoint.set = false;
-	YerFace_MutexLock(myMutex);
-	markerPoints[frameNumber] = markerPoint;
-	YerFace_MutexUnlock(myMutex);
 }
 
-void MarkerTracker::frameStatusGone(FrameNumber frameNumber) {
-	YerFace_MutexLock(myMutex);
-	markerPoints.erase(frameNumber);
-	YerFace_MutexUnlock(myMutex);
-}
-
-MarkerPoint MarkerTracker::getMarkerPoint(FrameNumber frameNumber) {
-	MarkerPoint val;
-	YerFace_MutexLock(myMutex);
-	val = markerPoints[frameNumber];
-	YerFace_MutexUnlock(myMutex);
-	return val;
+const MarkerPoint &MarkerTracker::getMarkerPoint(FrameNumber frameNumber) {
+	const MarkerPoint *markerPoint = frameServer->getWorkingFrame(frameNumber)->getResult<MarkerPoint>(FRAME_RESULT_MARKERS + markerType.type);
+	if(markerPoint == NULL) {
+		return unassignedMarkerPoint;
+	}
+	return *markerPoint;
 }
 
 vector<MarkerTracker *> MarkerTracker::markerTrackers;
@@ -33,15 +33,14 @@ public:
 	MarkerType getMarkerType(void);
 	void processFrame(FrameNumber frameNumber);
 	void renderPreviewHUD(cv::Mat frame, FrameNumber frameNumber, int density, bool mirrorMode);
-	void frameStatusNew(FrameNumber frameNumber);
-	void frameStatusGone(FrameNumber frameNumber);
-	MarkerPoint getMarkerPoint(FrameNumber frameNumber);
+	const MarkerPoint &getMarkerPoint(FrameNumber frameNumber); //Valid until the frame is gone.
 	static vector<MarkerTracker *> getMarkerTrackers(void);
 	static MarkerTracker *getMarkerTrackerByType(MarkerType markerType);
 private:
 	void assignMarkerPoint(FrameNumber frameNumber, MarkerPoint *markerPoint);
 	void calculate3dMarkerPoint(FrameNumber frameNumber, MarkerPoint *markerPoint);
 	void performMarkerPointValidationAndSmoothing(WorkingFrame *workingFrame, FrameNumber frameNumber, MarkerPoint *markerPoint);
+	void extrapolateMarkerPoint(WorkingFrame *workingFrame, MarkerPoint *markerPoint);
 	
 	static vector<MarkerTracker *> markerTrackers;
 	static SDL_mutex *myStaticMutex;
@@ -61,7 +60,8 @@ private:
 	SDL_mutex *myMutex;
 	list<MarkerPoint> markerPointSmoothingBuffer;
 	MarkerPoint previouslyReportedMarkerPoint;
-	unordered_map<FrameNumber, MarkerPoint> markerPoints;
+	MarkerPoint penultimateReportedMarkerPoint; //Together with previouslyReportedMarkerPoint, gives us a velocity for extrapolation.
+	MarkerPoint unassignedMarkerPoint; //Read by frames which have not been processed yet.
 };
 
 }; //namespace YerFace
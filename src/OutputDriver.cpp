@@ -188,6 +188,7 @@ OutputDriver::OutputDriver(json config, string myOutputFilename, Status *myStatu
 	if((workerMutex = SDL_CreateMutex()) == NULL) {
 		throw runtime_error("Failed creating mutex!");
 	}
+	outputFrameQueue = new SequencedFrameQueue("OutputDriver");
 	if((rawEventsMutex = SDL_CreateMutex()) == NULL) {
 		throw runtime_error("Failed creating mutex!");
 	}
@@ -306,12 +307,13 @@ OutputDriver::OutputDriver(json config, string myOutputFilename, Status *myStatu
 	frameServer->onFrameStatusChangeEvent(frameStatusChangeCallback);
 
 	//We also want to introduce a checkpoint so that frames cannot TRANSITION AWAY from FRAME_STATUS_DRAINING without our blessing.
-	frameServer->registerFrameStatusCheckpoint(FRAME_STATUS_DRAINING, "outputDriver.ran");
+	frameServer->registerFrameStatusCheckpoint(FRAME_STATUS_DRAINING, FRAME_CHECKPOINT_OUTPUTDRIVER);
 
 	WorkerPoolParameters workerPoolParameters;
 	workerPoolParameters.name = "OutputDriver";
 	workerPoolParameters.numWorkers = 1;
 	workerPoolParameters.numWorkersPerCPU = 0.0;
+	workerPoolParameters.dedicatedThreads = false;
 	workerPoolParameters.initializer = NULL;
 	workerPoolParameters.deinitializer = NULL;
 	workerPoolParameters.usrPtr = (void *)this;
@@ -343,6 +345,7 @@ OutputDriver::~OutputDriver() noexcept(false) {
 	SDL_DestroyMutex(basisMutex);
 	SDL_DestroyMutex(webSocketServer->websocketMutex);
 	SDL_DestroyMutex(workerMutex);
+	delete outputFrameQueue;
 
 	if(outputFilename.length() > 0 && outputFilestream.is_open()) {
 		outputFilestream.close();
@@ -422,9 +425,16 @@ void OutputDriver::handleOutputFrame(OutputFrameContainer *outputFrame) {
 		//Default basis unless set earlier.
 		outputFrame->frame["meta"]["basis"] = false;
 	}
+	//Synthesized frames skipped landmark prediction (because they were late) and carry extrapolated pose and marker data.
+	outputFrame->frame["meta"]["synthesized"] = faceTracker->getIsSynthesized(outputFrame->frameTimestamps.frameNumber);
+	//Let consumers know when (and why) the latency controller had traded away quality for this frame.
+	WorkingFrame *workingFrame = frameServer->getWorkingFrame(outputFrame->frameTimestamps.frameNumber);
+	if(workingFrame->qualityLevel >= 0) {
+		outputFrame->frame["meta"]["quality"] = { {"level", workingFrame->qualityLevel}, {"reason", workingFrame->qualityReason} };
+	}
 
 	bool allPropsSet = true;
-	FacialPose facialPose = faceTracker->getFacialPose(outputFrame->frameTimestamps.frameNumber);
+	const FacialPose &facialPose = faceTracker->getFacialPose(outputFrame->frameTimestamps.frameNumber);
 	if(facialPose.set) {
 		outputFrame->frame["pose"] = json::object();
 		Vec3d angles = Utilities::rotationMatrixToEulerAngles(facialPose.rotationMatrix);
@@ -437,7 +447,7 @@ void OutputDriver::handleOutputFrame(OutputFrameContainer *outputFrame) {
 	json trackers;
 	auto markerTrackers = MarkerTracker::getMarkerTrackers();
 	for(auto markerTracker : markerTrackers) {
-		MarkerPoint markerPoint = markerTracker->getMarkerPoint(outputFrame->frameTimestamps.frameNumber);
+		const MarkerPoint &markerPoint = markerTracker->getMarkerPoint(outputFrame->frameTimestamps.frameNumber);
 		if(markerPoint.set) {
 			string trackerName = markerTracker->getMarkerType().toString();
 			trackers[trackerName.c_str()]["position"] = { {"x", markerPoint.point3d.x}, {"y", markerPoint.point3d.y}, {"z", markerPoint.point3d.z} };
@@ -483,7 +493,14 @@ void OutputDriver::insertFrameData(string key, json value, FrameNumber frameNumb
 	}
 	pendingFrames[frameNumber].frame[key] = value;
 	pendingFrames[frameNumber].waitingOn[key] = false;
+	bool outputReady = false;
+	if(pendingFrames[frameNumber].isReady()) {
+		outputReady = outputFrameQueue->setFrameReady(frameNumber);
+	}
 	YerFace_MutexUnlock(workerMutex);
+	if(outputReady && workerPool != NULL) {
+		workerPool->sendWorkerSignal();
+	}
 }
 
 void OutputDriver::outputNewFrame(json frame) {
@@ -521,21 +538,11 @@ bool OutputDriver::workerHandler(WorkerPoolWorker *worker) {
 
 	YerFace_MutexLock(self->workerMutex);
 	//// CHECK FOR WORK ////
-	for(auto pendingFramePair : self->pendingFrames) {
-		if(myFrameNumber < 0 || pendingFramePair.first < myFrameNumber) {
-			if(!self->pendingFrames[pendingFramePair.first].outputProcessed) {
-				myFrameNumber = pendingFramePair.first;
-			}
-		}
-	}
-	if(myFrameNumber > 0) {
+	FrameTimestamps nextFrameTimestamps;
+	if(self->outputFrameQueue->popNextReadyFrame(&nextFrameTimestamps)) {
+		myFrameNumber = nextFrameTimestamps.frameNumber;
 		outputFrame = &self->pendingFrames[myFrameNumber];
 	}
-	if(outputFrame != NULL && !outputFrame->isReady()) {
-		self->logger->debug4("BLOCKED on frame " YERFACE_FRAMENUMBER_FORMAT " because it is not ready!", myFrameNumber);
-		myFrameNumber = -1;
-		outputFrame = NULL;
-	}
 	YerFace_MutexUnlock(self->workerMutex);
 
 	//// DO THE WORK ////
@@ -553,7 +560,7 @@ bool OutputDriver::workerHandler(WorkerPoolWorker *worker) {
 		outputFrame->outputProcessed = true;
 		YerFace_MutexUnlock(self->workerMutex);
 
-		self->frameServer->setWorkingFrameStatusCheckpoint(outputFrame->frameTimestamps.frameNumber, FRAME_STATUS_DRAINING, "outputDriver.ran");
+		self->frameServer->setWorkingFrameStatusCheckpoint(outputFrame->frameTimestamps.frameNumber, FRAME_STATUS_DRAINING, FRAME_CHECKPOINT_OUTPUTDRIVER);
 
 		didWork = true;
 	}
@@ -567,6 +574,7 @@ void OutputDriver::handleFrameStatusChange(void *userdata, WorkingFrameStatus ne
 	unordered_map<string, json> eventBuffer;
 	unordered_map<string, json>::iterator eventBufferIter;
 	static OutputFrameContainer newOutputFrame;
+	bool outputReady;
 	switch(newStatus) {
 		default:
 			throw logic_error("Handler passed unsupported frame status change event!");
@@ -584,6 +592,7 @@ void OutputDriver::handleFrameStatusChange(void *userdata, WorkingFrameStatus ne
 				newOutputFrame.waitingOn[waitOn] = true;
 			}
 			self->pendingFrames[frameNumber] = newOutputFrame;
+			self->outputFrameQueue->insertFrame(frameTimestamps);
 			YerFace_MutexUnlock(self->workerMutex);
 			break;
 		case FRAME_STATUS_PREVIEW_DISPLAY:
@@ -628,8 +637,12 @@ void OutputDriver::handleFrameStatusChange(void *userdata, WorkingFrameStatus ne
 			YerFace_MutexLock(self->workerMutex);
 			self->logger->debug4("handleFrameStatusChange() Frame #" YERFACE_FRAMENUMBER_FORMAT " waiting on me. Queue depth is now %lu", frameNumber, self->pendingFrames.size());
 			self->pendingFrames[frameNumber].frameIsDraining = true;
+			outputReady = false;
+			if(self->pendingFrames[frameNumber].isReady()) {
+				outputReady = self->outputFrameQueue->setFrameReady(frameNumber);
+			}
 			YerFace_MutexUnlock(self->workerMutex);
-			if(self->workerPool != NULL) {
+			if(outputReady && self->workerPool != NULL) {
 				self->workerPool->sendWorkerSignal();
 			}
 			break;
@@ -9,6 +9,7 @@
 #include "Utilities.hpp"
 #include "Status.hpp"
 #include "WorkerPool.hpp"
+#include "SequencedFrameQueue.hpp"
 
 #include <set>
 
@@ -76,6 +77,7 @@ private:
 	SDL_mutex *workerMutex;
 	list<string> lateFrameWaitOn;
 	unordered_map<FrameNumber, OutputFrameContainer> pendingFrames;
+	SequencedFrameQueue *outputFrameQueue;
 	bool frameServerDrained;
 
 	SDL_mutex *rawEventsMutex;
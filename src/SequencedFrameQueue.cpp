@@ -0,0 +1,113 @@
+
+#include "SequencedFrameQueue.hpp"
+
+using namespace std;
+
+namespace YerFace {
+
+SequencedFrameQueue::SequencedFrameQueue(string myName, size_t initialCapacity) {
+	name = myName;
+	size_t capacity = 1;
+	while(capacity < initialCapacity) {
+		capacity = capacity << 1;
+	}
+	SequencedFrameQueueSlot emptySlot;
+	emptySlot.occupied = false;
+	emptySlot.ready = false;
+	ring.assign(capacity, emptySlot);
+	ringMask = capacity - 1;
+	headFrameNumber = -1;
+	tailFrameNumber = -1;
+	count = 0;
+}
+
+void SequencedFrameQueue::insertFrame(FrameTimestamps frameTimestamps) {
+	FrameNumber frameNumber = frameTimestamps.frameNumber;
+	if(frameNumber < 0) {
+		throw invalid_argument("SequencedFrameQueue<" + name + "> was passed an invalid frame number!");
+	}
+	if(tailFrameNumber >= 0 && frameNumber < tailFrameNumber) {
+		throw logic_error("SequencedFrameQueue<" + name + "> frames were inserted out of order!");
+	}
+	if(count == 0) {
+		headFrameNumber = frameNumber;
+	}
+	size_t span = (size_t)(frameNumber - headFrameNumber) + 1;
+	if(span > ring.size()) {
+		grow(span);
+	}
+	SequencedFrameQueueSlot *slot = getSlot(frameNumber);
+	slot->occupied = true;
+	slot->ready = false;
+	slot->frameTimestamps = frameTimestamps;
+	tailFrameNumber = frameNumber + 1;
+	count++;
+}
+
+bool SequencedFrameQueue::setFrameReady(FrameNumber frameNumber) {
+	if(!contains(frameNumber)) {
+		throw logic_error("SequencedFrameQueue<" + name + "> tried to set a frame ready which is not in the queue!");
+	}
+	getSlot(frameNumber)->ready = true;
+	skipGaps();
+	return frameNumber == headFrameNumber;
+}
+
+bool SequencedFrameQueue::popNextReadyFrame(FrameTimestamps *frameTimestamps) {
+	skipGaps();
+	if(count == 0) {
+		return false;
+	}
+	SequencedFrameQueueSlot *slot = getSlot(headFrameNumber);
+	if(!slot->ready) {
+		return false;
+	}
+	*frameTimestamps = slot->frameTimestamps;
+	slot->occupied = false;
+	slot->ready = false;
+	headFrameNumber++;
+	count--;
+	return true;
+}
+
+bool SequencedFrameQueue::contains(FrameNumber frameNumber) {
+	if(count == 0 || frameNumber < headFrameNumber || frameNumber >= tailFrameNumber) {
+		return false;
+	}
+	return getSlot(frameNumber)->occupied;
+}
+
+size_t SequencedFrameQueue::size(void) {
+	return count;
+}
+
+SequencedFrameQueueSlot *SequencedFrameQueue::getSlot(FrameNumber frameNumber) {
+	return &ring[(size_t)frameNumber & ringMask];
+}
+
+void SequencedFrameQueue::skipGaps(void) {
+	while(count > 0 && !getSlot(headFrameNumber)->occupied) {
+		headFrameNumber++;
+	}
+}
+
+void SequencedFrameQueue::grow(size_t minimumCapacity) {
+	size_t capacity = ring.size();
+	while(capacity < minimumCapacity) {
+		capacity = capacity << 1;
+	}
+	vector<SequencedFrameQueueSlot> oldRing = ring;
+	size_t oldRingMask = ringMask;
+	SequencedFrameQueueSlot emptySlot;
+	emptySlot.occupied = false;
+	emptySlot.ready = false;
+	ring.assign(capacity, emptySlot);
+	ringMask = capacity - 1;
+	if(count > 0) {
+		for(FrameNumber frameNumber = headFrameNumber; frameNumber < tailFrameNumber; frameNumber++) {
+			*getSlot(frameNumber) = oldRing[(size_t)frameNumber & oldRingMask];
+		}
+	}
+}
+
+}; //namespace YerFace
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Utilities.hpp"
+
+#include <vector>
+
+using namespace std;
+
+namespace YerFace {
+
+#define YERFACE_SEQUENCEDFRAMEQUEUE_INITIAL_CAPACITY 256
+
+class SequencedFrameQueueSlot {
+public:
+	bool occupied;
+	bool ready;
+	FrameTimestamps frameTimestamps;
+};
+
+// Ordered queue for pipeline stages which must handle frames strictly in
+// sequence. Frames are inserted (in increasing frame number order) when they
+// appear, marked ready whenever the stage may process them, and handed out
+// only once the lowest pending frame is ready. Storage is a power-of-two ring
+// indexed by frame number, so every operation is O(1). (Gaps in the frame
+// numbering, such as from dropped frames, are skipped over.)
+// NOTE: SequencedFrameQueue is NOT thread safe. Callers must hold their own lock.
+class SequencedFrameQueue {
+public:
+	SequencedFrameQueue(string myName, size_t initialCapacity = YERFACE_SEQUENCEDFRAMEQUEUE_INITIAL_CAPACITY);
+	void insertFrame(FrameTimestamps frameTimestamps);
+	bool setFrameReady(FrameNumber frameNumber); //Returns true if this made the next in-order frame ready. (Time to wake up the worker!)
+	bool popNextReadyFrame(FrameTimestamps *frameTimestamps); //Returns false if the next in-order frame is not ready yet.
+	bool contains(FrameNumber frameNumber);
+	size_t size(void);
+private:
+	SequencedFrameQueueSlot *getSlot(FrameNumber frameNumber);
+	void skipGaps(void);
+	void grow(size_t minimumCapacity);
+
+	string name;
+	vector<SequencedFrameQueueSlot> ring;
+	size_t ringMask;
+	FrameNumber headFrameNumber; //Lowest frame number which may still be pending.
+	FrameNumber tailFrameNumber; //One past the highest frame number inserted so far.
+	size_t count;
+};
+
+}; //namespace YerFace
@@ -136,6 +136,7 @@ SphinxDriver::SphinxDriver(json config, Status *myStatus, FrameServer *myFrameSe
 	workerPoolParameters.name = "SphinxDriver.Recognition";
 	workerPoolParameters.numWorkers = 1;
 	workerPoolParameters.numWorkersPerCPU = 0.0;
+	workerPoolParameters.dedicatedThreads = false;
 	workerPoolParameters.initializer = NULL;
 	workerPoolParameters.deinitializer = recognitionWorkerDeinitializer;
 	workerPoolParameters.usrPtr = (void *)this;
@@ -143,11 +144,12 @@ SphinxDriver::SphinxDriver(json config, Status *myStatus, FrameServer *myFrameSe
 	recognitionWorkerPool = new WorkerPool(config, status, frameServer, workerPoolParameters);
 
 	//We also want to introduce a checkpoint so that frames cannot TRANSITION AWAY from the relevant statuses without our blessing.
-	frameServer->registerFrameStatusCheckpoint(FRAME_STATUS_MAPPING, "sphinxDriver.ran");
+	frameServer->registerFrameStatusCheckpoint(FRAME_STATUS_MAPPING, FRAME_CHECKPOINT_SPHINXDRIVER);
 
 	workerPoolParameters.name = "SphinxDriver.LipFlapping";
 	workerPoolParameters.numWorkers = 1;
 	workerPoolParameters.numWorkersPerCPU = 0.0;
+	workerPoolParameters.dedicatedThreads = false;
 	workerPoolParameters.initializer = NULL;
 	workerPoolParameters.deinitializer = NULL;
 	workerPoolParameters.usrPtr = (void *)this;
@@ -155,11 +157,12 @@ SphinxDriver::SphinxDriver(json config, Status *myStatus, FrameServer *myFrameSe
 	lipFlappingWorkerPool = new WorkerPool(config, status, frameServer, workerPoolParameters);
 
 	if(!lowLatency) {
-		frameServer->registerFrameStatusCheckpoint(FRAME_STATUS_LATE_PROCESSING, "sphinxDriver.ran");
+		frameServer->registerFrameStatusCheckpoint(FRAME_STATUS_LATE_PROCESSING, FRAME_CHECKPOINT_SPHINXDRIVER);
 
 		workerPoolParameters.name = "SphinxDriver.PhonemeBreakdown";
 		workerPoolParameters.numWorkers = 1;
 		workerPoolParameters.numWorkersPerCPU = 0.0;
+		workerPoolParameters.dedicatedThreads = false;
 		workerPoolParameters.initializer = NULL;
 		workerPoolParameters.deinitializer = NULL;
 		workerPoolParameters.usrPtr = (void *)this;
@@ -680,7 +683,7 @@ bool SphinxDriver::lipFlappingWorkerHandler(WorkerPoolWorker *worker) {
 			self->outputDriver->insertFrameData("phonemes", percent, myFrameNumber);
 		}
 
-		self->frameServer->setWorkingFrameStatusCheckpoint(myFrameNumber, FRAME_STATUS_MAPPING, "sphinxDriver.ran");
+		self->frameServer->setWorkingFrameStatusCheckpoint(myFrameNumber, FRAME_STATUS_MAPPING, FRAME_CHECKPOINT_SPHINXDRIVER);
 
 		didWork = true;
 	}
@@ -737,7 +740,7 @@ bool SphinxDriver::phonemeBreakdownWorkerHandler(WorkerPoolWorker *worker) {
 				self->outputDriver->insertFrameData("phonemes", percent, myFrameNumber);
 			}
 
-			self->frameServer->setWorkingFrameStatusCheckpoint(myFrameNumber, FRAME_STATUS_LATE_PROCESSING, "sphinxDriver.ran");
+			self->frameServer->setWorkingFrameStatusCheckpoint(myFrameNumber, FRAME_STATUS_LATE_PROCESSING, FRAME_CHECKPOINT_SPHINXDRIVER);
 			lastFrameNumber = myFrameNumber;
 			didWork = true;
 		}
@@ -12,11 +12,17 @@ Status::Status(bool myLowLatency) {
 	if((myMutex = SDL_CreateMutex()) == NULL) {
 		throw runtime_error("Failed creating mutex!");
 	}
+	if((changeCond = SDL_CreateCond()) == NULL) {
+		throw runtime_error("Failed creating condition!");
+	}
+	if((listenerMutex = SDL_CreateMutex()) == NULL) {
+		throw runtime_error("Failed creating mutex!");
+	}
 	logger = new Logger("Status");
 	logger->debug1("Status object constructed and ready to go!");
-	emergency = false;
-	isRunning = false;
-	isPaused = true;
+	emergency.store(false, std::memory_order_relaxed);
+	isRunning.store(false, std::memory_order_relaxed);
+	isPaused.store(true, std::memory_order_relaxed);
 	setIsRunning(true);
 	setIsPaused(false);
 	setPreviewPositionInFrame(BottomRight);
@@ -25,41 +31,55 @@ Status::Status(bool myLowLatency) {
 
 Status::~Status() noexcept(false) {
 	logger->debug1("Status object destructing...");
+	SDL_DestroyCond(changeCond);
+	SDL_DestroyMutex(listenerMutex);
 	SDL_DestroyMutex(myMutex);
 	delete logger;
 }
 
 void Status::setEmergency(void) {
 	YerFace_MutexLock(myMutex);
-	if(!emergency) {
+	bool changed = false;
+	if(!emergency.load(std::memory_order_relaxed)) {
 		logger->emerg("Initiated Emergency Stop");
+		emergency.store(true, std::memory_order_release);
+		changed = true;
+	}
+	if(isRunning.load(std::memory_order_relaxed)) {
+		logger->info("Running is set to FALSE...");
+		isRunning.store(false, std::memory_order_release);
+		changed = true;
+	}
+	if(changed) {
+		SDL_CondBroadcast(changeCond);
 	}
-	emergency = true;
-	setIsRunning(false);
 	YerFace_MutexUnlock(myMutex);
+	if(changed) {
+		notifyListeners();
+	}
 }
 
 bool Status::getEmergency(void) {
-	YerFace_MutexLock(myMutex);
-	bool status = emergency;
-	YerFace_MutexUnlock(myMutex);
-	return status;
+	return emergency.load(std::memory_order_acquire);
 }
 
 void Status::setIsRunning(bool newIsRunning) {
 	YerFace_MutexLock(myMutex);
-	if(newIsRunning != isRunning) {
+	bool changed = false;
+	if(newIsRunning != isRunning.load(std::memory_order_relaxed)) {
 		logger->info("Running is set to %s...", newIsRunning ? "TRUE" : "FALSE");
+		isRunning.store(newIsRunning, std::memory_order_release);
+		SDL_CondBroadcast(changeCond);
+		changed = true;
 	}
-	isRunning = newIsRunning;
 	YerFace_MutexUnlock(myMutex);
+	if(changed) {
+		notifyListeners();
+	}
 }
 
 bool Status::getIsRunning(void) {
-	YerFace_MutexLock(myMutex);
-	bool status = isRunning;
-	YerFace_MutexUnlock(myMutex);
-	return status;
+	return isRunning.load(std::memory_order_acquire);
 }
 
 void Status::setIsPaused(bool newIsPaused) {
@@ -69,24 +89,77 @@ void Status::setIsPaused(bool newIsPaused) {
 		YerFace_MutexUnlock(myMutex);
 		return;
 	}
-	isPaused = newIsPaused;
-	logger->info("Processing is set to %s...", isPaused ? "PAUSED" : "RESUMED");
+	isPaused.store(newIsPaused, std::memory_order_release);
+	SDL_CondBroadcast(changeCond);
+	logger->info("Processing is set to %s...", newIsPaused ? "PAUSED" : "RESUMED");
 	YerFace_MutexUnlock(myMutex);
+	notifyListeners();
 }
 
 bool Status::toggleIsPaused(void) {
-	YerFace_MutexLock(myMutex);
-	setIsPaused(!isPaused);
-	bool status = isPaused;
-	YerFace_MutexUnlock(myMutex);
-	return status;
+	//NOTE: setIsPaused() must not be called with myMutex held, since it notifies listeners.
+	setIsPaused(!getIsPaused());
+	return getIsPaused();
 }
 
 bool Status::getIsPaused(void) {
+	return isPaused.load(std::memory_order_acquire);
+}
+
+bool Status::waitWhilePaused(Uint32 timeoutMilliseconds) {
+	//Fast path, so callers can use this unconditionally.
+	if(!getIsPaused() || !getIsRunning() || getEmergency()) {
+		return false;
+	}
+	Uint32 deadline = SDL_GetTicks() + timeoutMilliseconds;
 	YerFace_MutexLock(myMutex);
-	bool status = isPaused;
+	while(isPaused.load(std::memory_order_relaxed) && isRunning.load(std::memory_order_relaxed) && !emergency.load(std::memory_order_relaxed)) {
+		int result;
+		if(timeoutMilliseconds == SDL_MUTEX_MAXWAIT) {
+			result = SDL_CondWait(changeCond, myMutex);
+		} else {
+			Uint32 now = SDL_GetTicks();
+			if(SDL_TICKS_PASSED(now, deadline)) {
+				break;
+			}
+			result = SDL_CondWaitTimeout(changeCond, myMutex, deadline - now);
+		}
+		if(result < 0) {
+			YerFace_MutexUnlock(myMutex);
+			throw runtime_error("CondWait() failed!");
+		}
+	}
+	bool stillPaused = isPaused.load(std::memory_order_relaxed) && isRunning.load(std::memory_order_relaxed) && !emergency.load(std::memory_order_relaxed);
 	YerFace_MutexUnlock(myMutex);
-	return status;
+	return stillPaused;
+}
+
+void Status::onStatusChangeEvent(StatusChangeEventCallback callback) {
+	YerFace_MutexLock(listenerMutex);
+	listeners.push_back(callback);
+	YerFace_MutexUnlock(listenerMutex);
+}
+
+void Status::removeStatusChangeEvent(void *userdata) {
+	//Holding listenerMutex also waits out any notification in flight, so the listener is safe to destroy afterward.
+	YerFace_MutexLock(listenerMutex);
+	for(auto iter = listeners.begin(); iter != listeners.end();) {
+		if(iter->userdata == userdata) {
+			iter = listeners.erase(iter);
+		} else {
+			++iter;
+		}
+	}
+	YerFace_MutexUnlock(listenerMutex);
+}
+
+void Status::notifyListeners(void) {
+	// NOTE: Listeners take their own locks, so this must be called without myMutex held.
+	YerFace_MutexLock(listenerMutex);
+	for(auto listener : listeners) {
+		listener.callback(listener.userdata);
+	}
+	YerFace_MutexUnlock(listenerMutex);
 }
 
 void Status::setPreviewPositionInFrame(PreviewPositionInFrame newPosition) {
@@ -5,6 +5,10 @@
 
 #include "SDL.h"
 
+#include <atomic>
+#include <functional>
+#include <vector>
+
 using namespace std;
 
 namespace YerFace {
@@ -24,6 +28,19 @@ enum PreviewPositionInFrameDirection {
 	MoveRight
 };
 
+class StatusChangeEventCallback {
+public:
+	void *userdata;
+	std::function<void(void *userdata)> callback;
+};
+
+// The emergency, running and paused flags are read on every iteration of
+// every worker and driver loop, so they are atomics and their getters never
+// take a lock. Setters are serialized by myMutex, and every change is
+// broadcast on changeCond, so threads blocked in waitWhilePaused() wake up
+// immediately on resume (or emergency) rather than polling. Threads which
+// sleep on their own conditions can register a listener instead, which is
+// called (without myMutex held) after every change.
 class Status {
 public:
 	Status(bool myLowLatency);
@@ -35,6 +52,9 @@ public:
 	void setIsPaused(bool newIsPaused);
 	bool toggleIsPaused(void);
 	bool getIsPaused(void);
+	bool waitWhilePaused(Uint32 timeoutMilliseconds = SDL_MUTEX_MAXWAIT); //Returns true if we are still paused (timed out). Returns early on emergency or when running stops.
+	void onStatusChangeEvent(StatusChangeEventCallback callback);
+	void removeStatusChangeEvent(void *userdata); //Removes every listener registered with this userdata.
 	void setPreviewPositionInFrame(PreviewPositionInFrame newPosition);
 	PreviewPositionInFrame movePreviewPositionInFrame(PreviewPositionInFrameDirection moveDirection);
 	PreviewPositionInFrame getPreviewPositionInFrame(void);
@@ -43,15 +63,20 @@ public:
 	int getPreviewDebugDensity(void);
 
 private:
+	void notifyListeners(void);
+
 	bool lowLatency;
-	bool emergency;
-	bool isRunning;
-	bool isPaused;
+	std::atomic<bool> emergency;
+	std::atomic<bool> isRunning;
+	std::atomic<bool> isPaused;
 	int previewDebugDensity;
 	PreviewPositionInFrame previewPositionInFrame;
 
 	Logger *logger;
 	SDL_mutex *myMutex;
+	SDL_cond *changeCond;
+	SDL_mutex *listenerMutex;
+	std::vector<StatusChangeEventCallback> listeners;
 };
 
 }; //namespace YerFace
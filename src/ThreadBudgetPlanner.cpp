@@ -0,0 +1,237 @@
+
+#include "ThreadBudgetPlanner.hpp"
+#include "WorkerPool.hpp"
+#include "Utilities.hpp"
+
+#include <cmath>
+#include <sstream>
+
+using namespace std;
+
+namespace YerFace {
+
+ThreadBudgetPlanner *ThreadBudgetPlanner::instance = NULL;
+
+ThreadBudgetPlanner::ThreadBudgetPlanner(json config, Status *myStatus) {
+	status = myStatus;
+	if(status == NULL) {
+		throw invalid_argument("status cannot be NULL");
+	}
+	if(instance != NULL) {
+		throw logic_error("Only one ThreadBudgetPlanner may exist at a time!");
+	}
+	logger = new Logger("ThreadBudgetPlanner");
+	if((myMutex = SDL_CreateMutex()) == NULL) {
+		throw runtime_error("Failed creating mutex!");
+	}
+	if((myCond = SDL_CreateCond()) == NULL) {
+		throw runtime_error("Failed creating condition!");
+	}
+
+	coreBudget = config["YerFace"]["ThreadBudgetPlanner"]["coreBudget"];
+	double coreBudgetPerCPU = config["YerFace"]["ThreadBudgetPlanner"]["coreBudgetPerCPU"];
+	if(coreBudget < 0) {
+		throw invalid_argument("coreBudget is nonsense.");
+	}
+	if(coreBudgetPerCPU < 0.0) {
+		throw invalid_argument("coreBudgetPerCPU is nonsense.");
+	}
+	if(coreBudget == 0) {
+		int numCPUs = SDL_GetCPUCount();
+		coreBudget = (int)ceil((double)numCPUs * coreBudgetPerCPU);
+		logger->debug1("Calculating Core Budget: System has %d CPUs, at %.02lf Cores per CPU that's a budget of %d Cores.", numCPUs, coreBudgetPerCPU, coreBudget);
+	}
+	if(coreBudget < 1) {
+		throw invalid_argument("Core Budget can't be zero!");
+	}
+	rebalanceEverySeconds = config["YerFace"]["ThreadBudgetPlanner"]["rebalanceEverySeconds"];
+	if(rebalanceEverySeconds < 0.0) {
+		throw invalid_argument("rebalanceEverySeconds is nonsense.");
+	}
+
+	json stagesConfig = config["YerFace"]["ThreadBudgetPlanner"]["stages"];
+	for(json::iterator iter = stagesConfig.begin(); iter != stagesConfig.end(); ++iter) {
+		ThreadBudgetStage stage;
+		stage.name = iter.key();
+		stage.weight = iter.value();
+		if(stage.weight <= 0.0) {
+			throw invalid_argument("Thread budget stage weights must be greater than zero.");
+		}
+		stage.pool = NULL;
+		stage.allocation = 0;
+		stage.demand = stage.weight;
+		stages.push_back(stage);
+	}
+	if((int)stages.size() > coreBudget) {
+		logger->warning("There are more planned stages (%lu) than cores in the budget (%d)! Every stage still gets at least one core.", stages.size(), coreBudget);
+	}
+
+	running = true;
+	rebalanceThread = NULL;
+	if(rebalanceEverySeconds > 0.0) {
+		if((rebalanceThread = SDL_CreateThread(rebalanceLoop, "ThreadBudgetPlanner", (void *)this)) == NULL) {
+			throw runtime_error("Failed starting thread!");
+		}
+	}
+
+	instance = this;
+	logger->debug1("ThreadBudgetPlanner object constructed with a budget of %d Cores across %lu stages.", coreBudget, stages.size());
+}
+
+ThreadBudgetPlanner::~ThreadBudgetPlanner() noexcept(false) {
+	logger->debug1("ThreadBudgetPlanner object destructing...");
+
+	instance = NULL;
+
+	YerFace_MutexLock(myMutex);
+	running = false;
+	SDL_CondBroadcast(myCond);
+	for(ThreadBudgetStage stage : stages) {
+		if(stage.pool != NULL) {
+			logger->err("Stage %s is still registered! Did somebody forget to destroy a WorkerPool?", stage.name.c_str());
+		}
+	}
+	YerFace_MutexUnlock(myMutex);
+
+	if(rebalanceThread != NULL) {
+		SDL_WaitThread(rebalanceThread, NULL);
+	}
+
+	SDL_DestroyCond(myCond);
+	SDL_DestroyMutex(myMutex);
+	delete logger;
+}
+
+int ThreadBudgetPlanner::getCoreBudget(void) {
+	return coreBudget;
+}
+
+ThreadBudgetPlanner *ThreadBudgetPlanner::getInstance(void) {
+	return instance;
+}
+
+bool ThreadBudgetPlanner::registerPool(WorkerPool *pool, string name) {
+	YerFace_MutexLock(myMutex);
+	for(ThreadBudgetStage &stage : stages) {
+		if(stage.name == name) {
+			if(stage.pool != NULL) {
+				YerFace_MutexUnlock(myMutex);
+				throw logic_error("Two WorkerPools registered for the same thread budget stage!");
+			}
+			stage.pool = pool;
+			plan(false);
+			YerFace_MutexUnlock(myMutex);
+			return true;
+		}
+	}
+	YerFace_MutexUnlock(myMutex);
+	return false;
+}
+
+void ThreadBudgetPlanner::unregisterPool(WorkerPool *pool) {
+	YerFace_MutexLock(myMutex);
+	for(ThreadBudgetStage &stage : stages) {
+		if(stage.pool == pool) {
+			stage.pool = NULL;
+			stage.allocation = 0;
+		}
+	}
+	YerFace_MutexUnlock(myMutex);
+}
+
+void ThreadBudgetPlanner::plan(bool useMeasurements) {
+	// NOTE: Caller must hold myMutex.
+	std::vector<int> allocations(stages.size(), 0);
+	int remaining = coreBudget;
+
+	//Every registered stage gets one core, no matter what.
+	for(size_t i = 0; i < stages.size(); i++) {
+		ThreadBudgetStage &stage = stages[i];
+		if(stage.pool == NULL) {
+			continue;
+		}
+		if(useMeasurements) {
+			Metrics *metrics = stage.pool->getMetrics();
+			double measured = metrics->getAverageTimeSeconds() * metrics->getFPS();
+			if(measured > 0.0) {
+				stage.demand = measured;
+			}
+		}
+		allocations[i] = 1;
+		remaining--;
+	}
+
+	//Hand out the rest one core at a time, to whoever is most starved.
+	while(remaining > 0) {
+		int neediest = -1;
+		double neediestUtilization = 0.0;
+		for(size_t i = 0; i < stages.size(); i++) {
+			if(stages[i].pool == NULL || allocations[i] >= stages[i].pool->getNumWorkers()) {
+				continue;
+			}
+			double utilization = stages[i].demand / (double)allocations[i];
+			if(neediest < 0 || utilization > neediestUtilization) {
+				neediest = (int)i;
+				neediestUtilization = utilization;
+			}
+		}
+		if(neediest < 0) {
+			break;
+		}
+		allocations[neediest]++;
+		remaining--;
+	}
+
+	bool changed = false;
+	for(size_t i = 0; i < stages.size(); i++) {
+		if(stages[i].pool != NULL && stages[i].allocation != allocations[i]) {
+			changed = true;
+		}
+	}
+	if(!changed) {
+		return;
+	}
+
+	std::ostringstream report;
+	for(size_t i = 0; i < stages.size(); i++) {
+		ThreadBudgetStage &stage = stages[i];
+		if(stage.pool == NULL) {
+			continue;
+		}
+		stage.allocation = allocations[i];
+		stage.pool->setActiveWorkerLimit(stage.allocation);
+		char line[METRICS_STRING_LENGTH];
+		WorkerPoolScalingStats scaling = stage.pool->getScalingStats();
+		if(scaling.autoscaling) {
+			snprintf(line, METRICS_STRING_LENGTH, " %s=%d (demand %.02lf, max %d, autoscaled to %d after %d grows and %d shrinks)", stage.name.c_str(), stage.allocation, stage.demand, scaling.numWorkers, scaling.scaledWorkers, scaling.growEvents, scaling.shrinkEvents);
+		} else {
+			snprintf(line, METRICS_STRING_LENGTH, " %s=%d (demand %.02lf, max %d)", stage.name.c_str(), stage.allocation, stage.demand, scaling.numWorkers);
+		}
+		report << line;
+	}
+	logger->info("%s %d Core budget:%s", useMeasurements ? "Rebalanced" : "Planned", coreBudget, report.str().c_str());
+}
+
+int ThreadBudgetPlanner::rebalanceLoop(void *ptr) {
+	ThreadBudgetPlanner *self = (ThreadBudgetPlanner *)ptr;
+	try {
+		YerFace_MutexLock(self->myMutex);
+		while(self->running) {
+			int result = SDL_CondWaitTimeout(self->myCond, self->myMutex, (Uint32)(self->rebalanceEverySeconds * 1000.0));
+			if(result < 0) {
+				throw runtime_error("CondWaitTimeout() failed!");
+			}
+			if(self->running && !self->status->getIsPaused()) {
+				self->plan(true);
+			}
+		}
+		YerFace_MutexUnlock(self->myMutex);
+		return 0;
+	} catch(exception &e) {
+		self->logger->emerg("Uncaught exception in rebalance thread: %s\n", e.what());
+		self->status->setEmergency();
+	}
+	return 1;
+}
+
+}; //namespace YerFace
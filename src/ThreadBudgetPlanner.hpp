@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Logger.hpp"
+#include "Status.hpp"
+#include "Metrics.hpp"
+#include "Utilities.hpp"
+
+#include "SDL.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace YerFace {
+
+class WorkerPool;
+
+class ThreadBudgetStage {
+public:
+	string name;
+	double weight; //Configured cost estimate, in cores. Used until we have measurements.
+	WorkerPool *pool; //NULL until the stage's WorkerPool registers.
+	int allocation;
+	double demand; //Most recent estimate of how many cores this stage could keep busy.
+};
+
+// Divides a total core budget among the pipeline stages named in
+// YerFace.ThreadBudgetPlanner.stages. Each stage's demand is its measured
+// average task time multiplied by its task rate (taken from the pool's
+// Metrics), or the configured weight until measurements exist. Every stage
+// gets at least one core, and the rest are handed out one at a time to
+// whichever stage is most heavily utilized (demand / allocation), never
+// exceeding the number of workers the pool was created with. The plan is
+// applied as a concurrency limit on each pool (scheduled workers above it stay
+// idle, dedicated workers above it park), and optionally recomputed while
+// running so cores follow the bottleneck.
+class ThreadBudgetPlanner {
+public:
+	ThreadBudgetPlanner(json config, Status *myStatus);
+	~ThreadBudgetPlanner() noexcept(false);
+	bool registerPool(WorkerPool *pool, string name);
+	void unregisterPool(WorkerPool *pool);
+	int getCoreBudget(void);
+	static ThreadBudgetPlanner *getInstance(void); //Returns NULL if no planner is running.
+private:
+	void plan(bool useMeasurements);
+	static int rebalanceLoop(void *ptr);
+
+	Status *status;
+	Logger *logger;
+	SDL_mutex *myMutex;
+	SDL_cond *myCond;
+	SDL_Thread *rebalanceThread;
+	bool running;
+
+	int coreBudget;
+	double rebalanceEverySeconds; //Zero disables rebalancing while running.
+	std::vector<ThreadBudgetStage> stages;
+
+	static ThreadBudgetPlanner *instance;
+};
+
+}; //namespace YerFace
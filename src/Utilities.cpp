@@ -4,6 +4,8 @@
 #include <cmath>
 #include <sys/stat.h>
 #include <regex>
+#include <algorithm>
+#include <unordered_map>
 
 using namespace std;
 using namespace cv;
@@ -394,6 +396,156 @@ string Utilities::stringTrimRight(std::string str) {
 	return str;
 }
 
+MutexParkingLotBucket *MutexParkingLot::createBuckets(void) {
+	MutexParkingLotBucket *buckets = new MutexParkingLotBucket[YERFACE_MUTEX_PARKINGLOT_BUCKETS];
+	for(int i = 0; i < YERFACE_MUTEX_PARKINGLOT_BUCKETS; i++) {
+		if((buckets[i].mutex = SDL_CreateMutex()) == NULL) {
+			throw runtime_error("Failed creating mutex!");
+		}
+		if((buckets[i].cond = SDL_CreateCond()) == NULL) {
+			throw runtime_error("Failed creating condition!");
+		}
+		SDL_AtomicSet(&buckets[i].waiters, 0);
+	}
+	return buckets;
+}
+
+MutexParkingLotBucket *MutexParkingLot::getBucket(SDL_mutex *mutex) {
+	// Function-local static initialization is thread safe, and ensures the buckets exist before the first contended lock.
+	static MutexParkingLotBucket *buckets = createBuckets();
+	uintptr_t hash = (uintptr_t)mutex;
+	hash = hash ^ (hash >> 7) ^ (hash >> 13);
+	return &buckets[hash % YERFACE_MUTEX_PARKINGLOT_BUCKETS];
+}
+
+void MutexParkingLot::lockContended(SDL_mutex *mutex, const char *mutexName, int tryLockStatus) {
+	if(tryLockStatus == -1) {
+		YerFace_SLog("Utilities", LOG_SEVERITY_CRIT, "Failed to lock mutex %s (%p). Error was: %s", mutexName, mutex, SDL_GetError());
+		throw runtime_error("Failed to lock mutex.");
+	}
+	uint64_t start = MutexProfiler::now() / 1000;
+	MutexParkingLotBucket *bucket = getBucket(mutex);
+	if(SDL_LockMutex(bucket->mutex) != 0) {
+		throw runtime_error("Failed to lock parking lot mutex.");
+	}
+	// Registering as a waiter BEFORE retrying the lock (while holding the
+	// bucket mutex) guarantees we cannot miss the wakeup from the unlocker.
+	SDL_AtomicIncRef(&bucket->waiters);
+	int status;
+	while((status = SDL_TryLockMutex(mutex)) == SDL_MUTEX_TIMEDOUT) {
+		uint64_t elapsed = (MutexProfiler::now() / 1000) - start;
+		if(elapsed > YERFACE_MUTEX_WATCHDOG_MILLISECONDS) {
+			break;
+		}
+		YERFACE_MUTEX_DEBUGLOG("Utilities", LOG_SEVERITY_DEBUG4, "Parking on contended mutex %s (%p) ...", mutexName, mutex);
+		if(SDL_CondWaitTimeout(bucket->cond, bucket->mutex, YERFACE_MUTEX_PARKINGLOT_SLICE_MILLISECONDS) < 0) {
+			status = -1;
+			break;
+		}
+	}
+	SDL_AtomicDecRef(&bucket->waiters);
+	SDL_UnlockMutex(bucket->mutex);
+	if(status == -1) {
+		YerFace_SLog("Utilities", LOG_SEVERITY_CRIT, "Failed to lock mutex %s (%p). Error was: %s", mutexName, mutex, SDL_GetError());
+		throw runtime_error("Failed to lock mutex.");
+	} else if(status == SDL_MUTEX_TIMEDOUT) {
+		YerFace_SLog("Utilities", LOG_SEVERITY_CRIT, "Lock attempt on mutex %s (%p) timed out! No more retries...", mutexName, mutex);
+		throw runtime_error("Break glass! Mutex lock timed out; possible deadlock. (This was probably caused by an earlier exception!!!)");
+	}
+}
+
+void MutexParkingLot::unparkAll(SDL_mutex *mutex) {
+	MutexParkingLotBucket *bucket = getBucket(mutex);
+	if(SDL_AtomicGet(&bucket->waiters) == 0) {
+		return;
+	}
+	SDL_LockMutex(bucket->mutex);
+	SDL_CondBroadcast(bucket->cond);
+	SDL_UnlockMutex(bucket->mutex);
+}
+
+class MutexProfilerHeld {
+public:
+	MutexProfile *profile;
+	uint64_t lockedAt;
+	int depth;
+};
+
+static SDL_mutex *mutexProfilerMutex = SDL_CreateMutex();
+static unordered_map<string, MutexProfile> mutexProfiles;
+static thread_local unordered_map<SDL_mutex *, MutexProfilerHeld> mutexProfilerHeld;
+
+uint64_t MutexProfiler::now(void) {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void MutexProfiler::recordLocked(SDL_mutex *mutex, const char *fileName, const char *mutexName, uint64_t startTime, bool contended) {
+	uint64_t lockedAt = now();
+	uint64_t waited = lockedAt - startTime;
+	MutexProfilerHeld &held = mutexProfilerHeld[mutex];
+	if(held.depth > 0) {
+		// Recursive acquisition; the outermost lock owns the hold time.
+		held.depth++;
+		return;
+	}
+	string name = (string)fileName + ":" + (string)mutexName;
+	SDL_LockMutex(mutexProfilerMutex);
+	MutexProfile &profile = mutexProfiles[name];
+	if(profile.lockCount == 0) {
+		profile.name = name;
+	}
+	profile.lockCount++;
+	if(contended) {
+		profile.contendedCount++;
+	}
+	profile.waitTotal += waited;
+	profile.waitWorst = std::max(profile.waitWorst, waited);
+	SDL_UnlockMutex(mutexProfilerMutex);
+	held.profile = &profile;
+	held.lockedAt = lockedAt;
+	held.depth = 1;
+}
+
+void MutexProfiler::recordUnlocking(SDL_mutex *mutex) {
+	auto iter = mutexProfilerHeld.find(mutex);
+	if(iter == mutexProfilerHeld.end()) {
+		return;
+	}
+	if(--iter->second.depth > 0) {
+		return;
+	}
+	uint64_t held = now() - iter->second.lockedAt;
+	MutexProfile *profile = iter->second.profile;
+	mutexProfilerHeld.erase(iter);
+	SDL_LockMutex(mutexProfilerMutex);
+	profile->holdTotal += held;
+	profile->holdWorst = std::max(profile->holdWorst, held);
+	SDL_UnlockMutex(mutexProfilerMutex);
+}
+
+void MutexProfiler::logReport(void) {
+	SDL_LockMutex(mutexProfilerMutex);
+	vector<MutexProfile> profiles;
+	for(auto &pair : mutexProfiles) {
+		profiles.push_back(pair.second);
+	}
+	SDL_UnlockMutex(mutexProfilerMutex);
+	if(profiles.size() == 0) {
+		return;
+	}
+	std::sort(profiles.begin(), profiles.end(), [](const MutexProfile &a, const MutexProfile &b) {
+		return a.waitTotal > b.waitTotal;
+	});
+	YerFace_SLog("MutexProfiler", LOG_SEVERITY_INFO, "Mutex contention report for %lu mutexes, ranked by total wait time: (times in microseconds)", (unsigned long)profiles.size());
+	int rank = 1;
+	for(MutexProfile &profile : profiles) {
+		YerFace_SLog("MutexProfiler", LOG_SEVERITY_INFO, "#%d %s: locks %lu, contended %.2lf%%, wait total %lu avg %.2lf worst %lu, hold total %lu avg %.2lf worst %lu",
+			rank++, profile.name.c_str(), (unsigned long)profile.lockCount, 100.0 * (double)profile.contendedCount / (double)profile.lockCount,
+			(unsigned long)profile.waitTotal, (double)profile.waitTotal / (double)profile.lockCount, (unsigned long)profile.waitWorst,
+			(unsigned long)profile.holdTotal, (double)profile.holdTotal / (double)profile.lockCount, (unsigned long)profile.holdWorst);
+	}
+}
+
 Logger *Utilities::logger = new Logger("Utilities");
 char *Utilities::sdlDataPath = NULL;
 
@@ -20,6 +20,11 @@ namespace YerFace {
 // #define YERFACE_MUTEX_TRIVIAL
 //// YERFACE_MUTEX_DEBUGGING enables extremely detailed mutex logging
 // #define YERFACE_MUTEX_DEBUGGING
+//// YERFACE_MUTEX_PROFILING records per-mutex wait and hold times, and logs a ranked contention report at exit.
+// #define YERFACE_MUTEX_PROFILING
+
+//// Contended mutex locks give up (and throw) after this many milliseconds.
+#define YERFACE_MUTEX_WATCHDOG_MILLISECONDS 4000
 
 
 #ifdef WIN32
@@ -68,6 +73,16 @@ static constexpr cstr portableBasename(cstr str) {
 #define YERFACE_MUTEX_DEBUGLOG(...) do { } while(0)
 #endif
 
+#ifdef YERFACE_MUTEX_PROFILING
+#define YERFACE_MUTEX_PROFILE_START(T) uint64_t T = MutexProfiler::now()
+#define YERFACE_MUTEX_PROFILE_LOCKED(X, N, T, C) MutexProfiler::recordLocked(X, YERFACE_FILE, N, T, C)
+#define YERFACE_MUTEX_PROFILE_UNLOCKING(X) MutexProfiler::recordUnlocking(X)
+#else
+#define YERFACE_MUTEX_PROFILE_START(T) do { } while(0)
+#define YERFACE_MUTEX_PROFILE_LOCKED(X, N, T, C) do { } while(0)
+#define YERFACE_MUTEX_PROFILE_UNLOCKING(X) do { } while(0)
+#endif
+
 #ifdef YERFACE_MUTEX_TRIVIAL
 
 #define YerFace_MutexLock YerFace_MutexLock_Trivial
@@ -75,41 +90,30 @@ static constexpr cstr portableBasename(cstr str) {
 
 #else // END Trivial mutex macros, BEGIN non-trivial mutex macros
 
+// Uncontended locks are taken with a single SDL_TryLockMutex(). Contended
+// locks park the calling thread in MutexParkingLot::lockContended(), which
+// sleeps until the holder unlocks (or the watchdog gives up).
 #define YerFace_MutexLock(X) do {														\
-	int _mutexStatus = SDL_MUTEX_TIMEDOUT;												\
-	uint64_t _mutexStart = std::chrono::duration_cast<std::chrono::milliseconds>		\
-		(std::chrono::steady_clock::now().time_since_epoch()).count();					\
 	YERFACE_MUTEX_DEBUGLOG("Utilities", LOG_SEVERITY_DEBUG4,							\
 		"Attempting lock on mutex %s (%p) ...", #X, X);									\
-	while(_mutexStatus == SDL_MUTEX_TIMEDOUT) {											\
-		_mutexStatus = SDL_TryLockMutex(X);												\
-		if(_mutexStatus == -1) {														\
-			YERFACE_MUTEX_DEBUGLOG("Utilities", LOG_SEVERITY_CRIT, "Failed to "			\
-				"lock mutex %s (%p). Error was: %s", #X, X, SDL_GetError());			\
-			throw runtime_error("Failed to lock mutex.");								\
-		} else if(_mutexStatus == SDL_MUTEX_TIMEDOUT) {									\
-			uint64_t _mutexEnd = std::chrono::duration_cast<std::chrono::milliseconds>	\
-				(std::chrono::steady_clock::now().time_since_epoch()).count();			\
-			YERFACE_MUTEX_DEBUGLOG("Utilities", LOG_SEVERITY_DEBUG4,					\
-				"Lock attempt on mutex %s (%p) timed out...", #X, X);					\
-			if(_mutexEnd - _mutexStart > 4000) {										\
-				YerFace_SLog("Utilities", LOG_SEVERITY_CRIT, "Lock attempt on mutex "	\
-					"%s (%p) timed out! No more retries...", #X, X);					\
-				throw runtime_error("Break glass! Mutex lock timed out; possible "		\
-					"deadlock. (This was probably caused by an earlier exception!!!)");	\
-			}																			\
-		}																				\
+	YERFACE_MUTEX_PROFILE_START(_mutexProfileStart);									\
+	int _mutexStatus = SDL_TryLockMutex(X);												\
+	if(_mutexStatus != 0) {																\
+		MutexParkingLot::lockContended(X, #X, _mutexStatus);							\
 	}																					\
+	YERFACE_MUTEX_PROFILE_LOCKED(X, #X, _mutexProfileStart, _mutexStatus != 0);		\
 	YERFACE_MUTEX_DEBUGLOG("Utilities", LOG_SEVERITY_DEBUG4,							\
 		"Successfully locked mutex %s (%p) ...", #X, X);								\
 } while(0)
 
 #define YerFace_MutexUnlock(X) do {														\
+	YERFACE_MUTEX_PROFILE_UNLOCKING(X);													\
 	if(SDL_UnlockMutex(X) != 0) {														\
 		YerFace_SLog("Utilities", LOG_SEVERITY_CRIT, "Failed to unlock mutex "			\
 			"%s (%p). Error was: %s", #X, X, SDL_GetError());							\
 		throw runtime_error("Failed to unlock mutex.");									\
 	}																					\
+	MutexParkingLot::unparkAll(X);														\
 	YERFACE_MUTEX_DEBUGLOG("Utilities", LOG_SEVERITY_DEBUG4,							\
 		"Successfully unlocked mutex %s (%p) ...", #X, X);								\
 } while(0)
@@ -144,6 +148,49 @@ public:
 
 class Logger;
 
+#define YERFACE_MUTEX_PARKINGLOT_BUCKETS 64
+#define YERFACE_MUTEX_PARKINGLOT_SLICE_MILLISECONDS 10
+
+class MutexParkingLotBucket {
+public:
+	SDL_mutex *mutex;
+	SDL_cond *cond;
+	SDL_atomic_t waiters;
+};
+
+// Parks threads waiting on a contended mutex. Waiters sleep on a condition
+// shared by all mutexes which hash to the same bucket, and YerFace_MutexUnlock
+// wakes them only if somebody is actually waiting. (Mutexes released
+// implicitly by SDL_CondWait are picked up within one wait slice.)
+class MutexParkingLot {
+public:
+	static void lockContended(SDL_mutex *mutex, const char *mutexName, int tryLockStatus);
+	static void unparkAll(SDL_mutex *mutex);
+private:
+	static MutexParkingLotBucket *getBucket(SDL_mutex *mutex);
+	static MutexParkingLotBucket *createBuckets(void);
+};
+
+class MutexProfile {
+public:
+	string name;
+	uint64_t lockCount;
+	uint64_t contendedCount;
+	uint64_t waitTotal, waitWorst;
+	uint64_t holdTotal, holdWorst;
+};
+
+// Contention profiler. Only populated when YERFACE_MUTEX_PROFILING is defined.
+// All times are in microseconds. (Hold time for mutexes used with condition
+// variables includes the time spent inside SDL_CondWait.)
+class MutexProfiler {
+public:
+	static uint64_t now(void);
+	static void recordLocked(SDL_mutex *mutex, const char *fileName, const char *mutexName, uint64_t startTime, bool contended);
+	static void recordUnlocking(SDL_mutex *mutex);
+	static void logReport(void);
+};
+
 class Utilities {
 public:
 	static double normalize(double x, double length);
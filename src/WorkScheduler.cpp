@@ -0,0 +1,304 @@
+
+#include "WorkScheduler.hpp"
+#include "WorkerPool.hpp"
+#include "FrameServer.hpp"
+#include "Utilities.hpp"
+
+#include <cmath>
+
+using namespace std;
+
+namespace YerFace {
+
+WorkScheduler *WorkScheduler::instance = NULL;
+
+//The executor thread we are running on, if any. Lets workers resubmit to their own deque.
+static thread_local WorkSchedulerThread *currentSchedulerThread = NULL;
+
+WorkScheduler::WorkScheduler(json config, Status *myStatus) {
+	status = myStatus;
+	if(status == NULL) {
+		throw invalid_argument("status cannot be NULL");
+	}
+	if(instance != NULL) {
+		throw logic_error("Only one WorkScheduler may exist at a time!");
+	}
+	logger = new Logger("WorkScheduler");
+	if((myMutex = SDL_CreateMutex()) == NULL) {
+		throw runtime_error("Failed creating mutex!");
+	}
+
+	int numThreads = config["YerFace"]["WorkScheduler"]["numWorkers"];
+	double numThreadsPerCPU = config["YerFace"]["WorkScheduler"]["numWorkersPerCPU"];
+	if(numThreads < 0) {
+		throw invalid_argument("numWorkers is nonsense.");
+	}
+	if(numThreadsPerCPU < 0.0) {
+		throw invalid_argument("numWorkersPerCPU is nonsense.");
+	}
+	if(numThreads == 0) {
+		int numCPUs = SDL_GetCPUCount();
+		numThreads = (int)ceil((double)numCPUs * numThreadsPerCPU);
+		logger->debug1("Calculating NumThreads: System has %d CPUs, at %.02lf Threads per CPU that's %d NumThreads.", numCPUs, numThreadsPerCPU, numThreads);
+	} else {
+		logger->debug1("NumThreads explicitly set to %d.", numThreads);
+	}
+	if(numThreads < 1) {
+		throw invalid_argument("NumThreads can't be zero!");
+	}
+
+	affinity = CPUAffinity::fromJSON(config["YerFace"]["CPUAffinity"]["WorkScheduler"]);
+	frameAffinity = config["YerFace"]["WorkScheduler"]["frameAffinity"];
+	SDL_AtomicSet(&frameVisits, 0);
+	SDL_AtomicSet(&frameVisitsSameCPU, 0);
+	SDL_AtomicSet(&frameVisitsSameCacheDomain, 0);
+	SDL_AtomicSet(&affineDispatches, 0);
+	SDL_AtomicSet(&affineDispatchesKept, 0);
+	SDL_AtomicSet(&frameWidth, 0);
+	SDL_AtomicSet(&frameHeight, 0);
+	int numCPUs = SDL_GetCPUCount();
+	for(int cpu = 0; cpu < numCPUs; cpu++) {
+		cacheDomains.push_back(CPUAffinity::getCPUCacheDomain(cpu));
+	}
+
+	running = true;
+	queuedWorkers = 0;
+	sleepingThreads = 0;
+	nextThread = 0;
+
+	//Every deque must exist before any thread starts stealing.
+	for(int i = 1; i <= numThreads; i++) {
+		WorkSchedulerThread *thread = new WorkSchedulerThread();
+		thread->num = i;
+		thread->thread = NULL;
+		thread->scheduler = this;
+		if((thread->dequeMutex = SDL_CreateMutex()) == NULL) {
+			throw runtime_error("Failed creating mutex!");
+		}
+		if((thread->wakeCond = SDL_CreateCond()) == NULL) {
+			throw runtime_error("Failed creating condition!");
+		}
+		thread->sleeping = false;
+		threads.push_back(thread);
+	}
+	for(WorkSchedulerThread *thread : threads) {
+		if((thread->thread = SDL_CreateThread(outerSchedulerLoop, "WorkScheduler", (void *)thread)) == NULL) {
+			throw runtime_error("Failed starting thread!");
+		}
+	}
+
+	instance = this;
+	logger->debug1("WorkScheduler object constructed with NumThreads: %d", numThreads);
+}
+
+WorkScheduler::~WorkScheduler() noexcept(false) {
+	logger->debug1("WorkScheduler object destructing...");
+
+	instance = NULL;
+
+	if(queuedWorkers > 0) {
+		logger->err("Workers are still queued! Did somebody forget to destroy a WorkerPool?");
+	}
+	YerFace_MutexLock(myMutex);
+	running = false;
+	for(WorkSchedulerThread *thread : threads) {
+		SDL_CondSignal(thread->wakeCond);
+	}
+	YerFace_MutexUnlock(myMutex);
+
+	for(WorkSchedulerThread *thread : threads) {
+		SDL_WaitThread(thread->thread, NULL);
+		SDL_DestroyCond(thread->wakeCond);
+		SDL_DestroyMutex(thread->dequeMutex);
+		delete thread;
+	}
+
+	logFrameAffinityReport();
+
+	SDL_DestroyMutex(myMutex);
+	delete logger;
+}
+
+WorkScheduler *WorkScheduler::getInstance(void) {
+	return instance;
+}
+
+int WorkScheduler::getNumThreads(void) {
+	return (int)threads.size();
+}
+
+void WorkScheduler::schedule(WorkerPoolWorker *worker, int preferredThread) {
+	WorkSchedulerThread *thread = currentSchedulerThread;
+	WorkSchedulerThread *preferred = NULL;
+	if(frameAffinity && preferredThread > 0 && preferredThread <= (int)threads.size()) {
+		preferred = threads[preferredThread - 1];
+		thread = preferred;
+		SDL_AtomicIncRef(&affineDispatches);
+	}
+	worker->preferredSchedulerThread = preferred != NULL ? preferred->num : 0;
+	if(thread == NULL || thread->scheduler != this) {
+		thread = threads[nextThread++ % threads.size()];
+	}
+
+	//NOTE: Count BEFORE pushing, so the count never dips below zero. A thread which sees the count
+	//before the entry lands just scans again.
+	queuedWorkers++;
+	YerFace_MutexLock(thread->dequeMutex);
+	thread->deque.push_back(worker);
+	YerFace_MutexUnlock(thread->dequeMutex);
+
+	//NOTE: Count BEFORE checking for sleepers. A thread going to sleep announces itself BEFORE it checks the
+	//count, so either it sees our entry and doesn't sleep, or we see it and wake it up.
+	if(sleepingThreads > 0) {
+		YerFace_MutexLock(myMutex);
+		wakeThread(preferred != NULL ? preferred : thread);
+		YerFace_MutexUnlock(myMutex);
+	}
+}
+
+void WorkScheduler::wakeThread(WorkSchedulerThread *preferred) {
+	// NOTE: Caller must hold myMutex.
+	//Wake the thread which owns the entry if it's asleep, so it (and not a thief) picks it up.
+	if(preferred->sleeping) {
+		preferred->sleeping = false;
+		sleepingThreads--;
+		SDL_CondSignal(preferred->wakeCond);
+		return;
+	}
+	for(WorkSchedulerThread *thread : threads) {
+		if(thread->sleeping) {
+			thread->sleeping = false;
+			sleepingThreads--;
+			SDL_CondSignal(thread->wakeCond);
+			return;
+		}
+	}
+	//Nobody is asleep. Whoever finishes first will pick up the entry.
+}
+
+void WorkScheduler::touchFrame(WorkingFrame *frame) {
+	WorkScheduler *self = instance;
+	int cpu = CPUAffinity::getCurrentCPU();
+	int lastCPU = SDL_AtomicSet(&frame->affinityCPU, cpu + 1) - 1;
+	WorkSchedulerThread *thread = currentSchedulerThread;
+	SDL_AtomicSet(&frame->affinityThread, (thread != NULL && thread->scheduler == self) ? thread->num : 0);
+	if(self == NULL || cpu < 0 || lastCPU < 0 || cpu >= (int)self->cacheDomains.size() || lastCPU >= (int)self->cacheDomains.size()) {
+		return;
+	}
+	SDL_AtomicIncRef(&self->frameVisits);
+	if(cpu == lastCPU) {
+		SDL_AtomicIncRef(&self->frameVisitsSameCPU);
+		SDL_AtomicIncRef(&self->frameVisitsSameCacheDomain);
+	} else if(self->cacheDomains[cpu] == self->cacheDomains[lastCPU]) {
+		SDL_AtomicIncRef(&self->frameVisitsSameCacheDomain);
+	}
+	SDL_AtomicSet(&self->frameWidth, frame->frame.cols);
+	SDL_AtomicSet(&self->frameHeight, frame->frame.rows);
+}
+
+int WorkScheduler::getFrameAffinity(WorkingFrame *frame) {
+	return SDL_AtomicGet(&frame->affinityThread);
+}
+
+void WorkScheduler::logFrameAffinityReport(void) {
+	int visits = SDL_AtomicGet(&frameVisits);
+	int dispatches = SDL_AtomicGet(&affineDispatches);
+	if(visits == 0) {
+		logger->info("Frame affinity (%s): no frames were handed between stages.", frameAffinity ? "enabled" : "disabled");
+		return;
+	}
+	logger->info("Frame affinity (%s) at <%dx%d>: %d stage handoffs, %.01lf%% stayed on the same CPU, %.01lf%% within the same cache domain. %d affine dispatches, %.01lf%% ran on the preferred thread.",
+		frameAffinity ? "enabled" : "disabled",
+		SDL_AtomicGet(&frameWidth), SDL_AtomicGet(&frameHeight),
+		visits,
+		100.0 * (double)SDL_AtomicGet(&frameVisitsSameCPU) / (double)visits,
+		100.0 * (double)SDL_AtomicGet(&frameVisitsSameCacheDomain) / (double)visits,
+		dispatches,
+		dispatches > 0 ? 100.0 * (double)SDL_AtomicGet(&affineDispatchesKept) / (double)dispatches : 0.0);
+}
+
+bool WorkScheduler::popWork(WorkSchedulerThread *thread, WorkerPoolWorker **worker) {
+	// NOTE: Only one dequeMutex is ever held at a time.
+	YerFace_MutexLock(thread->dequeMutex);
+	if(thread->deque.size() > 0) {
+		*worker = thread->deque.back();
+		thread->deque.pop_back();
+		YerFace_MutexUnlock(thread->dequeMutex);
+		return true;
+	}
+	YerFace_MutexUnlock(thread->dequeMutex);
+
+	for(size_t i = 1; i < threads.size(); i++) {
+		WorkSchedulerThread *victim = threads[(thread->num - 1 + i) % threads.size()];
+		YerFace_MutexLock(victim->dequeMutex);
+		if(victim->deque.size() > 0) {
+			*worker = victim->deque.front();
+			victim->deque.pop_front();
+			YerFace_MutexUnlock(victim->dequeMutex);
+			return true;
+		}
+		YerFace_MutexUnlock(victim->dequeMutex);
+	}
+	return false;
+}
+
+int WorkScheduler::outerSchedulerLoop(void *ptr) {
+	WorkSchedulerThread *thread = (WorkSchedulerThread *)ptr;
+	WorkScheduler *self = thread->scheduler;
+	currentSchedulerThread = thread;
+	try {
+		self->logger->debug1("Scheduler Thread #%d Alive!", thread->num);
+
+		string threadName = "Scheduler Thread #" + to_string(thread->num);
+		self->affinity.applyToCurrentThread(thread->num - 1, (int)self->threads.size(), self->logger, threadName.c_str());
+
+		while(self->running) {
+			WorkerPoolWorker *worker;
+			if(self->popWork(thread, &worker)) {
+				self->queuedWorkers--;
+				if(worker->preferredSchedulerThread == thread->num) {
+					SDL_AtomicIncRef(&self->affineDispatchesKept);
+				}
+				WorkerPool::runScheduledWorker(worker);
+				continue;
+			}
+
+			//Every deque came up empty. Announce that we are going to sleep, then look again, so a
+			//submission which raced with our scan either gets seen here or wakes us up.
+			YerFace_MutexLock(self->myMutex);
+			if(!self->running) {
+				YerFace_MutexUnlock(self->myMutex);
+				break;
+			}
+			thread->sleeping = true;
+			self->sleepingThreads++;
+			if(self->queuedWorkers > 0) {
+				//An entry which is still landing, or which somebody is popping right now. Scan again.
+				thread->sleeping = false;
+				self->sleepingThreads--;
+				YerFace_MutexUnlock(self->myMutex);
+				SDL_Delay(0);
+				continue;
+			}
+			int result = SDL_CondWait(thread->wakeCond, self->myMutex);
+			if(thread->sleeping) {
+				//Woken spuriously, or by shutdown.
+				thread->sleeping = false;
+				self->sleepingThreads--;
+			}
+			YerFace_MutexUnlock(self->myMutex);
+			if(result < 0) {
+				throw runtime_error("CondWait() failed!");
+			}
+		}
+
+		self->logger->debug1("Scheduler Thread #%d Done.", thread->num);
+		return 0;
+	} catch(exception &e) {
+		self->logger->emerg("Uncaught exception in scheduler thread: %s\n", e.what());
+		self->status->setEmergency();
+	}
+	return 1;
+}
+
+}; //namespace YerFace
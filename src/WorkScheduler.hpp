@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Logger.hpp"
+#include "Status.hpp"
+#include "Utilities.hpp"
+#include "CPUAffinity.hpp"
+
+#include "SDL.h"
+
+#include <atomic>
+#include <deque>
+#include <vector>
+
+using namespace std;
+
+namespace YerFace {
+
+class WorkerPoolWorker;
+class WorkingFrame;
+class WorkScheduler;
+
+class WorkSchedulerThread {
+public:
+	int num;
+	SDL_Thread *thread;
+	WorkScheduler *scheduler;
+	SDL_mutex *dequeMutex;
+	std::deque<WorkerPoolWorker *> deque; //Owner pops from the back, thieves steal from the front.
+	SDL_cond *wakeCond; //Each thread sleeps on its own condition, so work can be handed to a particular thread.
+	bool sleeping; //Protected by the scheduler's myMutex, which is only ever taken to go to sleep or to wake somebody.
+};
+
+// Process-wide work-stealing executor, shared by every WorkerPool which does
+// not ask for dedicated threads. Pools submit a worker whenever it has work to
+// do, and the worker runs on whichever executor thread picks it up. Each
+// executor thread prefers its own deque (newest first, for cache warmth) and
+// steals the oldest entry from a sibling when it runs dry. A worker is never
+// queued twice, so single-worker (ordered) stages still run strictly in sequence.
+//
+// Submitting and popping only ever take the one deque's mutex. The scheduler
+// mutex is just for sleeping: a thread whose scan came up empty announces
+// itself in sleepingThreads and re-checks queuedWorkers before it waits, and a
+// submitter only takes the mutex to wake somebody if anybody is asleep.
+//
+// Frame affinity: stages which work on a frame's bitmaps call touchFrame(),
+// which remembers the executor thread (and CPU) that last had the frame in
+// cache. The next stage's pool can pass getFrameAffinity() as a hint when it
+// signals its workers, and the worker is then queued on (and wakes) that
+// thread, so the frame is still warm in its L2/L3 when the next stage picks
+// it up. Idle threads still steal, so this never costs throughput. How often
+// affinity was kept is reported when the scheduler shuts down.
+class WorkScheduler {
+public:
+	WorkScheduler(json config, Status *myStatus);
+	~WorkScheduler() noexcept(false);
+	void schedule(WorkerPoolWorker *worker, int preferredThread = 0);
+	int getNumThreads(void);
+	static WorkScheduler *getInstance(void); //Returns NULL if no scheduler is running.
+	static void touchFrame(WorkingFrame *frame);
+	static int getFrameAffinity(WorkingFrame *frame); //Returns a thread number for schedule(), or zero for no preference.
+private:
+	bool popWork(WorkSchedulerThread *thread, WorkerPoolWorker **worker);
+	void wakeThread(WorkSchedulerThread *preferred);
+	void logFrameAffinityReport(void);
+	static int outerSchedulerLoop(void *ptr);
+
+	Status *status;
+	Logger *logger;
+
+	SDL_mutex *myMutex;
+	std::atomic<bool> running;
+	std::atomic<size_t> queuedWorkers; //Number of entries across all deques which have not been popped yet.
+	std::atomic<size_t> sleepingThreads; //Number of threads with sleeping set.
+	std::atomic<size_t> nextThread; //Round robin target for submissions from outside the executor.
+
+	std::vector<WorkSchedulerThread *> threads;
+	CPUAffinity affinity;
+
+	bool frameAffinity;
+	std::vector<int> cacheDomains; //Indexed by CPU. (See CPUAffinity::getCPUCacheDomain().)
+	SDL_atomic_t frameVisits; //Times a stage touched a frame which an earlier stage had already touched.
+	SDL_atomic_t frameVisitsSameCPU;
+	SDL_atomic_t frameVisitsSameCacheDomain; //Includes frameVisitsSameCPU.
+	SDL_atomic_t affineDispatches; //Workers routed to a preferred thread.
+	SDL_atomic_t affineDispatchesKept; //...which then actually ran on that thread, rather than being stolen.
+	SDL_atomic_t frameWidth, frameHeight; //Most recently touched frame size, for the report.
+
+	static WorkScheduler *instance;
+};
+
+}; //namespace YerFace
@@ -1,5 +1,7 @@
 
 #include "WorkerPool.hpp"
+#include "WorkScheduler.hpp"
+#include "ThreadBudgetPlanner.hpp"
 #include "Utilities.hpp"
 
 using namespace std;
@@ -26,6 +28,9 @@ WorkerPool::WorkerPool(json config, Status *myStatus, FrameServer *myFrameServer
 	if((myCond = SDL_CreateCond()) == NULL) {
 		throw runtime_error("Failed creating condition!");
 	}
+	if((parkCond = SDL_CreateCond()) == NULL) {
+		throw runtime_error("Failed creating condition!");
+	}
 
 	if(parameters.numWorkers < 0.0) {
 		throw invalid_argument("numWorkers is nonsense.");
@@ -33,8 +38,13 @@ WorkerPool::WorkerPool(json config, Status *myStatus, FrameServer *myFrameServer
 	if(parameters.numWorkersPerCPU < 0.0) {
 		throw invalid_argument("numWorkersPerCPU is nonsense.");
 	}
+	if((parameters.handler == NULL) == (parameters.taskHandler == NULL)) {
+		throw invalid_argument("exactly one of handler or taskHandler must be set.");
+	}
 
 	running = true;
+	pendingSignals = 0;
+	idleWorkers = 0;
 
 	//Hook into the frame lifecycle.
 
@@ -45,6 +55,12 @@ WorkerPool::WorkerPool(json config, Status *myStatus, FrameServer *myFrameServer
 	frameServerDrainedCallback.callback = handleFrameServerDrainedEvent;
 	frameServer->onFrameServerDrainedEvent(frameServerDrainedCallback);
 
+	//Sleeping workers need to notice when we stop running (or hit an emergency), even if nobody signals them.
+	StatusChangeEventCallback statusChangeCallback;
+	statusChangeCallback.userdata = (void *)this;
+	statusChangeCallback.callback = handleStatusChangeEvent;
+	status->onStatusChangeEvent(statusChangeCallback);
+
 	//Start worker threads.
 	if(parameters.numWorkers == 0) {
 		int numCPUs = SDL_GetCPUCount();
@@ -56,50 +72,499 @@ WorkerPool::WorkerPool(json config, Status *myStatus, FrameServer *myFrameServer
 	if(parameters.numWorkers < 1) {
 		throw invalid_argument("NumWorkers can't be zero!");
 	}
+
+	if(config["YerFace"]["CPUAffinity"]["pools"].contains(parameters.name)) {
+		parameters.affinity = CPUAffinity::fromJSON(config["YerFace"]["CPUAffinity"]["pools"][parameters.name]);
+	}
+	if(parameters.affinity.layout != CPU_AFFINITY_NONE && !parameters.dedicatedThreads) {
+		logger->debug1("Pool has a CPU affinity, so it will run on dedicated (pinned) threads instead of the WorkScheduler.");
+		parameters.dedicatedThreads = true;
+	}
+
+	//Autoscaling, if configured for this pool. Our worker count becomes the maximum.
+	autoscaling = false;
+	minWorkers = parameters.numWorkers;
+	if(config["YerFace"]["WorkerPoolAutoscaling"]["enabled"] && config["YerFace"]["WorkerPoolAutoscaling"]["pools"].contains(parameters.name)) {
+		minWorkers = config["YerFace"]["WorkerPoolAutoscaling"]["pools"][parameters.name]["minWorkers"];
+		if(minWorkers < 1) {
+			throw invalid_argument("Autoscaling minWorkers must be at least one.");
+		}
+		if(minWorkers > parameters.numWorkers) {
+			minWorkers = parameters.numWorkers;
+		}
+		if(parameters.handler != NULL && parameters.backlog == NULL) {
+			logger->warning("Autoscaling is configured, but this pool has no way to report its backlog. Running all %d workers.", parameters.numWorkers);
+			minWorkers = parameters.numWorkers;
+		} else if(minWorkers < parameters.numWorkers) {
+			autoscaling = true;
+		}
+	}
+	if(autoscaling) {
+		evaluateEverySeconds = config["YerFace"]["WorkerPoolAutoscaling"]["evaluateEverySeconds"];
+		if(evaluateEverySeconds < 0.0) {
+			throw invalid_argument("Autoscaling evaluateEverySeconds is nonsense.");
+		}
+		growAboveBacklogPerWorker = config["YerFace"]["WorkerPoolAutoscaling"]["growAboveBacklogPerWorker"];
+		shrinkBelowBacklogPerWorker = config["YerFace"]["WorkerPoolAutoscaling"]["shrinkBelowBacklogPerWorker"];
+		if(shrinkBelowBacklogPerWorker < 0.0 || growAboveBacklogPerWorker <= shrinkBelowBacklogPerWorker) {
+			throw invalid_argument("Autoscaling growAboveBacklogPerWorker must be greater than shrinkBelowBacklogPerWorker, or the pool would thrash.");
+		}
+		growAfterSeconds = config["YerFace"]["WorkerPoolAutoscaling"]["growAfterSeconds"];
+		shrinkAfterSeconds = config["YerFace"]["WorkerPoolAutoscaling"]["shrinkAfterSeconds"];
+		if(growAfterSeconds < 0.0 || shrinkAfterSeconds < 0.0) {
+			throw invalid_argument("Autoscaling growAfterSeconds and shrinkAfterSeconds cannot be less than zero.");
+		}
+		logger->debug1("Autoscaling between %d and %d workers.", minWorkers, parameters.numWorkers);
+	}
+	scaledWorkers = minWorkers;
+	lastScalingCheck = 0.0;
+	scalingCheckInProgress = false;
+	backlogHighSince = -1.0;
+	backlogLowSince = -1.0;
+	slowestInitializerSeconds = 0.0;
+	growEvents = 0;
+	shrinkEvents = 0;
+	peakScaledWorkers = scaledWorkers;
+
+	scheduler = NULL;
+	doneWorkers = 0;
+	activeWorkerLimit = parameters.numWorkers;
+	metrics = NULL;
+	if(!parameters.dedicatedThreads) {
+		scheduler = WorkScheduler::getInstance();
+		if(scheduler == NULL) {
+			logger->debug1("No WorkScheduler is running. Falling back to dedicated threads.");
+		}
+	}
+
 	for(int i = 1; i <= parameters.numWorkers; i++) {
 		WorkerPoolWorker *worker = new WorkerPoolWorker();
 		worker->num = i;
+		worker->thread = NULL;
 		worker->ptr = parameters.usrPtr;
 		worker->pool = this;
-		if((worker->thread = SDL_CreateThread(outerWorkerLoop, parameters.name.c_str(), (void *)worker)) == NULL) {
-			throw runtime_error("Failed starting thread!");
-		}
+		worker->state = WORKER_QUEUED;
+		worker->initialized = false;
+		worker->preferredSchedulerThread = 0;
 		workers.push_back(worker);
+		//Dedicated threads above our autoscaled size are started when (if) we grow.
+		if(scheduler == NULL && i <= scaledWorkers) {
+			startDedicatedWorker(worker);
+		}
 	}
 
-	logger->debug1("WorkerPool object constructed with NumWorkers: %d", parameters.numWorkers);
+	//Let the planner decide how many of our workers may run at once.
+	planned = false;
+	ThreadBudgetPlanner *planner = ThreadBudgetPlanner::getInstance();
+	if(planner != NULL) {
+		string metricsName = "WorkerPool<" + parameters.name + ">";
+		metrics = new Metrics(config, metricsName.c_str());
+		planned = planner->registerPool(this, parameters.name);
+		if(!planned) {
+			delete metrics;
+			metrics = NULL;
+		} else if(scheduler == NULL) {
+			logger->warning("The ThreadBudgetPlanner can only limit pools running on the WorkScheduler. This pool will ignore its allocation.");
+		}
+	}
+
+	//Scheduled workers run once right away, so their initializers don't wait for the first frame.
+	//(Workers above our autoscaled size are initialized the first time we grow onto them.)
+	if(scheduler != NULL) {
+		YerFace_MutexLock(myMutex);
+		for(auto worker : workers) {
+			if(worker->num <= scaledWorkers) {
+				scheduler->schedule(worker);
+			} else {
+				worker->state = WORKER_IDLE;
+			}
+		}
+		YerFace_MutexUnlock(myMutex);
+	}
+
+	logger->debug1("WorkerPool object constructed with NumWorkers: %d (%s)", parameters.numWorkers, scheduler != NULL ? "scheduled" : "dedicated threads");
 }
 
 WorkerPool::~WorkerPool() noexcept(false) {
 	logger->debug1("WorkerPool object destructing...");
 
+	status->removeStatusChangeEvent((void *)this);
+
+	if(planned) {
+		ThreadBudgetPlanner *planner = ThreadBudgetPlanner::getInstance();
+		if(planner != NULL) {
+			planner->unregisterPool(this);
+		}
+	}
+
 	YerFace_MutexLock(myMutex);
 	if(!frameServerDrained && running) {
 		logger->crit("Frame server has not finished draining and nobody explicitly told us to stop! Here be dragons!");
 		running = false;
-		SDL_CondBroadcast(myCond);
+		wakeWorkers(true);
+	}
+	if(scheduler != NULL) {
+		while(doneWorkers < workers.size()) {
+			if(SDL_CondWait(myCond, myMutex) < 0) {
+				YerFace_MutexUnlock(myMutex);
+				throw runtime_error("CondWait() failed!");
+			}
+		}
 	}
 	YerFace_MutexUnlock(myMutex);
 
 	for(auto worker : workers) {
-		SDL_WaitThread(worker->thread, NULL);
+		if(worker->thread != NULL) {
+			SDL_WaitThread(worker->thread, NULL);
+		}
 		delete worker;
 	}
 
+	if(tasks.size() > 0) {
+		logger->err("Tasks are still pending! Woe is me!");
+	}
+
+	if(autoscaling) {
+		logger->info("Autoscaling Report: Grew %d times and shrank %d times, peaking at %d of %d workers and finishing at %d. Slowest worker initialization took %.01lfms.", growEvents, shrinkEvents, peakScaledWorkers, parameters.numWorkers, scaledWorkers, slowestInitializerSeconds * 1000.0);
+	}
+
+	if(metrics != NULL) {
+		delete metrics;
+	}
+	SDL_DestroyCond(parkCond);
 	SDL_DestroyCond(myCond);
 	SDL_DestroyMutex(myMutex);
 	delete logger;
 }
 
-void WorkerPool::sendWorkerSignal(void) {
+void WorkerPool::sendWorkerSignal(int schedulerThreadHint) {
+	considerScaling();
+	YerFace_MutexLock(myMutex);
+	//Remember the signal, so a worker which is busy scanning right now will scan again instead of going to sleep.
+	if(pendingSignals < parameters.numWorkers) {
+		pendingSignals++;
+	}
+	wakeWorkers(false, schedulerThreadHint);
+	YerFace_MutexUnlock(myMutex);
+}
+
+void WorkerPool::pushTask(WorkerPoolTask task, int schedulerThreadHint) {
+	considerScaling();
 	YerFace_MutexLock(myMutex);
-	SDL_CondSignal(myCond);
+	if(parameters.taskHandler == NULL) {
+		YerFace_MutexUnlock(myMutex);
+		throw logic_error("pushTask() called on a WorkerPool with no taskHandler!");
+	}
+	tasks.insert(std::make_pair(task.deadline, task));
+	//Wake exactly one sleeping worker per task. Busy workers will find the task on their own.
+	wakeWorkers(false, schedulerThreadHint);
 	YerFace_MutexUnlock(myMutex);
 }
 
 void WorkerPool::stopWorkerNow(void) {
 	YerFace_MutexLock(myMutex);
 	running = false;
+	wakeWorkers(true);
+	YerFace_MutexUnlock(myMutex);
+}
+
+int WorkerPool::getNumWorkers(void) {
+	return parameters.numWorkers;
+}
+
+Metrics *WorkerPool::getMetrics(void) {
+	return metrics;
+}
+
+WorkerPoolScalingStats WorkerPool::getScalingStats(void) {
+	WorkerPoolScalingStats stats;
+	YerFace_MutexLock(myMutex);
+	stats.autoscaling = autoscaling;
+	stats.numWorkers = parameters.numWorkers;
+	stats.scaledWorkers = scaledWorkers;
+	stats.peakScaledWorkers = peakScaledWorkers;
+	stats.growEvents = growEvents;
+	stats.shrinkEvents = shrinkEvents;
+	YerFace_MutexUnlock(myMutex);
+	return stats;
+}
+
+int WorkerPool::getEffectiveWorkerLimit(void) {
+	// NOTE: Caller must hold myMutex.
+	int limit = scaledWorkers;
+	//The planner's limit applies to dedicated pools too. Their workers above it park on parkCond.
+	if(activeWorkerLimit < limit) {
+		limit = activeWorkerLimit;
+	}
+	return limit;
+}
+
+void WorkerPool::considerScaling(void) {
+	// NOTE: Caller must NOT hold myMutex, because the backlog callback takes its module's locks.
+	if(!autoscaling) {
+		return;
+	}
+	double now = FrameServer::getWallClock();
+	YerFace_MutexLock(myMutex);
+	if(scalingCheckInProgress || now - lastScalingCheck < evaluateEverySeconds || frameServerDrained || !running) {
+		YerFace_MutexUnlock(myMutex);
+		return;
+	}
+	scalingCheckInProgress = true;
+	lastScalingCheck = now;
+	size_t backlog = tasks.size();
+	YerFace_MutexUnlock(myMutex);
+
+	if(parameters.backlog != NULL) {
+		backlog = parameters.backlog(parameters.usrPtr);
+	}
+
+	YerFace_MutexLock(myMutex);
+	scalingCheckInProgress = false;
+	double backlogPerWorker = (double)backlog / (double)scaledWorkers;
+	if(backlogPerWorker > growAboveBacklogPerWorker && scaledWorkers < parameters.numWorkers) {
+		backlogLowSince = -1.0;
+		if(backlogHighSince < 0.0) {
+			backlogHighSince = now;
+		}
+		double waitSeconds = growAfterSeconds;
+		WorkerPoolWorker *nextWorker = NULL;
+		for(auto worker : workers) {
+			if(worker->num == scaledWorkers + 1) {
+				nextWorker = worker;
+			}
+		}
+		if(nextWorker != NULL && !nextWorker->initialized && slowestInitializerSeconds > waitSeconds) {
+			waitSeconds = slowestInitializerSeconds;
+		}
+		if(now - backlogHighSince >= waitSeconds) {
+			setScaledWorkers(scaledWorkers + 1, backlog);
+			backlogHighSince = now;
+		}
+	} else if(backlogPerWorker < shrinkBelowBacklogPerWorker && scaledWorkers > minWorkers) {
+		backlogHighSince = -1.0;
+		if(backlogLowSince < 0.0) {
+			backlogLowSince = now;
+		}
+		if(now - backlogLowSince >= shrinkAfterSeconds) {
+			setScaledWorkers(scaledWorkers - 1, backlog);
+			backlogLowSince = now;
+		}
+	} else {
+		backlogHighSince = -1.0;
+		backlogLowSince = -1.0;
+	}
+	YerFace_MutexUnlock(myMutex);
+}
+
+void WorkerPool::setScaledWorkers(int newScaledWorkers, size_t backlog) {
+	// NOTE: Caller must hold myMutex.
+	int oldScaledWorkers = scaledWorkers;
+	scaledWorkers = newScaledWorkers;
+	if(scaledWorkers > oldScaledWorkers) {
+		growEvents++;
+		if(scaledWorkers > peakScaledWorkers) {
+			peakScaledWorkers = scaledWorkers;
+		}
+	} else {
+		shrinkEvents++;
+	}
+	logger->info("Autoscaling %s from %d to %d workers. (Backlog is %lu.)", scaledWorkers > oldScaledWorkers ? "up" : "down", oldScaledWorkers, scaledWorkers, backlog);
+
+	if(scheduler == NULL) {
+		for(auto worker : workers) {
+			if(worker->num <= scaledWorkers && worker->thread == NULL) {
+				startDedicatedWorker(worker);
+			}
+		}
+		SDL_CondBroadcast(parkCond);
+	} else if(scaledWorkers > oldScaledWorkers) {
+		wakeWorkers(true);
+	}
+}
+
+void WorkerPool::startDedicatedWorker(WorkerPoolWorker *worker) {
+	if((worker->thread = SDL_CreateThread(outerWorkerLoop, parameters.name.c_str(), (void *)worker)) == NULL) {
+		throw runtime_error("Failed starting thread!");
+	}
+}
+
+void WorkerPool::initializeWorker(WorkerPoolWorker *worker) {
+	if(parameters.initializer != NULL) {
+		double started = FrameServer::getWallClock();
+		parameters.initializer(worker, parameters.usrPtr);
+		double elapsed = FrameServer::getWallClock() - started;
+		YerFace_MutexLock(myMutex);
+		if(elapsed > slowestInitializerSeconds) {
+			slowestInitializerSeconds = elapsed;
+		}
+		YerFace_MutexUnlock(myMutex);
+	}
+	worker->initialized = true;
+}
+
+void WorkerPool::setActiveWorkerLimit(int limit) {
+	if(limit < 1) {
+		limit = 1;
+	} else if(limit > parameters.numWorkers) {
+		limit = parameters.numWorkers;
+	}
+	YerFace_MutexLock(myMutex);
+	int oldLimit = activeWorkerLimit;
+	activeWorkerLimit = limit;
+	logger->debug1("Active worker limit is now %d.", activeWorkerLimit);
+	//Parked dedicated workers re-check the limit whenever they wake, so unpark them even without pending work.
+	if(limit > oldLimit && scheduler == NULL) {
+		SDL_CondBroadcast(parkCond);
+	}
+	//Newly unthrottled workers may be needed right away.
+	if(limit > oldLimit && hasPendingWork()) {
+		wakeWorkers(true);
+	}
+	YerFace_MutexUnlock(myMutex);
+}
+
+void WorkerPool::wakeWorkers(bool everyone, int schedulerThreadHint) {
+	// NOTE: Caller must hold myMutex.
+	if(scheduler == NULL) {
+		if(everyone) {
+			SDL_CondBroadcast(myCond);
+			SDL_CondBroadcast(parkCond);
+		} else if(idleWorkers > 0) {
+			SDL_CondSignal(myCond);
+		}
+		return;
+	}
+	bool stopping = frameServerDrained || !running;
+	for(auto worker : workers) {
+		//Throttled workers only need to wake up when it's time to stop.
+		if(worker->num > getEffectiveWorkerLimit() && !stopping) {
+			continue;
+		}
+		if(worker->state == WORKER_IDLE) {
+			worker->state = WORKER_QUEUED;
+			scheduler->schedule(worker, schedulerThreadHint);
+			if(!everyone) {
+				return;
+			}
+		}
+	}
+}
+
+bool WorkerPool::hasPendingWork(void) {
+	// NOTE: Caller must hold myMutex.
+	return pendingSignals > 0 || tasks.size() > 0;
+}
+
+bool WorkerPool::doWork(WorkerPoolWorker *worker) {
+	// NOTE: Caller must hold myMutex. It is released while the handler runs.
+	bool didWork = false;
+	MetricsTick tick;
+	if(metrics != NULL) {
+		tick = metrics->startClock();
+	}
+	if(parameters.taskHandler != NULL) {
+		if(tasks.size() > 0) {
+			//Earliest deadline first. (Ties, including tasks with no deadline, go in FIFO order.)
+			WorkerPoolTask task = tasks.begin()->second;
+			tasks.erase(tasks.begin());
+			YerFace_MutexUnlock(myMutex);
+			//NOTE: Pool tasks are never shed here, since only the taskHandler knows whether downstream stages can live without them.
+			task.missedDeadline = frameServer->checkDeadline(parameters.name, task.deadline, task.shedIfLate);
+			parameters.taskHandler(worker, task);
+			YerFace_MutexLock(myMutex);
+			didWork = true;
+		}
+	} else {
+		//Any signals received so far are satisfied by the scan we are about to do.
+		pendingSignals = 0;
+		YerFace_MutexUnlock(myMutex);
+		didWork = parameters.handler(worker);
+		YerFace_MutexLock(myMutex);
+	}
+	//Only productive runs count toward this stage's measured cost.
+	if(metrics != NULL && didWork) {
+		metrics->endClock(tick);
+	}
+	return didWork;
+}
+
+void WorkerPool::runScheduledWorker(WorkerPoolWorker *worker) {
+	WorkerPool *self = worker->pool;
+	try {
+		if(!worker->initialized) {
+			//Workers we never grew onto are only scheduled so they can finish. Don't pay for their initializer.
+			YerFace_MutexLock(self->myMutex);
+			bool stopping = self->frameServerDrained || !self->running || self->status->getEmergency();
+			YerFace_MutexUnlock(self->myMutex);
+			if(stopping) {
+				self->finishScheduledWorker(worker);
+				return;
+			}
+			self->logger->debug1("Worker #%d Alive!", worker->num);
+			self->initializeWorker(worker);
+		}
+
+		YerFace_MutexLock(self->myMutex);
+		worker->state = WORKER_RUNNING;
+		for(int i = 0; i < YERFACE_WORKERPOOL_SCHEDULED_QUANTUM; i++) {
+			if(self->status->getEmergency()) {
+				self->logger->debug1("Worker #%d honoring emergency stop.", worker->num);
+				self->running = false;
+			}
+			if(self->frameServerDrained || !self->running) {
+				YerFace_MutexUnlock(self->myMutex);
+				self->finishScheduledWorker(worker);
+				return;
+			}
+			if(worker->num > self->getEffectiveWorkerLimit()) {
+				worker->state = WORKER_IDLE;
+				YerFace_MutexUnlock(self->myMutex);
+				return;
+			}
+			if(self->status->getIsPaused() && self->status->getIsRunning()) {
+				//Don't hold the scheduler thread forever, other pools may need it to wind down.
+				YerFace_MutexUnlock(self->myMutex);
+				self->status->waitWhilePaused(YERFACE_WORKERPOOL_PAUSE_MILLISECONDS);
+				YerFace_MutexLock(self->myMutex);
+				break;
+			}
+
+			bool didWork = self->doWork(worker);
+
+			//If there is no work available, give the scheduler thread back. We'll be resubmitted when somebody signals us.
+			if(!didWork && !self->hasPendingWork()) {
+				worker->state = WORKER_IDLE;
+				YerFace_MutexUnlock(self->myMutex);
+				return;
+			}
+		}
+
+		//Out of time (or paused). Yield the scheduler thread to other workers, and get back in line.
+		worker->state = WORKER_QUEUED;
+		self->scheduler->schedule(worker);
+		YerFace_MutexUnlock(self->myMutex);
+	} catch(exception &e) {
+		self->logger->emerg("Uncaught exception in scheduled worker #%d: %s\n", worker->num, e.what());
+		self->status->setEmergency();
+		//NOTE: Handlers and (de)initializers run without myMutex, so we do not hold it here.
+		YerFace_MutexLock(self->myMutex);
+		worker->state = WORKER_DONE;
+		self->doneWorkers++;
+		SDL_CondBroadcast(self->myCond);
+		YerFace_MutexUnlock(self->myMutex);
+	}
+}
+
+void WorkerPool::finishScheduledWorker(WorkerPoolWorker *worker) {
+	if(worker->initialized && parameters.deinitializer != NULL) {
+		parameters.deinitializer(worker, parameters.usrPtr);
+	}
+	logger->debug1("Worker #%d Done.", worker->num);
+
+	YerFace_MutexLock(myMutex);
+	worker->state = WORKER_DONE;
+	doneWorkers++;
 	SDL_CondBroadcast(myCond);
 	YerFace_MutexUnlock(myMutex);
 }
@@ -113,7 +578,18 @@ void WorkerPool::handleFrameServerDrainedEvent(void *userdata) {
 	}
 	YerFace_MutexLock(self->myMutex);
 	self->frameServerDrained = true;
-	SDL_CondBroadcast(self->myCond);
+	self->wakeWorkers(true);
+	YerFace_MutexUnlock(self->myMutex);
+}
+
+void WorkerPool::handleStatusChangeEvent(void *userdata) {
+	WorkerPool *self = (WorkerPool *)userdata;
+	YerFace_MutexLock(self->myMutex);
+	//Everybody re-checks the status (and handler pools re-scan), so a stop is never slept through.
+	if(self->parameters.handler != NULL) {
+		self->pendingSignals = self->parameters.numWorkers;
+	}
+	self->wakeWorkers(true);
 	YerFace_MutexUnlock(self->myMutex);
 }
 
@@ -123,35 +599,40 @@ int WorkerPool::outerWorkerLoop(void *ptr) {
 	try {
 		self->logger->debug1("Worker Thread #%d Alive!", worker->num);
 
-		if(self->parameters.initializer != NULL) {
-			self->parameters.initializer(worker, self->parameters.usrPtr);
-		}
+		string threadName = self->parameters.name + " Worker Thread #" + to_string(worker->num);
+		self->parameters.affinity.applyToCurrentThread(worker->num - 1, self->parameters.numWorkers, self->logger, threadName.c_str());
+
+		self->initializeWorker(worker);
 
 		YerFace_MutexLock(self->myMutex);
 		while(!self->frameServerDrained && self->running) {
 			// self->logger->debug4("Thread #%d Top of Loop", worker->num);
 
+			//Workers above our autoscaled size park until we grow (or stop).
+			if(worker->num > self->getEffectiveWorkerLimit()) {
+				if(SDL_CondWait(self->parkCond, self->myMutex) < 0) {
+					throw runtime_error("CondWait() failed!");
+				}
+				continue;
+			}
+
 			if(self->status->getIsPaused() && self->status->getIsRunning()) {
 				YerFace_MutexUnlock(self->myMutex);
-				SDL_Delay(100);
+				self->status->waitWhilePaused();
 				YerFace_MutexLock(self->myMutex);
 				continue;
 			}
 
-			YerFace_MutexUnlock(self->myMutex);
-			bool didWork = self->parameters.handler(worker);
-			YerFace_MutexLock(self->myMutex);
+			bool didWork = self->doWork(worker);
 
-			//If there is no work available, go to sleep and wait.
-			if(!didWork) {
+			//If there is no work available, go to sleep until somebody signals us. (No polling!)
+			if(!didWork && !self->hasPendingWork() && !self->frameServerDrained && self->running) {
 				// self->logger->verbose("Thread #%d entering CondWait...", worker->num);
-				int result = SDL_CondWaitTimeout(self->myCond, self->myMutex, 1000);
+				self->idleWorkers++;
+				int result = SDL_CondWait(self->myCond, self->myMutex);
+				self->idleWorkers--;
 				if(result < 0) {
-					throw runtime_error("CondWaitTimeout() failed!");
-				} else if(result == SDL_MUTEX_TIMEDOUT) {
-					if(!self->status->getIsPaused() && !self->frameServerDrained) {
-						self->logger->warning("Thread #%d timed out waiting for Condition signal!", worker->num);
-					}
+					throw runtime_error("CondWait() failed!");
 				}
 				// self->logger->verbose("Thread #%d left CondWait!", worker->num);
 			}
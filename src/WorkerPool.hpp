@@ -2,50 +2,125 @@
 
 #include "Logger.hpp"
 #include "Status.hpp"
+#include "Metrics.hpp"
+#include "CPUAffinity.hpp"
 #include "FrameServer.hpp"
 #include "Utilities.hpp"
 
 #include "SDL.h"
 
+#include <map>
+
 using namespace std;
 
 namespace YerFace {
 
+//Scheduled workers may run this many times before yielding their WorkScheduler thread.
+#define YERFACE_WORKERPOOL_SCHEDULED_QUANTUM 16
+#define YERFACE_WORKERPOOL_PAUSE_MILLISECONDS 100
+
 class WorkerPool;
+class WorkScheduler;
+
+enum WorkerPoolWorkerState: unsigned int {
+	WORKER_IDLE = 0, //Nothing to do. Will be submitted to the WorkScheduler when work arrives.
+	WORKER_QUEUED = 1, //Waiting in a WorkScheduler deque.
+	WORKER_RUNNING = 2, //Running on a WorkScheduler thread.
+	WORKER_DONE = 3 //Deinitialized, and will never run again.
+};
 
 class WorkerPoolWorker {
 public:
 	int num;
-	SDL_Thread *thread;
+	SDL_Thread *thread; //NULL unless the pool has dedicated threads.
 	void *ptr;
 	WorkerPool *pool;
+	WorkerPoolWorkerState state; //Only meaningful for pools running on the WorkScheduler.
+	bool initialized;
+	int preferredSchedulerThread; //WorkScheduler thread this worker was routed to for frame affinity, or zero.
+};
+
+//A unit of work pushed onto a WorkerPool's own task queue.
+class WorkerPoolTask {
+public:
+	FrameNumber frameNumber;
+	double deadline; //From FrameServer::getFrameDeadline(). Workers always take the task with the nearest deadline.
+	bool shedIfLate; //Counts a missed deadline as shed. The taskHandler is still called, and is expected to skip the work.
+	bool missedDeadline; //Set by the pool just before the taskHandler runs. (Always false outside of low latency mode.)
+	void *payload;
 };
 
 typedef function<void(WorkerPoolWorker *worker, void *ptr)> WorkerPoolWorkerInitializer;
 typedef function<bool(WorkerPoolWorker *worker)> WorkerPoolWorkerHandler;
+typedef function<void(WorkerPoolWorker *worker, WorkerPoolTask task)> WorkerPoolWorkerTaskHandler;
 typedef function<void(WorkerPoolWorker *worker, void *ptr)> WorkerPoolWorkerDeinitializer;
+typedef function<size_t(void *ptr)> WorkerPoolBacklog;
 
 class WorkerPoolParameters {
 public:
 	string name;
 	double numWorkersPerCPU;
 	int numWorkers;
+	bool dedicatedThreads; //If true, each worker gets its own thread instead of sharing the WorkScheduler. (For handlers which block!)
+	CPUAffinity affinity; //Pinning for dedicated threads. Overridden by YerFace.CPUAffinity.pools.<name>, and implies dedicatedThreads.
 
 	WorkerPoolWorkerInitializer initializer;
 	WorkerPoolWorkerDeinitializer deinitializer;
 	void *usrPtr;
 
+	//Exactly one of these must be set. Pools with a handler are woken by sendWorkerSignal()
+	//and scan their module's state. Pools with a taskHandler are fed by pushTask().
 	WorkerPoolWorkerHandler handler;
+	WorkerPoolWorkerTaskHandler taskHandler;
+
+	//Optional. Reports how much work is waiting on a handler pool, so it can autoscale. (Task pools use their own queue depth.)
+	//Called without the pool's lock held, so it may take the module's own locks.
+	WorkerPoolBacklog backlog;
+};
+
+//A snapshot of a pool's autoscaling state. (See WorkerPool::getScalingStats().)
+class WorkerPoolScalingStats {
+public:
+	bool autoscaling;
+	int numWorkers; //The most the pool will ever run.
+	int scaledWorkers; //Workers the autoscaler currently allows to run. (Equal to numWorkers without autoscaling.)
+	int peakScaledWorkers;
+	int growEvents, shrinkEvents;
 };
 
+// Autoscaling: pools listed under YerFace.WorkerPoolAutoscaling.pools start
+// with minWorkers running and grow toward their full worker count (which
+// becomes the maximum) while the backlog per running worker stays above
+// growAboveBacklogPerWorker, then shrink back while it stays below
+// shrinkBelowBacklogPerWorker. Each step needs the condition to persist for
+// growAfterSeconds (or shrinkAfterSeconds), and growing onto a worker which
+// has never been initialized also waits out the slowest initializer seen so
+// far, since a backlog which clears before the new worker is ready isn't worth
+// the cost. Shrinking only parks workers, so growing again later is cheap.
 class WorkerPool {
 public:
 	WorkerPool(json config, Status *myStatus, FrameServer *myFrameServer, WorkerPoolParameters myParameters);
 	~WorkerPool() noexcept(false);
-	void sendWorkerSignal(void);
+	void sendWorkerSignal(int schedulerThreadHint = 0); //Hint with WorkScheduler::getFrameAffinity() to keep a frame's stages on one core.
+	void pushTask(WorkerPoolTask task, int schedulerThreadHint = 0);
 	void stopWorkerNow(void);
+	int getNumWorkers(void);
+	Metrics *getMetrics(void); //NULL unless the ThreadBudgetPlanner is managing this pool.
+	void setActiveWorkerLimit(int limit);
+	WorkerPoolScalingStats getScalingStats(void); //Safe to call at any time while the pool is running.
+	static void runScheduledWorker(WorkerPoolWorker *worker);
 private:
+	bool doWork(WorkerPoolWorker *worker);
+	bool hasPendingWork(void);
+	void wakeWorkers(bool everyone, int schedulerThreadHint = 0);
+	void finishScheduledWorker(WorkerPoolWorker *worker);
+	void initializeWorker(WorkerPoolWorker *worker);
+	int getEffectiveWorkerLimit(void);
+	void considerScaling(void);
+	void setScaledWorkers(int newScaledWorkers, size_t backlog);
+	void startDedicatedWorker(WorkerPoolWorker *worker);
 	static void handleFrameServerDrainedEvent(void *userdata);
+	static void handleStatusChangeEvent(void *userdata);
 	static int outerWorkerLoop(void *ptr);
 
 	Status *status;
@@ -56,9 +131,32 @@ private:
 	Logger *logger;
 	SDL_mutex *myMutex;
 	SDL_cond *myCond;
+	SDL_cond *parkCond; //Dedicated workers above the autoscaled size or the planner's limit sleep here.
 
 	bool frameServerDrained, running;
 
+	std::multimap<double, WorkerPoolTask> tasks; //Keyed by deadline, so the earliest is always first. Equal keys keep insertion (FIFO) order.
+	int pendingSignals; //Signals which arrived since the last time a worker started scanning for work.
+	int idleWorkers; //Dedicated workers currently asleep on myCond.
+
+	WorkScheduler *scheduler; //NULL if we are running on dedicated threads.
+	size_t doneWorkers;
+	int activeWorkerLimit; //Workers numbered above this stay idle (scheduled) or park (dedicated). (Set by the ThreadBudgetPlanner.)
+	bool planned;
+	Metrics *metrics;
+
+	bool autoscaling;
+	int minWorkers;
+	int scaledWorkers;
+	double evaluateEverySeconds;
+	double growAboveBacklogPerWorker, shrinkBelowBacklogPerWorker;
+	double growAfterSeconds, shrinkAfterSeconds;
+	double lastScalingCheck;
+	bool scalingCheckInProgress;
+	double backlogHighSince, backlogLowSince; //Negative when the backlog is not past the respective threshold.
+	double slowestInitializerSeconds;
+	int growEvents, shrinkEvents, peakScaledWorkers;
+
 	std::list<WorkerPoolWorker *> workers;
 };
 
@@ -14,6 +14,10 @@
 #include "EventLogger.hpp"
 #include "PreviewHUD.hpp"
 #include "WorkerPool.hpp"
+#include "WorkScheduler.hpp"
+#include "ThreadBudgetPlanner.hpp"
+#include "LatencyController.hpp"
+#include "CPUAffinity.hpp"
 
 #include <iostream>
 #include <sstream>
@@ -71,6 +75,9 @@ WorkerPool *videoCaptureWorkerPool;
 
 Status *status = NULL;
 Logger *logger = NULL;
+WorkScheduler *workScheduler = NULL;
+ThreadBudgetPlanner *threadBudgetPlanner = NULL;
+LatencyController *latencyController = NULL;
 SDLDriver *sdlDriver = NULL;
 FFmpegDriver *ffmpegDriver = NULL;
 FrameServer *frameServer = NULL;
@@ -300,9 +307,16 @@ int yerface(int argc, char *argv[]) {
 	status = new Status(lowLatency);
 	metrics = new Metrics(config, "YerFace", true);
 	previewMetrics = new Metrics(config, "YerFace[Preview/Event Loop]", false);
+	std::vector<int> isolatedCores;
+	for(json core : config["YerFace"]["CPUAffinity"]["isolatedCores"]) {
+		isolatedCores.push_back(core);
+	}
+	CPUAffinity::setIsolatedCores(isolatedCores);
+	workScheduler = new WorkScheduler(config, status);
+	threadBudgetPlanner = new ThreadBudgetPlanner(config, status);
 	frameServer = new FrameServer(config, status, lowLatency);
 	previewHUD = new PreviewHUD(config, status, frameServer, previewMirrorBool);
-	ffmpegDriver = new FFmpegDriver(status, frameServer, lowLatency, false);
+	ffmpegDriver = new FFmpegDriver(config, status, frameServer, lowLatency, false);
 	ffmpegDriver->openInputMedia(inVideo, AVMEDIA_TYPE_VIDEO, inVideoFormat, inVideoSize, "", inVideoRate, inVideoCodec, inAudioChannelMap, tryAudioInVideo);
 	if(openInputAudio) {
 		ffmpegDriver->openInputMedia(inAudio, AVMEDIA_TYPE_AUDIO, inAudioFormat, "", inAudioChannels, inAudioRate, inAudioCodec, inAudioChannelMap, true);
@@ -317,6 +331,9 @@ int yerface(int argc, char *argv[]) {
 	faceDetector = new FaceDetector(config, status, frameServer);
 	faceTracker = new FaceTracker(config, status, sdlDriver, frameServer, faceDetector);
 	faceMapper = new FaceMapper(config, status, frameServer, faceTracker, previewHUD);
+	if(lowLatency && config["YerFace"]["LatencyController"]["enabled"]) {
+		latencyController = new LatencyController(config, status, frameServer, faceDetector, faceTracker);
+	}
 	if(outEventData.length() > 0 && fileExists(outEventData)) {
 		throw invalid_argument("Refusing to overwrite outEventData. Specified file already exists!");
 	}
@@ -345,7 +362,7 @@ int yerface(int argc, char *argv[]) {
 	if(!headless) {
 		frameStatusChangeCallback.newStatus = FRAME_STATUS_PREVIEW_DISPLAY;
 		frameServer->onFrameStatusChangeEvent(frameStatusChangeCallback);
-		frameServer->registerFrameStatusCheckpoint(FRAME_STATUS_PREVIEW_DISPLAY, "main.PreviewDisplayed");
+		frameServer->registerFrameStatusCheckpoint(FRAME_STATUS_PREVIEW_DISPLAY, FRAME_CHECKPOINT_PREVIEWDISPLAYED);
 	}
 	frameStatusChangeCallback.newStatus = FRAME_STATUS_GONE;
 	frameServer->onFrameStatusChangeEvent(frameStatusChangeCallback);
@@ -355,6 +372,8 @@ int yerface(int argc, char *argv[]) {
 	workerPoolParameters.name = "Main.VideoCapture";
 	workerPoolParameters.numWorkers = 1;
 	workerPoolParameters.numWorkersPerCPU = 0.0;
+	workerPoolParameters.dedicatedThreads = true; //Inserting frames and draining both block, so this must not tie up a WorkScheduler thread.
+	workerPoolParameters.affinity = CPUAffinity::isolated();
 	workerPoolParameters.initializer = videoCaptureInitializer;
 	workerPoolParameters.deinitializer = videoCaptureDeinitializer;
 	workerPoolParameters.usrPtr = NULL;
@@ -391,7 +410,7 @@ int yerface(int argc, char *argv[]) {
 			while(previewFrames.size() > 0) {
 				if(previewTargetFrameNumber != -1) {
 					// We had a previous "target" preview frame, we should release it from the pipeline.
-					frameServer->setWorkingFrameStatusCheckpoint(previewTargetFrameNumber, FRAME_STATUS_PREVIEW_DISPLAY, "main.PreviewDisplayed");
+					frameServer->setWorkingFrameStatusCheckpoint(previewTargetFrameNumber, FRAME_STATUS_PREVIEW_DISPLAY, FRAME_CHECKPOINT_PREVIEWDISPLAYED);
 				}
 				previewTargetFrameNumber = previewFrames.back();
 				previewFrames.pop_back();
@@ -410,7 +429,7 @@ int yerface(int argc, char *argv[]) {
 		// If we're shutting down, don't hang on to the previous frame.
 		if(!status->getIsRunning()) {
 			if(previewTargetFrameNumber != -1) {
-				frameServer->setWorkingFrameStatusCheckpoint(previewTargetFrameNumber, FRAME_STATUS_PREVIEW_DISPLAY, "main.PreviewDisplayed");
+				frameServer->setWorkingFrameStatusCheckpoint(previewTargetFrameNumber, FRAME_STATUS_PREVIEW_DISPLAY, FRAME_CHECKPOINT_PREVIEWDISPLAYED);
 				previewTargetFrameNumber = -1;
 			}
 		}
@@ -450,16 +469,20 @@ int yerface(int argc, char *argv[]) {
 		delete sphinxDriver;
 	}
 	YerFace_CarefullyDelete(logger, status, outputDriver);
+	YerFace_CarefullyDelete(logger, status, latencyController);
 	YerFace_CarefullyDelete(logger, status, faceMapper);
 	YerFace_CarefullyDelete(logger, status, faceTracker);
 	YerFace_CarefullyDelete(logger, status, faceDetector);
 	YerFace_CarefullyDelete(logger, status, previewHUD);
 	YerFace_CarefullyDelete(logger, status, frameServer);
+	YerFace_CarefullyDelete(logger, status, threadBudgetPlanner);
+	YerFace_CarefullyDelete(logger, status, workScheduler);
 	YerFace_CarefullyDelete(logger, status, ffmpegDriver);
 	YerFace_CarefullyDelete(logger, status, sdlDriver);
 	YerFace_CarefullyDelete(logger, status, previewMetrics);
 	YerFace_CarefullyDelete(logger, status, metrics);
 	YerFace_CarefullyDelete_NoStatus(logger, status);
+	MutexProfiler::logReport();
 	try {
 		logger->notice("Goodbye!");
 		delete logger;
@@ -526,6 +549,8 @@ bool videoCaptureHandler(WorkerPoolWorker *worker) {
 }
 
 void videoCaptureDeinitializer(WorkerPoolWorker *worker, void *ptr) {
+	//Our pool is about to be destroyed, so the demuxers must stop signalling it.
+	ffmpegDriver->setVideoCaptureWorkerPool(NULL);
 	sdlDriver->stopAudioDriverNow();
 
 	if(status->getEmergency()) {